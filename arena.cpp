@@ -0,0 +1,60 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include "config.h"
+#include "arena.h"
+
+Arena::Arena(size_t block_size) {
+  this->block_size = block_size;
+  cur_block = 0;
+  used = 0;
+}
+
+Arena::~Arena() {
+  for (auto it = blocks.begin(); it != blocks.end(); ++it) {
+    free(*it);
+  }
+}
+
+/*
+ * Returns size bytes aligned to align, a power of 2. Requests larger than the
+ * block size get a block of their own.
+ */
+void* Arena::alloc(size_t size, size_t align) {
+  size_t offset = (used + align - 1) & ~(align - 1);
+
+  if (cur_block < blocks.size() && offset + size <= block_size) {
+    used = offset + size;
+    return blocks[cur_block] + offset;
+  }
+
+  // move on to the next block, reusing blocks kept by reset()
+  if (cur_block < blocks.size()) {
+    ++cur_block;
+  }
+  if (cur_block >= blocks.size() || size > block_size) {
+    char *block = static_cast<char*>(malloc(size > block_size ? size 
+                                                              : block_size));
+    if (block == NULL) {
+      throw std::bad_alloc();
+    }
+    blocks.insert(blocks.begin() + cur_block, block);
+  }
+  // malloc alignment is enough for every type placed in an arena
+  used = size;
+  if (size > block_size) {
+    // oversized blocks are never reused for anything else
+    used = block_size;
+  }
+  return blocks[cur_block];
+}
+
+/*
+ * Frees everything allocated so far, keeping the blocks for reuse
+ */
+void Arena::reset() {
+  cur_block = 0;
+  used = 0;
+}
@@ -0,0 +1,36 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "config.h"
+
+/*
+ * Bump allocator that hands out memory from large blocks and frees it all at
+ * once. The arena never runs destructors, whoever places an object with 
+ * resources of its own in it has to destroy that object explicitly.
+ */
+class Arena {
+  std::vector<char*> blocks;
+  size_t block_size;
+  size_t cur_block;
+  size_t used;
+
+  public:
+    Arena(size_t block_size = ARENA_BLOCK_SIZE);
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* alloc(size_t size, size_t align);
+    void reset();
+
+    template <typename T>
+    T* alloc_array(size_t n) {
+      return static_cast<T*>(alloc(n * sizeof (T), alignof(T)));
+    }
+};
+
+#endif
@@ -0,0 +1,420 @@
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "config.h"
+#include "character.h"
+#include "region.h"
+#include "save.h"
+#include "autosave.h"
+
+extern Region *region_ptr[WORLD_SIZE][WORLD_SIZE];
+extern Pc *pc;
+extern uint64_t world_tick;
+extern uint64_t world_seed;
+
+/*
+ * Journal format, all integers little-endian
+ *
+ *   header: "PKJL" | u8 version
+ *   record: u8 type | u32 length | payload | u32 fnv-1a of payload
+ *
+ *   rec_player: the player, as in the save file
+ *   rec_region: u16 x | u16 y | region, as in the save file
+ *   rec_commit: u64 world tick
+ *
+ * A checkpoint is every record since the previous commit. Only the records 
+ * of the player and the regions that changed are written, and recovery 
+ * ignores a checkpoint whose commit never made it to disk.
+ *
+ * The writer thread keeps the latest record of everything, so compaction can
+ * write a full save file without touching the game, after which the journal 
+ * starts over.
+ */
+
+typedef enum journal_rec {
+  rec_player = 1,
+  rec_region,
+  rec_commit
+} journal_rec_t;
+
+typedef struct journal_entry {
+  journal_rec_t type;
+  std::string payload;
+} journal_entry_t;
+
+typedef struct checkpoint {
+  std::vector<journal_entry_t> entries;
+  uint64_t tick;
+  bool compact;
+  // non-zero for a save the game thread waits on
+  uint64_t save_seq;
+} checkpoint_t;
+
+static std::string save_path, journal_path;
+static std::thread writer_thread;
+static std::mutex queue_mutex;
+static std::condition_variable queue_wake;
+static std::deque<checkpoint_t> queue;
+static bool writer_running = false;
+static bool writer_stopping = false;
+static uint64_t last_checkpoint_tick = 0;
+// saves asked for by the player, and the outcome of the last one written
+static uint64_t save_seq_asked = 0;
+static uint64_t save_seq_done = 0;
+static bool save_ok = false;
+static std::condition_variable save_done;
+// game thread copy of the last player record, to skip unchanged players
+static std::string last_player;
+
+// writer thread state
+static FILE *journal_f = NULL;
+static std::string latest_player;
+static std::map<uint32_t, std::string> latest_regions;
+static uint64_t latest_tick = 0;
+
+static uint32_t fnv1a32(const std::string &s) {
+  uint32_t h = 0x811c9dc5;
+  for (size_t k = 0; k < s.size(); ++k) {
+    h ^= static_cast<uint8_t>(s[k]);
+    h *= 0x01000193;
+  }
+  return h;
+}
+
+/*
+ * Serializes into memory with the same writer the save file uses
+ */
+static std::string serialize_player() {
+  char *buf = NULL;
+  size_t len = 0;
+  FILE *f = open_memstream(&buf, &len);
+  SaveWriter out(f);
+  pc->save(&out);
+  fclose(f);
+  std::string s(buf, len);
+  free(buf);
+  return s;
+}
+
+static std::string serialize_region(int32_t x, int32_t y) {
+  char *buf = NULL;
+  size_t len = 0;
+  FILE *f = open_memstream(&buf, &len);
+  SaveWriter out(f);
+  out.u16(x);
+  out.u16(y);
+  region_ptr[x][y]->save(&out);
+  fclose(f);
+  std::string s(buf, len);
+  free(buf);
+  return s;
+}
+
+static void write_record(FILE *f, journal_rec_t type, const std::string &p) {
+  SaveWriter out(f);
+  out.u8(type);
+  out.u32(p.size());
+  out.bytes(p.data(), p.size());
+  out.u32(fnv1a32(p));
+}
+
+/*
+ * Starts a new, empty journal
+ */
+static void reset_journal() {
+  if (journal_f) {
+    fclose(journal_f);
+  }
+  journal_f = fopen(journal_path.c_str(), "wb");
+  if (journal_f) {
+    fwrite(JOURNAL_MAGIC, 1, 4, journal_f);
+    fputc(JOURNAL_VERSION, journal_f);
+    fflush(journal_f);
+  }
+}
+
+/*
+ * Writes a full save file from the latest records, then empties the journal.
+ * A crash in between only means the journal is replayed over records that
+ * are already in the save file.
+ * Returns false if the save file could not be written.
+ */
+static bool compact() {
+  std::string tmp_path = save_path + ".tmp";
+  FILE *f = fopen(tmp_path.c_str(), "wb");
+  if (!f) {
+    return false;
+  }
+  setvbuf(f, NULL, _IOFBF, SAVE_BUFFER_SIZE);
+  SaveWriter out(f);
+  out.bytes(SAVE_MAGIC, 4);
+  out.u8(SAVE_VERSION);
+  out.u64(latest_tick);
+  out.u64(world_seed);
+  out.u32(latest_regions.size());
+  out.bytes(latest_player.data(), latest_player.size());
+  for (auto it = latest_regions.begin(); it != latest_regions.end(); ++it) {
+    out.bytes(it->second.data(), it->second.size());
+  }
+  bool ok = !ferror(f) && fflush(f) == 0 && fsync(fileno(f)) == 0;
+  ok = (fclose(f) == 0) && ok;
+  if (!ok || rename(tmp_path.c_str(), save_path.c_str()) != 0) {
+    remove(tmp_path.c_str());
+    return false;
+  }
+  reset_journal();
+  return true;
+}
+
+static void writer_thread_main() {
+  std::unique_lock<std::mutex> lock(queue_mutex);
+
+  while (true) {
+    queue_wake.wait(lock, [] { return !queue.empty() || writer_stopping; });
+    if (queue.empty()) {
+      break;
+    }
+    checkpoint_t cp = std::move(queue.front());
+    queue.pop_front();
+    lock.unlock();
+
+    for (auto it = cp.entries.begin(); it != cp.entries.end(); ++it) {
+      if (journal_f) {
+        write_record(journal_f, it->type, it->payload);
+      }
+      if (it->type == rec_player) {
+        latest_player = it->payload;
+      } else {
+        const uint8_t *p = 
+          reinterpret_cast<const uint8_t*>(it->payload.data());
+        uint32_t key = (p[0] | p[1] << 8) * WORLD_SIZE + (p[2] | p[3] << 8);
+        latest_regions[key] = it->payload;
+      }
+    }
+    latest_tick = cp.tick;
+    if (journal_f) {
+      std::string tick(8, '\0');
+      for (int32_t b = 0; b < 8; ++b) {
+        tick[b] = (cp.tick >> (8 * b)) & 0xff;
+      }
+      write_record(journal_f, rec_commit, tick);
+      fflush(journal_f);
+      fsync(fileno(journal_f));
+    }
+    bool ok = true;
+    if (cp.compact || !journal_f
+        || ftell(journal_f) > AUTOSAVE_COMPACT_BYTES) {
+      ok = compact();
+    }
+
+    lock.lock();
+    if (cp.save_seq) {
+      save_seq_done = cp.save_seq;
+      save_ok = ok;
+      save_done.notify_all();
+    }
+  }
+}
+
+/*
+ * Starts autosaving the world to path and its journal on a writer thread.
+ * The first checkpoint holds every region and is compacted right away, so 
+ * the save file always has a complete world to apply the journal to.
+ */
+void autosave_start(const char *path) {
+  save_path = path;
+  journal_path = save_path + ".journal";
+  reset_journal();
+
+  for (int32_t x = 0; x < WORLD_SIZE; ++x) {
+    for (int32_t y = 0; y < WORLD_SIZE; ++y) {
+      if (region_ptr[x][y] != NULL) {
+        region_ptr[x][y]->mark_dirty();
+      }
+    }
+  }
+  last_player.clear();
+
+  writer_stopping = false;
+  writer_running = true;
+  writer_thread = std::thread(writer_thread_main);
+  autosave_checkpoint(true);
+}
+
+/*
+ * Called once per frame, checkpoints whenever enough game time has passed
+ */
+void autosave_tick() {
+  if (writer_running && world_tick - last_checkpoint_tick >= AUTOSAVE_TICKS) {
+    autosave_checkpoint(false);
+  }
+}
+
+/*
+ * Hands the player, if it changed, and every dirty region to the writer 
+ * thread. Only the serializing happens on the game thread.
+ */
+static void queue_checkpoint(bool compact, uint64_t save_seq) {
+  checkpoint_t cp;
+  cp.tick = world_tick;
+  cp.compact = compact;
+  cp.save_seq = save_seq;
+
+  std::string player = serialize_player();
+  if (player != last_player) {
+    cp.entries.push_back({rec_player, player});
+    last_player = player;
+  }
+  for (int32_t x = 0; x < WORLD_SIZE; ++x) {
+    for (int32_t y = 0; y < WORLD_SIZE; ++y) {
+      if (region_ptr[x][y] != NULL && region_ptr[x][y]->is_dirty()) {
+        cp.entries.push_back({rec_region, serialize_region(x, y)});
+        region_ptr[x][y]->clear_dirty();
+      }
+    }
+  }
+  last_checkpoint_tick = world_tick;
+
+  std::lock_guard<std::mutex> lock(queue_mutex);
+  queue.push_back(std::move(cp));
+  queue_wake.notify_one();
+}
+
+void autosave_checkpoint(bool compact) {
+  if (!writer_running) {
+    return;
+  }
+  queue_checkpoint(compact, 0);
+}
+
+/*
+ * Folds everything into the save file and waits for the writer thread to 
+ * finish it. Returns false if the save file could not be written.
+ */
+bool autosave_save() {
+  if (!writer_running) {
+    return false;
+  }
+  uint64_t seq = ++save_seq_asked;
+  queue_checkpoint(true, seq);
+  std::unique_lock<std::mutex> lock(queue_mutex);
+  save_done.wait(lock, [seq] { return save_seq_done >= seq; });
+  return save_ok;
+}
+
+/*
+ * Writes a last checkpoint and waits for everything to reach the disk
+ */
+void autosave_stop() {
+  if (!writer_running) {
+    return;
+  }
+  autosave_checkpoint(true);
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    writer_stopping = true;
+    queue_wake.notify_one();
+  }
+  writer_thread.join();
+  writer_running = false;
+  if (journal_f) {
+    fclose(journal_f);
+    journal_f = NULL;
+  }
+}
+
+bool autosave_active() {
+  return writer_running;
+}
+
+/*
+ * Applies one journal record to the loaded world
+ */
+static bool apply_record(journal_rec_t type, std::string &payload, 
+                         bool packed) {
+  FILE *f = fmemopen(&payload[0], payload.size(), "rb");
+  if (!f) {
+    return false;
+  }
+  SaveReader in(f, packed);
+  if (type == rec_player) {
+    delete pc;
+    pc = new Pc(&in);
+  } else if (type == rec_region) {
+    int32_t x = in.u16();
+    int32_t y = in.u16();
+    if (x >= WORLD_SIZE || y >= WORLD_SIZE) {
+      fclose(f);
+      return false;
+    }
+    delete region_ptr[x][y];
+    region_ptr[x][y] = new Region(&in);
+  } else {
+    world_tick = in.u64();
+  }
+  fclose(f);
+  return in.good();
+}
+
+/*
+ * Replays the journal next to the save file at path over the world loaded 
+ * from it, one committed checkpoint at a time. A torn checkpoint at the end 
+ * of the journal is ignored. Returns false only if a record fails to apply.
+ */
+bool autosave_recover(const char *path) {
+  std::string jpath = std::string(path) + ".journal";
+  FILE *f = fopen(jpath.c_str(), "rb");
+  char magic[4];
+
+  if (!f) {
+    return true;
+  }
+  setvbuf(f, NULL, _IOFBF, SAVE_BUFFER_SIZE);
+  SaveReader in(f);
+  in.bytes(magic, 4);
+  uint8_t version = in.u8();
+  if (!in.good() || memcmp(magic, JOURNAL_MAGIC, 4) 
+      || version < 1 || version > JOURNAL_VERSION) {
+    fclose(f);
+    return true;
+  }
+  // version 1 journals hold version 1 records
+  bool packed = version >= 2;
+
+  std::vector<journal_entry_t> pending;
+  bool ok = true;
+  while (ok) {
+    journal_rec_t type = static_cast<journal_rec_t>(in.u8());
+    uint32_t len = in.u32();
+    if (!in.good() || type < rec_player || type > rec_commit 
+        || len > AUTOSAVE_COMPACT_BYTES * 2) {
+      break;
+    }
+    std::string payload(len, '\0');
+    in.bytes(&payload[0], len);
+    uint32_t sum = in.u32();
+    if (!in.good() || sum != fnv1a32(payload)) {
+      break;
+    }
+    pending.push_back({type, payload});
+    if (type == rec_commit) {
+      for (auto it = pending.begin(); it != pending.end() && ok; ++it) {
+        ok = apply_record(it->type, it->payload, packed);
+      }
+      pending.clear();
+    }
+  }
+
+  fclose(f);
+  return ok;
+}
@@ -0,0 +1,17 @@
+#ifndef AUTOSAVE_H
+#define AUTOSAVE_H
+
+#include <cstdint>
+
+#define JOURNAL_MAGIC "PKJL"
+#define JOURNAL_VERSION 2
+
+void autosave_start(const char *path);
+void autosave_tick();
+void autosave_checkpoint(bool compact);
+bool autosave_save();
+void autosave_stop();
+bool autosave_active();
+bool autosave_recover(const char *path);
+
+#endif
@@ -0,0 +1,223 @@
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "config.h"
+#include "battle.h"
+#include "pokemon.h"
+#include "rng.h"
+#include "trainer_events.h"
+
+/*
+ * Determines if a catch is successful
+ * https://bulbapedia.bulbagarden.net/wiki/Catch_rate#Capture_method_.28Generation_III-IV.29
+ */
+bool is_catch_success(item_t ball, Pokemon *opp) {
+  float bonus_ball;
+  switch (ball) {
+    case item_poke_ball:
+      bonus_ball = 1;
+      break;
+    case item_great_ball:
+      bonus_ball = 1.5;
+      break;
+    case item_ultra_ball:
+      bonus_ball = 2;
+      break;
+    case item_master_ball:
+      // master ball has 100% catch rate
+      // bonus_ball = 255;
+      return true;
+    default:
+      // this item is not a poke ball
+      return false;
+  }
+  
+  float bonus_status = 1; // status effects are not implemented
+  int32_t a = ( (3 * opp->get_base_stat(stat_hp) - 2 * opp->get_current_hp())
+                * opp->get_pd_species_entry()->capture_rate * bonus_ball)
+              / (3.0 * opp->get_base_stat(stat_hp)) 
+              * bonus_status;
+  return (rng_rand() % 256) <= a;
+}
+
+Battle::Battle(Pokemon *pc_active, Pokemon *opp_active,
+               battle_listener_t listener, void *listener_ctx) {
+  active[side_pc] = pc_active;
+  active[side_opp] = opp_active;
+  escape_attempts = 0;
+  this->listener = listener;
+  this->listener_ctx = listener_ctx;
+}
+
+void Battle::emit(battle_event_type_t type, battle_side_t side, 
+                  pd_move_t *move, item_t item, int32_t value, float eff) {
+  if (listener == NULL) {
+    return;
+  }
+  battle_event_t e;
+  e.type = type;
+  e.side = side;
+  e.p = active[side];
+  e.move = move;
+  e.item = item;
+  e.value = value;
+  e.eff = eff;
+  listener(this, &e, listener_ctx);
+}
+
+Pokemon* Battle::get_active(battle_side_t side) {
+  return active[side];
+}
+void Battle::set_active(battle_side_t side, Pokemon *p) {
+  active[side] = p;
+}
+
+/*
+ * Returns true if the opposing pokemon does not belong to a trainer
+ */
+bool Battle::is_wild() {
+  return !active[side_opp]->get_has_owner();
+}
+
+/*
+ * Process a single attack of one side on the other.
+ * A move slot of -1 uses struggle.
+ * Returns true if the defending pokemon fainted
+ */
+bool Battle::attack(battle_side_t attacker_side, int32_t move_slot) {
+  battle_side_t defender_side = attacker_side == side_pc ? side_opp : side_pc;
+  Pokemon *attacker = active[attacker_side];
+  Pokemon *defender = active[defender_side];
+  pd_move_t *move = attacker->get_move(move_slot);
+
+  if (!attacker->has_pp()) {
+    emit(bev_no_pp, attacker_side, NULL, item_empty, 0, 1);
+  }
+  emit(bev_use_move, attacker_side, move, item_empty, 0, 1);
+  attacker->use_pp(move_slot);
+
+  if (is_miss(move)) {
+    emit(bev_miss, attacker_side, move, item_empty, 0, 1);
+    return false;
+  }
+  if (move->damage_class_id == 1) {
+    // STATUS MOVES ARE NOT IMPLEMENTED
+    emit(bev_status, attacker_side, move, item_empty, 0, 1);
+    return false;
+  }
+
+  bool critical = is_critical(attacker, move);
+  int32_t damage = calculate_damage(attacker, move, defender, critical);
+  defender->take_damage(damage);
+  emit(bev_damage, defender_side, move, item_empty, damage, 1);
+
+  float type = effectiveness(move, defender);
+  if (critical && type != 0) {
+    emit(bev_critical, attacker_side, move, item_empty, 0, type);
+  }
+  if (type != 1) {
+    emit(bev_effectiveness, defender_side, move, item_empty, 0, type);
+  }
+  if (defender->is_fainted()) {
+    emit(bev_faint, defender_side, NULL, item_empty, 0, 1);
+    return true;
+  }
+  return false;
+}
+
+/*
+ * Process a full turn where both sides use a move, in order of priority.
+ * Returns true if a pokemon fainted
+ */
+bool Battle::fight(int32_t pc_move_slot, int32_t opp_move_slot) {
+  int32_t priority = move_priority(
+                       active[side_pc]->get_move(pc_move_slot)->priority, 
+                       active[side_pc]->get_stat(stat_speed),
+                       active[side_opp]->get_move(opp_move_slot)->priority, 
+                       active[side_opp]->get_stat(stat_speed));
+
+  if (priority > 0) {
+    return attack(side_pc, pc_move_slot) 
+        || attack(side_opp, opp_move_slot);
+  }
+  return attack(side_opp, opp_move_slot) 
+      || attack(side_pc, pc_move_slot);
+}
+
+/*
+ * Attempts to run from the battle.
+ * Returns true only if escape is successful.
+ */
+bool Battle::escape() {
+  Pokemon *pc_active = active[side_pc];
+  Pokemon *opp = active[side_opp];
+
+  if (!is_wild()) {
+    emit(bev_escape_blocked, side_pc, NULL, item_empty, 0, 1);
+    return false;
+  }
+
+  int32_t escape_odds = (pc_active->get_stat(stat_speed) * 32)
+                        / ((opp->get_stat(stat_speed) / 4) % 256) 
+                        + 30 * escape_attempts;
+  if (rng_rand() % 256 < escape_odds) {
+    emit(bev_escape, side_pc, NULL, item_empty, 0, 1);
+    return true;
+  }
+  ++escape_attempts;
+  emit(bev_escape_fail, side_pc, NULL, item_empty, 0, 1);
+  return false;
+}
+
+/*
+ * Throws a ball at the opposing pokemon.
+ * Returns true if the pokemon was caught, it is then owned but not added to 
+ * any party.
+ */
+bool Battle::throw_ball(item_t ball) {
+  Pokemon *opp = active[side_opp];
+
+  if (!is_wild()) {
+    emit(bev_catch_blocked, side_opp, NULL, ball, 0, 1);
+    return false;
+  }
+  if (is_catch_success(ball, opp)) {
+    opp->set_has_owner(true);
+    emit(bev_catch, side_opp, NULL, ball, 0, 1);
+    return true;
+  }
+  emit(bev_catch_fail, side_opp, NULL, ball, 0, 1);
+  return false;
+}
+
+/*
+ * Gives the active player pokemon the exp for defeating the opposing 
+ * pokemon, one level at a time.
+ */
+void Battle::award_exp() {
+  Pokemon *p = active[side_pc];
+  int32_t exp_gain = experience_gain(active[side_opp]);
+  int32_t exp_for_this_level;
+  std::vector<pd_move_t*> new_moves;
+
+  emit(bev_exp, side_pc, NULL, item_empty, exp_gain, 1);
+  while (exp_gain > 0) {
+    exp_for_this_level = min(p->get_exp_next_level(), exp_gain);
+    exp_gain -= exp_for_this_level;
+    p->give_exp(exp_for_this_level);
+    emit(bev_exp_step, side_pc, NULL, item_empty, exp_for_this_level, 1);
+
+    new_moves.clear();
+    if (p->level_up(listener ? &new_moves : NULL)) {
+      emit(bev_level_up, side_pc, NULL, item_empty, p->get_level(), 1);
+      for (auto it = new_moves.begin(); it != new_moves.end(); ++it) {
+        emit(bev_learn_move, side_pc, *it, item_empty, 0, 1);
+      }
+    }
+    if (exp_for_this_level == 0) {
+      // max level, the rest of the exp is lost
+      break;
+    }
+  }
+}
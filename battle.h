@@ -0,0 +1,83 @@
+#ifndef BATTLE_H
+#define BATTLE_H
+
+#include <cstdint>
+
+#include "pokemon.h"
+#include "items.h"
+
+typedef enum battle_side {
+  side_pc,
+  side_opp
+} battle_side_t;
+
+typedef enum battle_event_type {
+  bev_no_pp,          // attacker has no pp left and will struggle
+  bev_use_move,       // attacker used move
+  bev_miss,           // attack missed
+  bev_status,         // status move, not implemented so it has no effect
+  bev_damage,         // value is the damage dealt, already applied
+  bev_critical,       // the last hit was a critical hit
+  bev_effectiveness,  // eff is the type multiplier of the last hit
+  bev_faint,          // pokemon fainted
+  bev_exp,            // value is the total exp about to be gained
+  bev_exp_step,       // value is the exp given towards the next level
+  bev_level_up,       // value is the new level
+  bev_learn_move,     // move can be learned, it is up to the listener to teach
+  bev_catch_blocked,  // ball was thrown at a trainer's pokemon
+  bev_catch,          // wild pokemon was caught
+  bev_catch_fail,     // wild pokemon broke free
+  bev_escape_blocked, // tried to run from a trainer battle
+  bev_escape,         // got away safely
+  bev_escape_fail     // couldn't escape
+} battle_event_type_t;
+
+typedef struct battle_event {
+  battle_event_type_t type;
+  battle_side_t side; // side the event concerns
+  Pokemon *p;         // pokemon the event concerns
+  pd_move_t *move;
+  item_t item;
+  int32_t value;
+  float eff;
+} battle_event_t;
+
+class Battle;
+typedef void (*battle_listener_t)(Battle *b, const battle_event_t *e, 
+                                  void *ctx);
+
+/*
+ * Battle state machine without any rendering or input
+ *
+ * The caller picks the actions for both sides and the battle applies them to
+ * the active pokemon. Everything that happens is reported to an optional 
+ * listener as it happens, so the game state seen by the listener always 
+ * matches the event. With no listener battles run as fast as the rules allow.
+ */
+class Battle {
+  Pokemon *active[2];
+  int32_t escape_attempts;
+  battle_listener_t listener;
+  void *listener_ctx;
+
+  void emit(battle_event_type_t type, battle_side_t side, pd_move_t *move, 
+            item_t item, int32_t value, float eff);
+
+  public:
+    Battle(Pokemon *pc_active, Pokemon *opp_active,
+           battle_listener_t listener, void *listener_ctx);
+
+    Pokemon* get_active(battle_side_t side);
+    void set_active(battle_side_t side, Pokemon *p);
+    bool is_wild();
+
+    bool attack(battle_side_t attacker_side, int32_t move_slot);
+    bool fight(int32_t pc_move_slot, int32_t opp_move_slot);
+    bool escape();
+    bool throw_ball(item_t ball);
+    void award_exp();
+};
+
+bool is_catch_success(item_t ball, Pokemon *opp);
+
+#endif
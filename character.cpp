@@ -1,32 +1,98 @@
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
+#include <new>
 #include <ncurses.h>
 
 #include "character.h"
 #include "region.h"
 #include "trainer_events.h"
 #include "global_events.h"
+#include "rng.h"
+#include "save.h"
 
 extern Region *region_ptr[WORLD_SIZE][WORLD_SIZE];
 extern Pc *pc;
 extern int32_t dist_map_hiker[MAX_ROW][MAX_COL];
 extern int32_t dist_map_rival[MAX_ROW][MAX_COL];
+extern uint8_t flow_map_hiker[MAX_ROW][MAX_COL];
+extern uint8_t flow_map_rival[MAX_ROW][MAX_COL];
+
+/*******************************************************************************
+* Trainer Table
+*******************************************************************************/
+/*
+ * Appends a row for a new trainer and returns its index
+ */
+int32_t TrainerTable::add(trainer_t tnr, int32_t i, int32_t j, 
+                          int32_t movetime) {
+  pos_i.push_back(i);
+  pos_j.push_back(j);
+  this->movetime.push_back(movetime);
+  this->tnr.push_back(tnr);
+  dir.push_back(dir_n);
+  flags.push_back(0);
+  return pos_i.size() - 1;
+}
+int32_t TrainerTable::size() {
+  return pos_i.size();
+}
+/*
+ * Returns the row of the trainer standing at i, j or -1 if there is none
+ */
+int32_t TrainerTable::find(int32_t i, int32_t j) {
+  int32_t n = pos_i.size();
+  const int32_t *pi = pos_i.data();
+  const int32_t *pj = pos_j.data();
+  for (int32_t k = 0; k < n; ++k) {
+    if (pi[k] == i && pj[k] == j) {
+      return k;
+    }
+  }
+  return -1;
+}
+/*
+ * Removes a row by moving the last row into its place. Returns the old index
+ * of the row that moved, or -1 if row was the last one.
+ */
+int32_t TrainerTable::remove(int32_t row) {
+  int32_t last = pos_i.size() - 1;
+  pos_i[row] = pos_i[last];
+  pos_j[row] = pos_j[last];
+  movetime[row] = movetime[last];
+  tnr[row] = tnr[last];
+  dir[row] = dir[last];
+  flags[row] = flags[last];
+  pos_i.pop_back();
+  pos_j.pop_back();
+  movetime.pop_back();
+  tnr.pop_back();
+  dir.pop_back();
+  flags.pop_back();
+  return row == last ? -1 : last;
+}
+void TrainerTable::step_movetimes(int32_t amount) {
+  int32_t n = movetime.size();
+  int32_t *mt = movetime.data();
+  for (int32_t k = 0; k < n; ++k) {
+    mt[k] -= amount;
+  }
+}
 
 /*******************************************************************************
 * Abstract Character Base-Class
 *******************************************************************************/
 int32_t Character::get_movetime() {
-  return movetime;
+  return movetime();
 }
 void Character::step_movetime(int32_t amount) {
-    movetime -= amount;
+    movetime() -= amount;
 }
 int32_t Character::get_i() {
-    return pos_i;
+    return pos_i();
 }
 int32_t Character::get_j() {
-    return pos_j;
+    return pos_j();
 }
 char Character::get_ch() {
     return ch;
@@ -38,10 +104,14 @@ trainer_t Character::get_tnr() {
     return tnr;
 }
 bool Character::is_defeated() {
-    return defeated;
+    return table->flags[slot] & TNR_FLAG_DEFEATED;
 }
 void Character::set_defeated(bool d) {
-    defeated = d;
+    if (d) {
+      table->flags[slot] |= TNR_FLAG_DEFEATED;
+    } else {
+      table->flags[slot] &= ~TNR_FLAG_DEFEATED;
+    }
     return;
 }
 
@@ -53,7 +123,7 @@ void Character::process_movement_turn() {
   Region *r = region_ptr[pc->get_x()][pc->get_y()];
 
   // update before moving to avoid issues with player changing regions
-  movetime = turn_times[ r->get_ter(pos_i, pos_j) ][ tnr ];
+  movetime() = turn_times[ r->get_ter(pos_i(), pos_j()) ][ tnr ];
 
   switch (tnr)
   {
@@ -62,63 +132,63 @@ void Character::process_movement_turn() {
     process_input_nav();
     break;
   case tnr_hiker:
-    if (!defeated && !pc->is_defeated()) {
-      move_along_gradient(this, dist_map_hiker);
+    if (!is_defeated() && !pc->is_defeated()) {
+      move_along_gradient(this, dist_map_hiker, flow_map_hiker);
     }
     break;
   case tnr_rival:
-    if (!defeated && !pc->is_defeated()) {
-      move_along_gradient(this, dist_map_rival);
+    if (!is_defeated() && !pc->is_defeated()) {
+      move_along_gradient(this, dist_map_rival, flow_map_rival);
     }
     break;
   case tnr_pacer:
-    if (defeated || pc->is_defeated()) {
+    if (is_defeated() || pc->is_defeated()) {
       // do nothing
-    } else if (pc->get_i() == (pos_i + dir_offsets[dir][0])
-            && pc->get_j() == (pos_j + dir_offsets[dir][1])) {
+    } else if (pc->get_i() == (pos_i() + dir_offsets[dir()][0])
+            && pc->get_j() == (pos_j() + dir_offsets[dir()][1])) {
       battle_driver(pc, this);
-    } else if (is_valid_location(pos_i + dir_offsets[dir][0], 
-                                 pos_j + dir_offsets[dir][1], 
+    } else if (is_valid_location(pos_i() + dir_offsets[dir()][0], 
+                                 pos_j() + dir_offsets[dir()][1], 
                                  tnr)) {
-      pos_i += dir_offsets[dir][0];
-      pos_j += dir_offsets[dir][1];
+      pos_i() += dir_offsets[dir()][0];
+      pos_j() += dir_offsets[dir()][1];
     } else {
-      dir = static_cast<direction_t>((dir + 4) % 8);
+      dir() = static_cast<direction_t>((dir() + 4) % 8);
     }
     break;
   case tnr_wanderer:
-    if (defeated || pc->is_defeated()) {
+    if (is_defeated() || pc->is_defeated()) {
       // do nothing
-      } else if (pc->get_i() == (pos_i + dir_offsets[dir][0])
-              && pc->get_j() == (pos_j + dir_offsets[dir][1])) {
+      } else if (pc->get_i() == (pos_i() + dir_offsets[dir()][0])
+              && pc->get_j() == (pos_j() + dir_offsets[dir()][1])) {
       battle_driver(pc, this);
-    } else if ((r->get_ter(pos_i + dir_offsets[dir][0], 
-                           pos_j + dir_offsets[dir][1])
-             == r->get_ter(pos_i                      , 
-                           pos_j                      ))
-      && is_valid_location(pos_i + dir_offsets[dir][0],
-                           pos_j + dir_offsets[dir][1], tnr)) {
-      pos_i += dir_offsets[dir][0];
-      pos_j += dir_offsets[dir][1];
+    } else if ((r->get_ter(pos_i() + dir_offsets[dir()][0], 
+                           pos_j() + dir_offsets[dir()][1])
+             == r->get_ter(pos_i()                    , 
+                           pos_j()                    ))
+      && is_valid_location(pos_i() + dir_offsets[dir()][0],
+                           pos_j() + dir_offsets[dir()][1], tnr)) {
+      pos_i() += dir_offsets[dir()][0];
+      pos_j() += dir_offsets[dir()][1];
     } else {
-      dir = static_cast<direction_t>(rand() % 8);
+      dir() = static_cast<direction_t>(rand() % 8);
     }
     break;
   case tnr_stationary:
     // Do nothing
     break;
   case tnr_rand_walker:
-    if (defeated || pc->is_defeated()) {
+    if (is_defeated() || pc->is_defeated()) {
       // do nothing
-    } else if (pc->get_i() == (pos_i + dir_offsets[dir][0])
-            && pc->get_j() == (pos_j + dir_offsets[dir][1])) {
+    } else if (pc->get_i() == (pos_i() + dir_offsets[dir()][0])
+            && pc->get_j() == (pos_j() + dir_offsets[dir()][1])) {
       battle_driver(pc, this);
-    } else if (is_valid_location(pos_i + dir_offsets[dir][0],
-                                 pos_j + dir_offsets[dir][1], tnr)) {
-      pos_i += dir_offsets[dir][0];
-      pos_j += dir_offsets[dir][1];
+    } else if (is_valid_location(pos_i() + dir_offsets[dir()][0],
+                                 pos_j() + dir_offsets[dir()][1], tnr)) {
+      pos_i() += dir_offsets[dir()][0];
+      pos_j() += dir_offsets[dir()][1];
     } else {
-      dir = static_cast<direction_t>(rand() % 8);
+      dir() = static_cast<direction_t>(rand() % 8);
     }
     break;
   default:
@@ -131,58 +201,117 @@ void Character::process_movement_turn() {
   return;
 }
 int32_t Character::num_in_bag(item_t i) {
-  for (auto it = bag.begin(); it != bag.end(); ++it) {
-    if (it->item == i) {
-      return it->cnt;
-    }
-  }
-  return 0;
+  return bag_cnt[i];
 }
 void Character::remove_item_from_bag(item_t i, int32_t cnt) {
-  for (auto it = bag.begin(); it != bag.end(); ++it) {
-    if (it->item == i) {
-      it->cnt -= cnt;
-      if (it->cnt < 1) {
-        bag.erase(it);
-      }
-      return;
-    }
+  if (bag_cnt[i] == 0) {
+    return;
   }
 
+  bag_cnt[i] -= cnt;
+  if (bag_cnt[i] < 1) {
+    bag_cnt[i] = 0;
+    // close the gap in the bag order
+    int32_t k = 0;
+    while (bag_order[k] != i) {
+      ++k;
+    }
+    for (; k < bag_slots - 1; ++k) {
+      bag_order[k] = bag_order[k + 1];
+    }
+    --bag_slots;
+  }
   return;
 }
 void Character::add_item_to_bag(item_t i, int32_t cnt) {
   // check if count is a positive number that is less than MAX_ITEMS
-  // check if bag_slot already exists
-  //   if (bag_slot exists)
-  //     add cnt to bag_slot
-  //     return
-  // create new bag_slot
+  // if the item is new to the bag it goes after all the others
   
   if (cnt < 1 || cnt > MAX_ITEMS) {
     return;
   }
 
-  for (auto it = bag.begin(); it != bag.end(); ++it) {
-    if (it->item == i) {
-      it->cnt += cnt;
-      if (cnt > MAX_ITEMS) {
-        it->cnt = MAX_ITEMS;
-      }
-      return;
-    }
+  if (bag_cnt[i] == 0) {
+    bag_order[bag_slots++] = i;
+  }
+  bag_cnt[i] += cnt;
+  if (bag_cnt[i] > MAX_ITEMS) {
+    bag_cnt[i] = MAX_ITEMS;
   }
-
-  bag_slot_t new_bag_slot;
-  new_bag_slot.item = i;
-  new_bag_slot.cnt = cnt;
-  bag.push_back(new_bag_slot);
 }
 int32_t Character::num_bag_slots() {
-  return bag.size();
+  return bag_slots;
 }
 bag_slot_t Character::peek_bag_slot(int32_t index) {
-  return bag[index];
+  bag_slot_t s;
+  s.item = bag_order[index];
+  s.cnt = bag_cnt[s.item];
+  return s;
+}
+/*
+ * Writes the character's table row, bag and party to a save file
+ */
+void Character::save(SaveWriter *out) {
+  out->u8(tnr);
+  out->u8(pos_i());
+  out->u8(pos_j());
+  out->u32(movetime());
+  out->u8(dir());
+  out->u8(table->flags[slot]);
+  out->str(nickname, 13);
+  out->u8(bag_slots);
+  for (int32_t k = 0; k < bag_slots; ++k) {
+    out->u8(bag_order[k]);
+    out->u16(bag_cnt[bag_order[k]]);
+  }
+  out->u8(party_size);
+  for (int32_t k = 0; k < party_size; ++k) {
+    party[k]->save(out);
+  }
+}
+/*
+ * Restores what Character::save wrote into a new row of the character's 
+ * table. Party members are allocated from arena, or with new if it is NULL.
+ */
+void Character::load(SaveReader *in, Arena *arena) {
+  tnr = static_cast<trainer_t>(in->u8() % (tnr_rand_walker + 1));
+  int32_t i = in->u8();
+  int32_t j = in->u8();
+  int32_t mt = in->u32();
+  // trainers stand inside the border, the player may be in an exit
+  int32_t edge = tnr == tnr_pc ? 0 : 1;
+  if (i < edge || i > MAX_ROW - 1 - edge || j < edge || j > MAX_COL - 1 - edge) {
+    in->fail();
+    i = 1;
+    j = 1;
+  }
+  slot = table->add(tnr, i, j, mt);
+  dir() = static_cast<direction_t>(in->u8() % 8);
+  table->flags[slot] = in->u8();
+  in->str(nickname, 13);
+  nickname[12] = '\0';
+  ch = trainer_chars[tnr];
+  color = trainer_colors[tnr];
+
+  int32_t slots = in->u8();
+  for (int32_t k = 0; k < slots; ++k) {
+    item_t item = static_cast<item_t>(in->u8() % num_items);
+    add_item_to_bag(item, in->u16());
+  }
+
+  party_size = 0;
+  int32_t size = in->u8();
+  for (int32_t k = 0; k < size && in->good(); ++k) {
+    Pokemon *p;
+    if (arena != NULL) {
+      p = new (arena->alloc_array<Pokemon>(1)) Pokemon(in);
+    } else {
+      p = new Pokemon(in);
+    }
+    if (!add_pokemon(p) && arena == NULL) {
+      delete p;
+    }
+  }
 }
 /*
  * Return 1 if pokemon was successfully added to the party, 0 otherwise
@@ -282,9 +411,10 @@ Pc::Pc(int32_t r_x, int32_t r_y) {
   ch    = CHAR_PC;
   color = CHAR_COLOR_PC;
   tnr   = tnr_pc;
+  table = &self;
+  slot  = self.add(tnr_pc, 0, 0, 0);
   reg_x = r_x;
   reg_y = r_y;
-  movetime = 0;
   party_size = 0;
   strncpy(nickname, "PLAYER", 12);
   
@@ -294,19 +424,16 @@ Pc::Pc(int32_t r_x, int32_t r_y) {
   // Find a valid spawn location
   int32_t found_location = 0;
   while (found_location != 1) {
-    pos_i = (rand() % (MAX_ROW - 2)) + 1;
-    pos_j = (rand() % (MAX_COL - 2)) + 1;
-    if (r->get_ter(pos_i, pos_j) == ter_path) {
+    pos_i() = (rand() % (MAX_ROW - 2)) + 1;
+    pos_j() = (rand() % (MAX_COL - 2)) + 1;
+    if (r->get_ter(pos_i(), pos_j()) == ter_path) {
       found_location = 1;
-      for (auto it = r->get_npcs()->begin(); it != r->get_npcs()->end(); ++it) {
-        if (it->get_i() == pos_i && it->get_j() == pos_j) {
-          found_location = 0;
-          break;
-        }
+      if (r->get_trainers()->find(pos_i(), pos_j()) != -1) {
+        found_location = 0;
       }
     }
   }
-  movetime = turn_times[r->get_ter(pos_i, pos_j)][tnr];
+  movetime() = turn_times[r->get_ter(pos_i(), pos_j())][tnr];
 
   // give the player starting items
   add_item_to_bag(item_poke_ball,    START_POKE_BALL);
@@ -330,7 +457,30 @@ Pc::Pc(int32_t r_x, int32_t r_y) {
 
 Pc::~Pc() {
   for (int32_t i = 0; i < party_size; ++i)
-    free(party[i]);
+    delete party[i];
+}
+
+/*
+ * Pc constructor that restores the player from a save file
+ */
+Pc::Pc(SaveReader *in) {
+  table = &self;
+  load(in, NULL);
+  reg_x = in->u16();
+  reg_y = in->u16();
+  poke_dollars = in->u32();
+  if (reg_x >= WORLD_SIZE || reg_y >= WORLD_SIZE) {
+    in->fail();
+    reg_x = WORLD_SIZE / 2;
+    reg_y = WORLD_SIZE / 2;
+  }
+}
+
+void Pc::save(SaveWriter *out) {
+  Character::save(out);
+  out->u16(reg_x);
+  out->u16(reg_y);
+  out->u32(poke_dollars);
 }
 
 int32_t Pc::get_x() {
@@ -411,10 +561,10 @@ void Pc::take_poke_dollars(int32_t amount) {
 /*
  * Non-Player Character contructor
  */
-Npc::Npc(trainer_t tnr, int32_t i, int32_t j, int32_t init_movetime) {
-  pos_i = i;
-  pos_j = j;
-  movetime = init_movetime;
+Npc::Npc(TrainerTable *table, trainer_t tnr, int32_t i, int32_t j, 
+         int32_t init_movetime) {
+  this->table = table;
+  slot = table->add(tnr, i, j, init_movetime);
   this->tnr = tnr;
   party_size = 0;
 
@@ -435,13 +585,13 @@ Npc::Npc(trainer_t tnr, int32_t i, int32_t j, int32_t init_movetime) {
       strncpy(nickname, "PACER", 12);
       ch = CHAR_PACER;
       color = CHAR_COLOR_PACER;
-      dir = static_cast<direction_t>(rand() % 8);
+      dir() = static_cast<direction_t>(rng_rand() % 8);
       break;
     case tnr_wanderer:
       strncpy(nickname, "WANDERER", 12);
       ch = CHAR_WANDERER;
       color = CHAR_COLOR_WANDERER;
-      dir = static_cast<direction_t>(rand() % 8);
+      dir() = static_cast<direction_t>(rng_rand() % 8);
       break;
     case tnr_stationary:
       strncpy(nickname, "STATIONARY", 12);
@@ -453,7 +603,7 @@ Npc::Npc(trainer_t tnr, int32_t i, int32_t j, int32_t init_movetime) {
       strncpy(nickname, "WALKER", 12);
       ch = CHAR_RAND_WALKER;
       color = CHAR_COLOR_RAND_WALKER;
-      dir = static_cast<direction_t>(rand() % 8);
+      dir() = static_cast<direction_t>(rng_rand() % 8);
       break;
     default:
       char m[MAX_COL];
@@ -462,7 +612,15 @@ Npc::Npc(trainer_t tnr, int32_t i, int32_t j, int32_t init_movetime) {
   }
 }
 
-Npc::~Npc() {
-  for (int32_t i = 0; i < party_size; ++i)
-    free(party[i]);
+/*
+ * Non-Player Character constructor that restores a trainer from a save file
+ * into a new row of table
+ */
+Npc::Npc(TrainerTable *table, SaveReader *in, Arena *arena) {
+  this->table = table;
+  load(in, arena);
+  if (tnr == tnr_pc) {
+    in->fail();
+  }
 }
+
@@ -7,6 +7,9 @@
 #include "config.h"
 #include "items.h"
 #include "pokemon.h"
+#include "arena.h"
+
+class Region;
 
 typedef enum trainer {
   tnr_pc,
@@ -60,20 +63,70 @@ static const int32_t dir_offsets[8][2] = {
   /* dir_nw */ {-1,-1}
 };
 
+// Order the neighbours of a tile are tried in when following a distance map,
+// the first of equally close ones wins
+static const direction_t gradient_order[8] = {
+  dir_n, dir_e, dir_s, dir_w, dir_ne, dir_se, dir_sw, dir_nw
+};
+
+static const char trainer_chars[7] = {
+  CHAR_PC, CHAR_HIKER, CHAR_RIVAL, CHAR_PACER, 
+  CHAR_WANDERER, CHAR_STATIONARY, CHAR_RAND_WALKER
+};
+
+static const int32_t trainer_colors[7] = {
+  CHAR_COLOR_PC, CHAR_COLOR_HIKER, CHAR_COLOR_RIVAL, CHAR_COLOR_PACER,
+  CHAR_COLOR_WANDERER, CHAR_COLOR_STATIONARY, CHAR_COLOR_RAND_WALKER
+};
+
+#define TNR_FLAG_DEFEATED 0x1
+
+/*
+ * Movement state of trainers kept in parallel arrays, one row per trainer.
+ *
+ * The tick loop, rendering and collision checks only ever need these fields, 
+ * so they are stored apart from the rest of the Character (party, bag, 
+ * nickname) and can be scanned without touching it.
+ */
+class TrainerTable {
+  public:
+    std::vector<int32_t> pos_i, pos_j;
+    std::vector<int32_t> movetime;
+    std::vector<trainer_t> tnr;
+    std::vector<direction_t> dir;
+    std::vector<uint8_t> flags;
+
+    int32_t add(trainer_t tnr, int32_t i, int32_t j, int32_t movetime);
+    int32_t size();
+    int32_t find(int32_t i, int32_t j);
+    int32_t remove(int32_t row);
+    void step_movetimes(int32_t amount);
+};
+
 // Abstract base class
 class Character {
   protected:
-    int32_t pos_i, pos_j;
+    // this character's row in a trainer table
+    TrainerTable *table;
+    int32_t slot;
     trainer_t tnr;
-    int32_t movetime;
     char ch = CHAR_UNDEFINED;
     int32_t color = CHAR_COLOR_UNDEFINED;
-    bool defeated = false;
-    direction_t dir;
-    std::vector<bag_slot_t> bag;
+    // item counts indexed by item, and the items held in the order they were
+    // first added for the bag menus
+    int32_t bag_cnt[num_items] = {};
+    item_t bag_order[num_items];
+    int32_t bag_slots = 0;
     Pokemon* party[6];
     int32_t party_size;
     char nickname[13];
+
+    int32_t& pos_i() { return table->pos_i[slot]; }
+    int32_t& pos_j() { return table->pos_j[slot]; }
+    int32_t& movetime() { return table->movetime[slot]; }
+    direction_t& dir() { return table->dir[slot]; }
+
+    void load(SaveReader *in, Arena *arena);
     
   public:
     int32_t get_movetime();
@@ -100,19 +153,27 @@ class Character {
     void rename(char new_name[12]);
     void switch_pokemon(int32_t a, int32_t b);
     int32_t get_payout();
+    void save(SaveWriter *out);
 
   friend void move_along_gradient(Character *c, 
-                                  int32_t dist_map[MAX_ROW][MAX_COL]);
+                                  int32_t dist_map[MAX_ROW][MAX_COL],
+                                  uint8_t flow_map[MAX_ROW][MAX_COL]);
+  friend bool cross_region(Region *r, int32_t rx, int32_t ry, int32_t k, 
+                           int32_t e);
 };
 
 // Derived class
 class Pc : public Character {
+  // the player is never part of a region, it keeps a table of its own
+  TrainerTable self;
   int32_t reg_x;
   int32_t reg_y;
   int32_t poke_dollars;
 
   public:
     Pc(int32_t r_x, int32_t r_y);
+    Pc(SaveReader *in);
+    void save(SaveWriter *out);
     ~Pc();
 
     int32_t get_x();
@@ -131,8 +192,9 @@ class Pc : public Character {
 class Npc : public Character {
 
   public:
-    Npc(trainer_t tnr, int32_t i, int32_t j, int32_t init_movetime);
-    ~Npc();
+    Npc(TrainerTable *table, trainer_t tnr, int32_t i, int32_t j, 
+        int32_t init_movetime);
+    Npc(TrainerTable *table, SaveReader *in, Arena *arena);
 };
   
 #endif
\ No newline at end of file
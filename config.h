@@ -24,6 +24,7 @@
 #define CTRL_SELECT        key == 10 /*ENTER*/ || key == '>' || key == '.'
 #define CTRL_BACK          key == 27 /*ESC*/ || key == '<' || key == ','
 #define CTRL_QUIT_GAME     key == 'Q'
+#define CTRL_SAVE_GAME     key == 'S'
 
 // will print parsing debug info and parsed data to terminal, if defined
 // #define VERBOSE_POKEDEX
@@ -69,6 +70,20 @@
 // Printed region dimensions 
 #define MAX_ROW 21
 #define MAX_COL 80
+// Full screen dimensions, the region plus the message lines around it
+#define SCREEN_ROWS (MAX_ROW + 3)
+#define SCREEN_COLS MAX_COL
+
+// Presents frames on a dedicated render thread, if defined
+// The game only publishes finished frames, frames that the terminal cannot 
+// keep up with are dropped in favor of the newest one.
+#define RENDER_THREAD
+
+// Size of the queue that keystrokes are read into, must be a power of 2
+#define INPUT_QUEUE_SIZE 64
+// Most movement keys that may be typed ahead of the player character, older 
+// keys beyond this are dropped so held keys don't keep walking after release
+#define INPUT_TYPEAHEAD_MAX 4
 
 // The number of biomes that will populate each region
 // The first 2 seeds will be grass the next 2 seeds will be clearings after that
@@ -161,8 +176,44 @@
 // show ivs in pokemon summary view if defined
 // #define POKEMON_SUMMARY_SHOW_IVS
 
+// How trainers choose their moves, ai_expected_damage or ai_random
+// Wild pokemon always choose at random.
+#define TRAINER_AI_POLICY ai_expected_damage
+// Size of the blocks that regions allocate their trainers' pokemon from
+#define ARENA_BLOCK_SIZE (64 * 1024)
 // The chance a trainer has n+1 pokemon. (0-100)%
 #define TRAINER_EXTRA_POKEMON_CHANCE 60
+// Battle simulator gives up and counts a draw after this many turns
+#define SIM_MAX_TURNS 500
+// File the game is saved to with CTRL_SAVE_GAME, unless loaded with --load
+#define SAVE_FILE "poke.sav"
+// Size of the stdio buffer used when writing and reading save files
+#define SAVE_BUFFER_SIZE (256 * 1024)
+// Saves changes in the background to a journal next to the save file, if 
+// defined. Sessions that are replayed never autosave.
+#define AUTOSAVE
+// Game time between autosave checkpoints
+#define AUTOSAVE_TICKS (TICKS_PER_SEC * 30)
+// The journal is folded back into the save file once it grows past this size
+#define AUTOSAVE_COMPACT_BYTES (4 * 1024 * 1024)
+// Size of the slot each region takes up in a --world file. Regions that do 
+// not fit, because of very many trainers, are never written out of memory.
+#define WORLD_RECORD_SIZE (16 * 1024)
+// Regions kept in memory with --world, the rest are read back from the file
+#define WORLD_RESIDENT_REGIONS 32
+// Record slots the world file grows by the first time, doubling after that
+#define WORLD_GROW_SLOTS 64
+// Regions --pregen generates between writing them to the world file
+#define PREGEN_BATCH 256
+// Regions around the player's region whose hikers and rivals chase it across
+// region borders
+#define PURSUIT_RADIUS 1
+// Regions around the player's region that keep moving at a coarse time step
+#define LOD_RADIUS 2
+// Ticks between coarse steps of the regions around the player's region
+#define LOD_STEP_TICKS TICKS_PER_SEC
+// Most steps a random walker takes catching up on a region it was away from
+#define LOD_CATCHUP_MOVES 64
 // Time in microseconds between using a move and seeing the applied damage
 #define BATTLE_ANIMATION_TIME 250000
 
@@ -11,11 +11,20 @@
 #include "trainer_events.h"
 #include "global_events.h"
 #include "items.h"
+#include "render.h"
+#include "input.h"
+#include "replay.h"
+#include "save.h"
+#include "autosave.h"
+#include "world.h"
+#include "pool.h"
 
 extern Region *region_ptr[WORLD_SIZE][WORLD_SIZE];
 extern Pc *pc;
 extern heap_t move_queue;;
+extern const char *save_path;
 
+static bool terminal_open = false;
 
 int32_t digits(int32_t n)  
 {  
@@ -39,45 +48,45 @@ void pc_next_region(int32_t to_rx,   int32_t to_ry,
   Region *r = region_ptr[to_rx][to_ry];
 
   // player gets first move in a new region
-  pc->movetime = 0;
+  pc->movetime() = 0;
 
   if (from_ry - to_ry > 0) {
     // coming from the north
-    pc->pos_i = 0;
+    pc->pos_i() = 0;
     render_region(r);
-    usleep(FRAMETIME);
-    pc->pos_i = 1;
+    frame_sleep(FRAMETIME);
+    pc->pos_i() = 1;
     render_region(r);
-    usleep(FRAMETIME);
+    frame_sleep(FRAMETIME);
     return;
   } else if (from_ry - to_ry < 0) {
     // coming from the south
-    pc->pos_i = MAX_ROW - 1;
+    pc->pos_i() = MAX_ROW - 1;
     render_region(r);
-    usleep(FRAMETIME);
-    pc->pos_i = MAX_ROW - 2;
+    frame_sleep(FRAMETIME);
+    pc->pos_i() = MAX_ROW - 2;
     render_region(r);
-    usleep(FRAMETIME);
+    frame_sleep(FRAMETIME);
     return;
   }
 
   if (from_rx - to_rx > 0) {
     // coming from the east
-    pc->pos_j = MAX_COL - 1;
+    pc->pos_j() = MAX_COL - 1;
     render_region(r);
-    usleep(FRAMETIME);
-    pc->pos_j = MAX_COL - 2;
+    frame_sleep(FRAMETIME);
+    pc->pos_j() = MAX_COL - 2;
     render_region(r);
-    usleep(FRAMETIME);
+    frame_sleep(FRAMETIME);
     return;
   } else if (from_rx - to_rx < 0) {
     // coming from the west
-    pc->pos_j = 0;
+    pc->pos_j() = 0;
     render_region(r);
-    usleep(FRAMETIME);
-    pc->pos_j = 1;
+    frame_sleep(FRAMETIME);
+    pc->pos_j() = 1;
     render_region(r);
-    usleep(FRAMETIME);
+    frame_sleep(FRAMETIME);
   return;
   }
 
@@ -85,63 +94,90 @@ void pc_next_region(int32_t to_rx,   int32_t to_ry,
   return;
 }
 
-void load_region(int32_t region_x, int32_t region_y, int32_t num_tnr) {
-  // If the region we are in is uninitialized, then generate the region.
-  if (region_ptr[region_x][region_y] == NULL) {
-    int32_t N_exit, E_exit, S_exit, W_exit;
-    N_exit = -1;
-    E_exit = -1;
-    S_exit = -1;
-    W_exit = -1;
-
-    // determine if new region should generate with poke center and/or mart
-    // (-45d/200 + 50) / 100 => -0.45*d/200 + 0.50
-    int32_t d = m_dist(region_x, region_y, WORLD_SIZE/2, WORLD_SIZE/2);
-    double p = (-0.45*d)/200 + 0.50;
-    int32_t place_center = rand_outcome(p);
-    int32_t place_mart = rand_outcome(p);
-
-    if (region_y + 1 < WORLD_SIZE) {
-      if (region_ptr[region_x][region_y + 1] != NULL) {
-        N_exit = region_ptr[region_x][region_y + 1]->get_S_exit_j(); /* North Region, South Exit */
-      }
+/*
+ * Generates the region at region_x, region_y. Its exits come from the world
+ * seed, unless a neighbouring region, in memory or in the world file, was 
+ * saved with a different exit by a game from before exits were derived that
+ * way. Only reads other regions, so any number of regions can be generated 
+ * at the same time.
+ */
+Region* generate_region(int32_t region_x, int32_t region_y, int32_t num_tnr) {
+  int32_t N_exit, E_exit, S_exit, W_exit;
+  int32_t exits[4];
+  border_exits(region_x, region_y, exits);
+  N_exit = exits[0];
+  E_exit = exits[1];
+  S_exit = exits[2];
+  W_exit = exits[3];
+
+  // determine if new region should generate with poke center and/or mart
+  // (-45d/200 + 50) / 100 => -0.45*d/200 + 0.50
+  int32_t d = m_dist(region_x, region_y, WORLD_SIZE/2, WORLD_SIZE/2);
+  double p = (-0.45*d)/200 + 0.50;
+  int32_t place_center = rand_outcome(p);
+  int32_t place_mart = rand_outcome(p);
+
+  if (region_y + 1 < WORLD_SIZE) {
+    if (region_ptr[region_x][region_y + 1] != NULL) {
+      N_exit = region_ptr[region_x][region_y + 1]->get_S_exit_j(); /* North Region, South Exit */
+    } else if (world_region_exits(region_x, region_y + 1, exits)) {
+      N_exit = exits[2];
     }
-    if (region_x + 1 < WORLD_SIZE) {
-      if (region_ptr[region_x + 1][region_y] != NULL) {
-        E_exit = region_ptr[region_x + 1][region_y]->get_W_exit_i(); /* East Region, West Exit */
-      }
+  }
+  if (region_x + 1 < WORLD_SIZE) {
+    if (region_ptr[region_x + 1][region_y] != NULL) {
+      E_exit = region_ptr[region_x + 1][region_y]->get_W_exit_i(); /* East Region, West Exit */
+    } else if (world_region_exits(region_x + 1, region_y, exits)) {
+      E_exit = exits[3];
     }
-    if (region_y - 1 >= 0) {
-      if (region_ptr[region_x][region_y - 1] != NULL) {
-        S_exit = region_ptr[region_x][region_y - 1]->get_N_exit_j(); /* South Region, North Exit */
-      }
+  }
+  if (region_y - 1 >= 0) {
+    if (region_ptr[region_x][region_y - 1] != NULL) {
+      S_exit = region_ptr[region_x][region_y - 1]->get_N_exit_j(); /* South Region, North Exit */
+    } else if (world_region_exits(region_x, region_y - 1, exits)) {
+      S_exit = exits[0];
     }
-    if (region_x - 1 >= 0) {
-      if (region_ptr[region_x - 1][region_y] != NULL) {
-        W_exit = region_ptr[region_x - 1][region_y]->get_E_exit_i(); /* West Region, East Exit */
-      }
+  }
+  if (region_x - 1 >= 0) {
+    if (region_ptr[region_x - 1][region_y] != NULL) {
+      W_exit = region_ptr[region_x - 1][region_y]->get_E_exit_i(); /* West Region, East Exit */
+    } else if (world_region_exits(region_x - 1, region_y, exits)) {
+      W_exit = exits[1];
     }
+  }
 
-    Region *new_region = new Region(N_exit, E_exit, S_exit, W_exit,
-                                    place_center, place_mart);
-    new_region->populate(num_tnr);
-    region_ptr[region_x][region_y] = new_region;
+  Region *new_region = new Region(N_exit, E_exit, S_exit, W_exit,
+                                  place_center, place_mart);
+  new_region->populate(num_tnr, region_x, region_y);
 
-    // If on the edge of the world, block exits with boulders so that player cannot
-    // fall out of the world
-    if (region_y == WORLD_SIZE - 1) {
-      new_region->close_N_exit();
-    }
-    if (region_x == WORLD_SIZE - 1) {
-      new_region->close_E_exit();
-    }
-    if (region_y == 0) {
-      new_region->close_S_exit();
-    }
-    if (region_x == 0) {
-      new_region->close_W_exit();
-    }
+  // If on the edge of the world, block exits with boulders so that player cannot
+  // fall out of the world
+  if (region_y == WORLD_SIZE - 1) {
+    new_region->close_N_exit();
+  }
+  if (region_x == WORLD_SIZE - 1) {
+    new_region->close_E_exit();
   }
+  if (region_y == 0) {
+    new_region->close_S_exit();
+  }
+  if (region_x == 0) {
+    new_region->close_W_exit();
+  }
+  return new_region;
+}
+
+void load_region(int32_t region_x, int32_t region_y, int32_t num_tnr) {
+  // Regions written out to the world file are read back instead
+  if (region_ptr[region_x][region_y] == NULL) {
+    region_ptr[region_x][region_y] = world_load_region(region_x, region_y);
+  }
+  // If the region we are in is uninitialized, then generate the region.
+  if (region_ptr[region_x][region_y] == NULL) {
+    region_ptr[region_x][region_y] = generate_region(region_x, region_y, 
+                                                     num_tnr);
+  }
+  world_touch(region_x, region_y);
   return;
 }
 
@@ -160,15 +196,22 @@ void free_all_regions() {
 }
 
 /*
- * Initialize terminal with ncurses
+ * Initialize terminal with ncurses and create the render backend
+ *
+ * Input is always read through ncurses on the input thread. With the ANSI 
+ * backend, stdscr is refreshed once here and then never drawn to.
  */
-void init_terminal() {
+void init_terminal(render_mode_t mode) {
+  if (mode == render_headless) {
+    display = new_render_backend(mode);
+    return;
+  }
+
   initscr();
   raw();
   noecho();
 
   curs_set(0);
-  keypad(stdscr, TRUE);
   set_escdelay(100);
 
   start_color();
@@ -179,38 +222,69 @@ void init_terminal() {
   init_pair(COLOR_MAGENTA, COLOR_MAGENTA, CHAR_COLOR_BACKGROUND);
   init_pair(COLOR_CYAN,    COLOR_CYAN,    CHAR_COLOR_BACKGROUND);
   init_pair(COLOR_WHITE,   COLOR_WHITE,   CHAR_COLOR_BACKGROUND);
+  refresh();
+  terminal_open = true;
+
+  input_start();
+
+#ifdef RENDER_THREAD
+  render_thread_start(mode);
+#else
+  display = new_render_backend(mode);
+#endif
+}
+
+/*
+ * Stops presenting frames and restores the terminal
+ */
+void close_terminal() {
+  render_thread_stop();
+  input_stop();
+  if (terminal_open) {
+    endwin();
+    terminal_open = false;
+  }
 }
 
 /*
  * Renders a region to the screen
  */
 void render_region(Region *r) { 
-  clear(); 
+  // every terrain cell is overwritten below, so erase() is enough here and 
+  // avoids forcing a full repaint of the terminal like clear() would
+  display->erase(); 
 
-  // add terrain to frame buffer
+  // add terrain to frame buffer, one pre-rendered row at a time
   for (int32_t i = 0; i < MAX_ROW; i++) {
-    for (int32_t j = 0; j < MAX_COL; j++) {
-      attron(COLOR_PAIR(r->get_color(i, j)));
-      mvaddch(i + 1, j, r->get_ch(i, j));
-      attroff(COLOR_PAIR(r->get_color(i, j)));
-    }
+    display->addchnstr(i + 1, 0, r->get_render_row(i), MAX_COL);
   }
 
   // add npcs to frame buffer
-  for (auto it = r->get_npcs()->begin(); it != r->get_npcs()->end(); ++it) {
-    attron(COLOR_PAIR(it->get_color()));
-    mvaddch(it->get_i() + 1, it->get_j(), it->get_ch());
-    attroff(COLOR_PAIR(it->get_color()));
+  TrainerTable *t = r->get_trainers();
+  for (int32_t k = 0; k < t->size(); ++k) {
+    display->attron(COLOR_PAIR(trainer_colors[t->tnr[k]]));
+    display->mvaddch(t->pos_i[k] + 1, t->pos_j[k], trainer_chars[t->tnr[k]]);
+    display->attroff(COLOR_PAIR(trainer_colors[t->tnr[k]]));
   }
   
   // add player to frame buffer
-  attron(A_BOLD);
-  attron(COLOR_PAIR(pc->get_color()));
-  mvaddch(pc->get_i() + 1, pc->get_j(), pc->get_ch());
-  attroff(COLOR_PAIR(pc->get_color()));
-  attroff(A_BOLD);
+  display->attron(A_BOLD);
+  display->attron(COLOR_PAIR(pc->get_color()));
+  display->mvaddch(pc->get_i() + 1, pc->get_j(), pc->get_ch());
+  display->attroff(COLOR_PAIR(pc->get_color()));
+  display->attroff(A_BOLD);
 
-  refresh();
+  display->refresh();
+}
+
+/*
+ * Shows a message on the line above the region
+ */
+void render_region_message(const char* m) {
+  display->move(0, 0);
+  display->clrtoeol();
+  display->mvprintw(0, 0, "%s", m);
+  display->refresh();
 }
 
 /*
@@ -218,12 +292,12 @@ void render_region(Region *r) {
  */
 void render_battle_message(const char* m) {
   for (int32_t i = 12; i < MAX_ROW + 3; ++i) {
-    move(i, 0);
-    clrtoeol();
+    display->move(i, 0);
+    display->clrtoeol();
   }
   
-  mvprintw(12, 0, m);
-  refresh();
+  display->mvprintw(12, 0, m);
+  display->refresh();
 }
 
 /*
@@ -233,8 +307,8 @@ void render_battle_message_getch(const char* m) {
   render_battle_message(m);
   
   // also wait for keypress
-  usleep(FRAMETIME);
-  flushinp();
+  frame_sleep(FRAMETIME);
+  input_flush();
   getch_next();
 }
 
@@ -245,28 +319,28 @@ void render_battle(Pokemon *p_pc, Pokemon *p_opp,
                    const char* message, bool show_menu,
                    int32_t scroller_pos, bool selected_fight) { 
   int32_t color;
-  clear();
+  display->clear();
 
   // OPPONENT POKEMON
   if (p_opp->is_shiny()) {
-    attron(A_BOLD);
-    mvaddch(2, 1,'*');
-    attroff(A_BOLD);
+    display->attron(A_BOLD);
+    display->mvaddch(2, 1,'*');
+    display->attroff(A_BOLD);
   }    
-  attron(A_BOLD);
-  mvprintw(2, 2,"%s ", p_opp->get_nickname());
-  attroff(A_BOLD);
+  display->attron(A_BOLD);
+  display->mvprintw(2, 2,"%s ", p_opp->get_nickname());
+  display->attroff(A_BOLD);
   if (p_opp->get_gender() == gender_male) {
-    attron(COLOR_PAIR(COLOR_BLUE));
-    addch('m');
-    attroff(COLOR_PAIR(COLOR_BLUE));
+    display->attron(COLOR_PAIR(COLOR_BLUE));
+    display->addch('m');
+    display->attroff(COLOR_PAIR(COLOR_BLUE));
   } else {
-    attron(COLOR_PAIR(COLOR_MAGENTA));
-    addch('f');
-    attroff(COLOR_PAIR(COLOR_MAGENTA));
+    display->attron(COLOR_PAIR(COLOR_MAGENTA));
+    display->addch('f');
+    display->attroff(COLOR_PAIR(COLOR_MAGENTA));
   }             
-  mvprintw(2, 21 - digits(p_opp->get_level()), "Lv.%d", p_opp->get_level());
-  mvprintw(3, 2, "HP");
+  display->mvprintw(2, 21 - digits(p_opp->get_level()), "Lv.%d", p_opp->get_level());
+  display->mvprintw(3, 2, "HP");
   if (p_opp->get_current_hp() < p_opp->get_stat(stat_hp) / 5) {
     color = CHAR_COLOR_HEALTH_LOW;
   } else if (p_opp->get_current_hp() < p_opp->get_stat(stat_hp) / 2) {
@@ -274,33 +348,33 @@ void render_battle(Pokemon *p_pc, Pokemon *p_opp,
   } else {
     color = CHAR_COLOR_HEALTH_HIGH;
   }
-  attron(COLOR_PAIR(color));
+  display->attron(COLOR_PAIR(color));
   for (int32_t h = 20 * p_opp->get_current_hp(); h > 0; 
        h -= p_opp->get_stat(stat_hp)) {
-    addch(CHAR_HEALTH);
+    display->addch(CHAR_HEALTH);
   }
-  attroff(COLOR_PAIR(color));
+  display->attroff(COLOR_PAIR(color));
 
   // PLAYER POKEMON
   if (p_pc->is_shiny()) {
-    attron(A_BOLD);
-    mvaddch(7, 1,'*');
-    attroff(A_BOLD);
+    display->attron(A_BOLD);
+    display->mvaddch(7, 1,'*');
+    display->attroff(A_BOLD);
   }     
-  attron(A_BOLD);
-  mvprintw(7, 2,"%s ", p_pc->get_nickname());
-  attroff(A_BOLD);
+  display->attron(A_BOLD);
+  display->mvprintw(7, 2,"%s ", p_pc->get_nickname());
+  display->attroff(A_BOLD);
   if (p_pc->get_gender() == gender_male) {
-    attron(COLOR_PAIR(COLOR_BLUE));
-    addch('m');
-    attroff(COLOR_PAIR(COLOR_BLUE));
+    display->attron(COLOR_PAIR(COLOR_BLUE));
+    display->addch('m');
+    display->attroff(COLOR_PAIR(COLOR_BLUE));
   } else {
-    attron(COLOR_PAIR(COLOR_MAGENTA));
-    addch('f');
-    attroff(COLOR_PAIR(COLOR_MAGENTA));
+    display->attron(COLOR_PAIR(COLOR_MAGENTA));
+    display->addch('f');
+    display->attroff(COLOR_PAIR(COLOR_MAGENTA));
   }     
-  mvprintw(7, 21 - digits(p_pc->get_level()), "Lv.%d", p_pc->get_level());
-  mvprintw(8, 2, "HP");
+  display->mvprintw(7, 21 - digits(p_pc->get_level()), "Lv.%d", p_pc->get_level());
+  display->mvprintw(8, 2, "HP");
   if (p_pc->get_current_hp() < p_pc->get_stat(stat_hp) / 5) {
     color = CHAR_COLOR_HEALTH_LOW;
   } else if (p_pc->get_current_hp() < p_pc->get_stat(stat_hp) / 2) {
@@ -308,58 +382,58 @@ void render_battle(Pokemon *p_pc, Pokemon *p_opp,
   } else {
     color = CHAR_COLOR_HEALTH_HIGH;
   }
-  attron(COLOR_PAIR(color));
+  display->attron(COLOR_PAIR(color));
   for (int32_t h = 20 * p_pc->get_current_hp(); h > 0; 
        h -= p_pc->get_stat(stat_hp)) {
-    addch(CHAR_HEALTH);
+    display->addch(CHAR_HEALTH);
   }
-  attroff(COLOR_PAIR(color));
-  mvprintw(9, 17,"%3d/%3d", p_pc->get_current_hp(), p_pc->get_stat(stat_hp));
-  mvprintw(10, 2, "EXP");
-  attron(COLOR_PAIR(CHAR_COLOR_EXP));
+  display->attroff(COLOR_PAIR(color));
+  display->mvprintw(9, 17,"%3d/%3d", p_pc->get_current_hp(), p_pc->get_stat(stat_hp));
+  display->mvprintw(10, 2, "EXP");
+  display->attron(COLOR_PAIR(CHAR_COLOR_EXP));
   for (int32_t e = 19 * p_pc->get_exp(); e > 0; 
        e -= p_pc->get_exp_next_level()) {
-    addch(CHAR_EXP);
+    display->addch(CHAR_EXP);
   }
-  attroff(COLOR_PAIR(CHAR_COLOR_EXP));
+  display->attroff(COLOR_PAIR(CHAR_COLOR_EXP));
 
-  mvprintw(12, 0, message);
+  display->mvprintw(12, 0, message);
   
   if (show_menu) {
-    mvaddch(13, 0, (0 == scroller_pos ? CHAR_CURSOR : CHAR_SCROLL_BAR));
+    display->mvaddch(13, 0, (0 == scroller_pos ? CHAR_CURSOR : CHAR_SCROLL_BAR));
     if (!selected_fight) {
-      printw(" FIGHT");
+      display->printw(" FIGHT");
     } else if (p_pc->get_num_moves() > 0) {
-      printw(" %s", p_pc->get_move(0)->identifier);
+      display->printw(" %s", p_pc->get_move(0)->identifier);
     }
-    mvaddch(14, 0, (1 == scroller_pos ? CHAR_CURSOR : CHAR_SCROLL_BAR));
+    display->mvaddch(14, 0, (1 == scroller_pos ? CHAR_CURSOR : CHAR_SCROLL_BAR));
     if (!selected_fight) {
-      printw(" BAG");
+      display->printw(" BAG");
     } else if (p_pc->get_num_moves() > 1) {
-      printw(" %s", p_pc->get_move(1)->identifier);
+      display->printw(" %s", p_pc->get_move(1)->identifier);
     }
-    mvaddch(15, 0, (2 == scroller_pos ? CHAR_CURSOR : CHAR_SCROLL_BAR));
+    display->mvaddch(15, 0, (2 == scroller_pos ? CHAR_CURSOR : CHAR_SCROLL_BAR));
       if (!selected_fight) {
-      printw(" POKEMON");
+      display->printw(" POKEMON");
     } else if (p_pc->get_num_moves() > 2) {
-      printw(" %s", p_pc->get_move(2)->identifier);
+      display->printw(" %s", p_pc->get_move(2)->identifier);
     }
-    mvaddch(16, 0, (3 == scroller_pos ? CHAR_CURSOR : CHAR_SCROLL_BAR));
+    display->mvaddch(16, 0, (3 == scroller_pos ? CHAR_CURSOR : CHAR_SCROLL_BAR));
     if (!selected_fight) {
-      printw(" RUN");
+      display->printw(" RUN");
     } else if (p_pc->get_num_moves() > 3) {
-      printw(" %s", p_pc->get_move(3)->identifier);
+      display->printw(" %s", p_pc->get_move(3)->identifier);
     }
 
     if (selected_fight && p_pc->get_num_moves() > 0) {
-      mvprintw(17, 0, "PP  %d/%d", p_pc->get_current_pp(scroller_pos), 
+      display->mvprintw(17, 0, "PP  %d/%d", p_pc->get_current_pp(scroller_pos), 
                                    p_pc->get_move(scroller_pos)->pp);
-      mvprintw(18, 0, "type/%s", type_name(p_pc->get_move(scroller_pos)->type_id));
+      display->mvprintw(18, 0, "type/%s", type_name(p_pc->get_move(scroller_pos)->type_id));
     }
 
   }
 
-  refresh();
+  display->refresh();
   return;
 }
 
@@ -368,30 +442,30 @@ void render_battle_getch(Pokemon *p_pc, Pokemon *p_opp,
                          int32_t scroller_pos, bool selected_fight) {
   render_battle(p_pc, p_opp, message, show_menu, scroller_pos, selected_fight);
 
-  usleep(FRAMETIME);
-  flushinp();
+  frame_sleep(FRAMETIME);
+  input_flush();
   getch_next();
 }
 
 void render_party_message(const char *m) {
   // if (display_options) {
-  //   move(10, 0);
-  //   clrtoeol();
-  //   mvprintw(10, 0, m);
+  //   display->move(10, 0);
+  //   display->clrtoeol();
+  //   display->mvprintw(10, 0, m);
   // } else {
-  //   move(6, 0);
-  //   clrtoeol();
-  //   mvprintw(6, 0, m);
+  //   display->move(6, 0);
+  //   display->clrtoeol();
+  //   display->mvprintw(6, 0, m);
   // }
 
-  move(10, 0);
-  clrtoeol();
-  mvprintw(10, 0, m);
+  display->move(10, 0);
+  display->clrtoeol();
+  display->mvprintw(10, 0, m);
   
-  refresh();
+  display->refresh();
   // also wait for keypress
-  usleep(FRAMETIME);
-  flushinp();
+  frame_sleep(FRAMETIME);
+  input_flush();
   getch_next();
 }
 
@@ -402,47 +476,47 @@ void render_party(int32_t selected_p1, int32_t selected_p2,
   Pokemon *p;
   int32_t color;
 
-  clear(); 
-  attron(A_BOLD);
-  mvprintw(0,0,"Pokemon");
-  attroff(A_BOLD);
+  display->clear(); 
+  display->attron(A_BOLD);
+  display->mvprintw(0,0,"Pokemon");
+  display->attroff(A_BOLD);
 
   for (i = 0; i < pc->get_party_size(); ++i) {
     j = (i > selected_p1 && selected_opt != -1) ? 4 : 1;
     p = pc->get_pokemon(i);
     if (i == selected_p1) {
-      mvaddch(i + j, 0, selected_opt == -1 ? CHAR_CURSOR 
+      display->mvaddch(i + j, 0, selected_opt == -1 ? CHAR_CURSOR 
                                            : CHAR_CURSOR_SELECTED);
     } else if (i == selected_p2) {
-      mvaddch(i + j, 0, CHAR_CURSOR);
+      display->mvaddch(i + j, 0, CHAR_CURSOR);
     } else if (selected_opt == -1 || selected_p2 != -1) {
-      mvaddch(i + j, 0, CHAR_SCROLL_BAR);
+      display->mvaddch(i + j, 0, CHAR_SCROLL_BAR);
     }
 
     if (p->is_shiny()) {
-      attron(A_BOLD);
-      mvaddch(i + j, 1,'*');
-      attroff(A_BOLD);
+      display->attron(A_BOLD);
+      display->mvaddch(i + j, 1,'*');
+      display->attroff(A_BOLD);
     } 
-    attron(A_BOLD);
+    display->attron(A_BOLD);
     if (i == selected_p1) {
-      mvprintw(i + j, 2, "%s ", p->get_nickname());
+      display->mvprintw(i + j, 2, "%s ", p->get_nickname());
     } else {
-      mvprintw(i + j, 2, "%s ", p->get_nickname());
+      display->mvprintw(i + j, 2, "%s ", p->get_nickname());
     }
-    attroff(A_BOLD);
+    display->attroff(A_BOLD);
     
     if (p->get_gender() == gender_male) {
-      attron(COLOR_PAIR(COLOR_BLUE));
-      addch('m');
-      attroff(COLOR_PAIR(COLOR_BLUE));
+      display->attron(COLOR_PAIR(COLOR_BLUE));
+      display->addch('m');
+      display->attroff(COLOR_PAIR(COLOR_BLUE));
     } else {
-      attron(COLOR_PAIR(COLOR_MAGENTA));
-      addch('f');
-      attroff(COLOR_PAIR(COLOR_MAGENTA));
+      display->attron(COLOR_PAIR(COLOR_MAGENTA));
+      display->addch('f');
+      display->attroff(COLOR_PAIR(COLOR_MAGENTA));
     }     
-    mvprintw(i + j, 21 - digits(p->get_level()), "Lv.%d", p->get_level());
-    mvprintw(i + j, 26, "HP");
+    display->mvprintw(i + j, 21 - digits(p->get_level()), "Lv.%d", p->get_level());
+    display->mvprintw(i + j, 26, "HP");
     if (p->get_current_hp() < p->get_stat(stat_hp) / 5) {
       color = CHAR_COLOR_HEALTH_LOW;
     } else if (p->get_current_hp() < p->get_stat(stat_hp) / 2) {
@@ -450,63 +524,63 @@ void render_party(int32_t selected_p1, int32_t selected_p2,
     } else {
       color = CHAR_COLOR_HEALTH_HIGH;
     }
-    attron(COLOR_PAIR(color));
+    display->attron(COLOR_PAIR(color));
     for (int32_t h = 12 * p->get_current_hp(); h > 0; 
         h -= p->get_stat(stat_hp)) {
-      addch(CHAR_HEALTH);
+      display->addch(CHAR_HEALTH);
     }
-    attroff(COLOR_PAIR(color));
-    mvprintw(i + j, 40,"%3d/%3d", p->get_current_hp(), p->get_stat(stat_hp));
-    mvprintw(i + j, 49, "EXP");
-    attron(COLOR_PAIR(CHAR_COLOR_EXP));
+    display->attroff(COLOR_PAIR(color));
+    display->mvprintw(i + j, 40,"%3d/%3d", p->get_current_hp(), p->get_stat(stat_hp));
+    display->mvprintw(i + j, 49, "EXP");
+    display->attron(COLOR_PAIR(CHAR_COLOR_EXP));
     for (int32_t e = 12 * p->get_exp(); e > 0; 
         e -= p->get_exp_next_level()) {
-      addch(CHAR_EXP);
+      display->addch(CHAR_EXP);
     }
-    attroff(COLOR_PAIR(CHAR_COLOR_EXP));
+    display->attroff(COLOR_PAIR(CHAR_COLOR_EXP));
 
     // draw submenu
     if (selected_opt != -1 && i == selected_p1) {
       if (selected_opt == 0) {
         if (selected_p2 == -1) {
-          mvaddch(i + j + 1, 2, CHAR_CURSOR);
-          mvaddch(i + j + 2, 2, CHAR_SCROLL_BAR);
-          mvaddch(i + j + 3, 2, CHAR_SCROLL_BAR);
+          display->mvaddch(i + j + 1, 2, CHAR_CURSOR);
+          display->mvaddch(i + j + 2, 2, CHAR_SCROLL_BAR);
+          display->mvaddch(i + j + 3, 2, CHAR_SCROLL_BAR);
         } else {
-          mvaddch(i + j + 1, 2, CHAR_CURSOR_SELECTED);
+          display->mvaddch(i + j + 1, 2, CHAR_CURSOR_SELECTED);
         }
       } else if (selected_opt == 1) {
-        mvaddch(i + j + 1, 2, CHAR_SCROLL_BAR);
-        mvaddch(i + j + 2, 2, CHAR_CURSOR);
-        mvaddch(i + j + 3, 2, CHAR_SCROLL_BAR);
+        display->mvaddch(i + j + 1, 2, CHAR_SCROLL_BAR);
+        display->mvaddch(i + j + 2, 2, CHAR_CURSOR);
+        display->mvaddch(i + j + 3, 2, CHAR_SCROLL_BAR);
       }  else if (selected_opt == 2) {
-        mvaddch(i + j + 1, 2, CHAR_SCROLL_BAR);
-        mvaddch(i + j + 2, 2, CHAR_SCROLL_BAR);
-        mvaddch(i + j + 3, 2, CHAR_CURSOR);
+        display->mvaddch(i + j + 1, 2, CHAR_SCROLL_BAR);
+        display->mvaddch(i + j + 2, 2, CHAR_SCROLL_BAR);
+        display->mvaddch(i + j + 3, 2, CHAR_CURSOR);
       } 
-      mvprintw(i + j + 1, 4, "%s", o1);
-      mvprintw(i + j + 2, 4, "%s", o2);
-      mvprintw(i + j + 3, 4, "CANCEL");
+      display->mvprintw(i + j + 1, 4, "%s", o1);
+      display->mvprintw(i + j + 2, 4, "%s", o2);
+      display->mvprintw(i + j + 3, 4, "CANCEL");
     }
 
     // if (selected_p2 != -1 && i == selected_p1) {
-    //   mvaddch(i + j + 1, 0, CHAR_SCROLL_BAR);
-    //   mvaddch(i + j + 2, 0, CHAR_SCROLL_BAR);
-    //   mvaddch(i + j + 3, 0, CHAR_SCROLL_BAR);
+    //   display->mvaddch(i + j + 1, 0, CHAR_SCROLL_BAR);
+    //   display->mvaddch(i + j + 2, 0, CHAR_SCROLL_BAR);
+    //   display->mvaddch(i + j + 3, 0, CHAR_SCROLL_BAR);
     // }
   }
 
   // jumping text (kinda distracting, opting not to use for now)
   // j = (i > selected_p1 && selected_opt != -1) ? 4 : 1;
-  // mvprintw(6 + j,0,"%s", m);
+  // display->mvprintw(6 + j,0,"%s", m);
 
-  mvprintw(10,0,"%s", m);
+  display->mvprintw(10,0,"%s", m);
 
   // scroller debug
-  // mvprintw(8+j,0,"p1: %d  opt: %d p2: %d", 
+  // display->mvprintw(8+j,0,"p1: %d  opt: %d p2: %d", 
   //            selected_p1, selected_opt, selected_p2);
 
-  refresh();
+  display->refresh();
   return;
 }
 
@@ -515,102 +589,102 @@ void render_party_getch(int32_t selected_p1, int32_t selected_p2,
                         const char *m, const char *o1, const char *o2) {
   render_party(selected_p1, selected_p2, selected_opt, m, o1, o2);
 
-  usleep(FRAMETIME);
-  flushinp();
+  frame_sleep(FRAMETIME);
+  input_flush();
   getch_next();
 }
 
 void render_summary(Pokemon *p) {
-  clear();
+  display->clear();
 
-  move(0, 0);
-  attron(A_BOLD);
+  display->move(0, 0);
+  display->attron(A_BOLD);
   if (p->is_shiny())
-    addch('*');
-  printw("%s ", p->get_nickname());
-  attroff(A_BOLD);
+    display->addch('*');
+  display->printw("%s ", p->get_nickname());
+  display->attroff(A_BOLD);
   
   if (p->get_gender() == gender_male) {
-    attron(COLOR_PAIR(COLOR_BLUE));
-    addch('m');
-    attroff(COLOR_PAIR(COLOR_BLUE));
+    display->attron(COLOR_PAIR(COLOR_BLUE));
+    display->addch('m');
+    display->attroff(COLOR_PAIR(COLOR_BLUE));
   } else {
-    attron(COLOR_PAIR(COLOR_MAGENTA));
-    addch('f');
-    attroff(COLOR_PAIR(COLOR_MAGENTA));
+    display->attron(COLOR_PAIR(COLOR_MAGENTA));
+    display->addch('f');
+    display->attroff(COLOR_PAIR(COLOR_MAGENTA));
   }
 
-  mvprintw(0, 19 - digits(p->get_level()), "Lv.%d", p->get_level());
+  display->mvprintw(0, 19 - digits(p->get_level()), "Lv.%d", p->get_level());
 
-  mvprintw(1, 0, "DEX NO.: %d %s", p->get_pd_entry()->id, 
+  display->mvprintw(1, 0, "DEX NO.: %d %s", p->get_pd_entry()->id, 
                                    p->get_pd_entry()->identifier);
-  mvprintw(2, 0, "TYPE   : %s %s", type_name(p->get_type(0)), 
+  display->mvprintw(2, 0, "TYPE   : %s %s", type_name(p->get_type(0)), 
                                    type_name(p->get_type(1)));
-  mvprintw(4, 0, "STATS");
-  mvprintw(5, 2, "HP     : %3d/%3d", p->get_current_hp(), p->get_stat(stat_hp));
-  mvprintw(6, 2, "ATTACK : %d", p->get_stat(stat_attack));
-  mvprintw(7, 2, "DEFENSE: %d", p->get_stat(stat_defense));
-  mvprintw(8, 2, "SP. ATK: %d", p->get_stat(stat_sp_atk));
-  mvprintw(9, 2, "SP. DEF: %d", p->get_stat(stat_sp_def));
-  mvprintw(10,2, "SPEED  : %d", p->get_stat(stat_speed));
+  display->mvprintw(4, 0, "STATS");
+  display->mvprintw(5, 2, "HP     : %3d/%3d", p->get_current_hp(), p->get_stat(stat_hp));
+  display->mvprintw(6, 2, "ATTACK : %d", p->get_stat(stat_attack));
+  display->mvprintw(7, 2, "DEFENSE: %d", p->get_stat(stat_defense));
+  display->mvprintw(8, 2, "SP. ATK: %d", p->get_stat(stat_sp_atk));
+  display->mvprintw(9, 2, "SP. DEF: %d", p->get_stat(stat_sp_def));
+  display->mvprintw(10,2, "SPEED  : %d", p->get_stat(stat_speed));
 
   #ifdef POKEMON_SUMMARY_SHOW_IVS
-  mvprintw(3, 17, "IVs");
-  mvprintw(4, 17, "%d", p->get_iv(stat_hp));
-  mvprintw(5, 17, "%d", p->get_iv(stat_attack));
-  mvprintw(6, 17, "%d", p->get_iv(stat_defense));
-  mvprintw(7, 17, "%d", p->get_iv(stat_sp_atk));
-  mvprintw(8, 17, "%d", p->get_iv(stat_sp_def));
-  mvprintw(9, 17, "%d", p->get_iv(stat_speed));
+  display->mvprintw(3, 17, "IVs");
+  display->mvprintw(4, 17, "%d", p->get_iv(stat_hp));
+  display->mvprintw(5, 17, "%d", p->get_iv(stat_attack));
+  display->mvprintw(6, 17, "%d", p->get_iv(stat_defense));
+  display->mvprintw(7, 17, "%d", p->get_iv(stat_sp_atk));
+  display->mvprintw(8, 17, "%d", p->get_iv(stat_sp_def));
+  display->mvprintw(9, 17, "%d", p->get_iv(stat_speed));
   #endif
 
-  mvprintw(12,0, "EXP");
-  mvprintw(13,2, "EXP POINTS: %d", p->get_exp());
-  mvprintw(14,2, "NEXT LV.  : %d", p->get_exp_next_level());
+  display->mvprintw(12,0, "EXP");
+  display->mvprintw(13,2, "EXP POINTS: %d", p->get_exp());
+  display->mvprintw(14,2, "NEXT LV.  : %d", p->get_exp_next_level());
 
-  mvprintw(16,0, "MOVES");
+  display->mvprintw(16,0, "MOVES");
   if (p->get_num_moves() > 0) {
-    mvprintw(17,2, "%s", p->get_move(0)->identifier);
-    mvprintw(17,22, "PP");
-    mvprintw(17,29 - digits(p->get_current_pp(0)) - digits(p->get_move(0)->pp), 
+    display->mvprintw(17,2, "%s", p->get_move(0)->identifier);
+    display->mvprintw(17,22, "PP");
+    display->mvprintw(17,29 - digits(p->get_current_pp(0)) - digits(p->get_move(0)->pp), 
              "%d/%d  type/%s", p->get_current_pp(0), 
                                p->get_move(0)->pp,
                                type_name(p->get_move(0)->type_id));
   }
   if (p->get_num_moves() > 1) {
-    mvprintw(18,2, "%s", p->get_move(1)->identifier);
-    mvprintw(18,22, "PP");
-    mvprintw(18,29 - digits(p->get_current_pp(1)) - digits(p->get_move(1)->pp), 
+    display->mvprintw(18,2, "%s", p->get_move(1)->identifier);
+    display->mvprintw(18,22, "PP");
+    display->mvprintw(18,29 - digits(p->get_current_pp(1)) - digits(p->get_move(1)->pp), 
              "%d/%d  type/%s", p->get_current_pp(1), 
                                p->get_move(1)->pp,
                                type_name(p->get_move(1)->type_id));
   }
   if (p->get_num_moves() > 2) {
-    mvprintw(19,2, "%s", p->get_move(2)->identifier);
-    mvprintw(19,22, "PP");
-    mvprintw(19,29 - digits(p->get_current_pp(2)) - digits(p->get_move(2)->pp), 
+    display->mvprintw(19,2, "%s", p->get_move(2)->identifier);
+    display->mvprintw(19,22, "PP");
+    display->mvprintw(19,29 - digits(p->get_current_pp(2)) - digits(p->get_move(2)->pp), 
              "%d/%d  type/%s", p->get_current_pp(2), 
                                p->get_move(2)->pp,
                                type_name(p->get_move(2)->type_id));
   }
   if (p->get_num_moves() > 3) {
-    mvprintw(20,2, "%s", p->get_move(3)->identifier);
-    mvprintw(20,22, "PP");
-    mvprintw(20,29 - digits(p->get_current_pp(3)) - digits(p->get_move(3)->pp), 
+    display->mvprintw(20,2, "%s", p->get_move(3)->identifier);
+    display->mvprintw(20,22, "PP");
+    display->mvprintw(20,29 - digits(p->get_current_pp(3)) - digits(p->get_move(3)->pp), 
              "%d/%d  type/%s", p->get_current_pp(3), 
                                p->get_move(3)->pp,
                                type_name(p->get_move(3)->type_id));
   }
 
-  mvprintw(22,0,"Press ESC to exit summary view");
+  display->mvprintw(22,0,"Press ESC to exit summary view");
 
-  refresh();
+  display->refresh();
 
   // wait for back input
   int32_t key;
-  flushinp();
+  input_flush();
   while (true) {
-    key = getch();
+    key = input_getch();
     if (CTRL_BACK) {
       return;
     } else if (CTRL_QUIT_GAME) {
@@ -623,12 +697,12 @@ void render_summary(Pokemon *p) {
  * Renders a poke center to the screen
  */
 void render_center() { 
-  clear();
-  attron(A_BOLD);
-  mvprintw(0,0,"Pokemon Center");
-  attroff(A_BOLD);
-  mvprintw(MAX_ROW + 2,0,"Press < to quickly exit the Pokemon Center");
-  refresh();
+  display->clear();
+  display->attron(A_BOLD);
+  display->mvprintw(0,0,"Pokemon Center");
+  display->attroff(A_BOLD);
+  display->mvprintw(MAX_ROW + 2,0,"Press < to quickly exit the Pokemon Center");
+  display->refresh();
   return;
 }
 
@@ -649,122 +723,122 @@ void render_mart(int32_t action_selector, int32_t item_scroller,
    * 2 Exit
    */
 
-  clear(); 
-  attron(A_BOLD);
-  mvprintw(0,0,"Pokemon Mart");
-  attroff(A_BOLD);
+  display->clear(); 
+  display->attron(A_BOLD);
+  display->mvprintw(0,0,"Pokemon Mart");
+  display->attroff(A_BOLD);
 
-  mvprintw(1,2, "BUY");
-  mvprintw(2,2, "SELL");
-  mvprintw(3,2, "SEE YA!");
+  display->mvprintw(1,2, "BUY");
+  display->mvprintw(2,2, "SELL");
+  display->mvprintw(3,2, "SEE YA!");
 
-  mvprintw(1, 20, "MONEY");
+  display->mvprintw(1, 20, "MONEY");
   sprintf(r_align, "$%d", pc->get_poke_dollars());
-  mvprintw(2, 18, "%*s", 9, r_align);
+  display->mvprintw(2, 18, "%*s", 9, r_align);
 
   if (item_scroller == -1) {
     // no option selected
     for (i = 0; i < 3; ++i) {
       if (i == action_selector) {
-        mvaddch(i + 1,0, CHAR_CURSOR);
+        display->mvaddch(i + 1,0, CHAR_CURSOR);
       } else {
-        mvaddch(i + 1,0, CHAR_SCROLL_BAR);
+        display->mvaddch(i + 1,0, CHAR_SCROLL_BAR);
       }
     }
   } else if (action_selector == 0 && item_scroller != -1) {
     // Selected BUY
-    mvaddch(1,0, CHAR_CURSOR_SELECTED);
+    display->mvaddch(1,0, CHAR_CURSOR_SELECTED);
     if (amount == -1) {
-      mvprintw(5,0,"What would you like to buy?");
+      display->mvprintw(5,0,"What would you like to buy?");
     } else {
-      mvprintw(5,0,"How many?");
+      display->mvprintw(5,0,"How many?");
     }
     for (i = 0; (i < num_items && i < MAX_ROW - 8); ++i) {
       tmp_item = static_cast<item_t>(i + page_index);
       if (i == item_scroller - page_index) {
         if (amount == -1) {
-          mvaddch(i + 6,0, CHAR_CURSOR);
+          display->mvaddch(i + 6,0, CHAR_CURSOR);
         } else {
-          mvaddch(i + 6,0, CHAR_CURSOR_SELECTED);
-          attron(A_BOLD);
-          mvaddch(i + 5, 27, '+');
-          attroff(A_BOLD);
+          display->mvaddch(i + 6,0, CHAR_CURSOR_SELECTED);
+          display->attron(A_BOLD);
+          display->mvaddch(i + 5, 27, '+');
+          display->attroff(A_BOLD);
           sprintf(r_align, "$%d", amount * item_cost[tmp_item]);
-          mvprintw(i + 6, 26, "x%02d %*s    IN BAG: %3d", amount, 7, r_align, 
+          display->mvprintw(i + 6, 26, "x%02d %*s    IN BAG: %3d", amount, 7, r_align, 
                    pc->num_in_bag(tmp_item));
-          attron(A_BOLD);
-          mvaddch(i + 7, 27, '-');
-          attroff(A_BOLD);
+          display->attron(A_BOLD);
+          display->mvaddch(i + 7, 27, '-');
+          display->attroff(A_BOLD);
         }
         cursor_item = static_cast<item_t>(i + page_index); 
       } else {
         if (amount == -1) {
-          mvaddch(i + 6,0, CHAR_SCROLL_BAR);
+          display->mvaddch(i + 6,0, CHAR_SCROLL_BAR);
         }
       }
       sprintf(r_align, "$%d", item_cost[tmp_item]);
-      mvprintw(i + 6, 2, "%*s | %s", 6, r_align, item_name_txt[tmp_item]);
+      display->mvprintw(i + 6, 2, "%*s | %s", 6, r_align, item_name_txt[tmp_item]);
     }
-    mvprintw(i + 7,0, item_desc_txt[cursor_item * 2]);
-    mvprintw(i + 8,0, item_desc_txt[cursor_item * 2 + 1]);
+    display->mvprintw(i + 7,0, item_desc_txt[cursor_item * 2]);
+    display->mvprintw(i + 8,0, item_desc_txt[cursor_item * 2 + 1]);
 
   } else if (action_selector == 1 && item_scroller != -1) {
     // Selected SELL
-    mvaddch(2,0, CHAR_CURSOR_SELECTED);
+    display->mvaddch(2,0, CHAR_CURSOR_SELECTED);
     if (amount == -1) {
-      mvprintw(5,0,"What would you like to sell?");
+      display->mvprintw(5,0,"What would you like to sell?");
     } else {
-      mvprintw(5,0,"How many?");
+      display->mvprintw(5,0,"How many?");
     }
     for (i = 0; (i < pc->num_bag_slots() && i < MAX_ROW - 8); ++i) {
       tmp_slot = pc->peek_bag_slot(i + page_index);
       if (i == item_scroller - page_index) {
         if (amount == -1) {
-          mvaddch(i + 6,0, CHAR_CURSOR);
+          display->mvaddch(i + 6,0, CHAR_CURSOR);
         } else {
-          mvaddch(i + 6,0, CHAR_CURSOR_SELECTED);
-          attron(A_BOLD);
-          mvaddch(i + 5, 27, '+');
-          attroff(A_BOLD);
-          mvprintw(i + 6, 26, "x%02d %*s", amount, 7, r_align);
+          display->mvaddch(i + 6,0, CHAR_CURSOR_SELECTED);
+          display->attron(A_BOLD);
+          display->mvaddch(i + 5, 27, '+');
+          display->attroff(A_BOLD);
+          display->mvprintw(i + 6, 26, "x%02d %*s", amount, 7, r_align);
           sprintf(r_align, "$%d", amount * item_sell_price[tmp_slot.item]);
-          mvprintw(i + 6, 26, "x%02d %*s    IN BAG: %3d", amount, 7, r_align, 
+          display->mvprintw(i + 6, 26, "x%02d %*s    IN BAG: %3d", amount, 7, r_align, 
                    pc->num_in_bag(tmp_slot.item));
-          attron(A_BOLD);
-          mvaddch(i + 7, 27, '-');
-          attroff(A_BOLD);
+          display->attron(A_BOLD);
+          display->mvaddch(i + 7, 27, '-');
+          display->attroff(A_BOLD);
         }
         cursor_slot = pc->peek_bag_slot(i + page_index); 
       } else {
-        mvaddch(i + 6,0, CHAR_SCROLL_BAR);
+        display->mvaddch(i + 6,0, CHAR_SCROLL_BAR);
       }
       
       sprintf(r_align, "$%d", item_sell_price[tmp_slot.item]);
-      mvprintw(i + 6, 2, "%*s | %s", 6, 
+      display->mvprintw(i + 6, 2, "%*s | %s", 6, 
                r_align, item_name_txt[tmp_slot.item]);
     }
-    mvprintw(i + 7,0, item_desc_txt[cursor_slot.item * 2]);
-    mvprintw(i + 8,0, item_desc_txt[cursor_slot.item * 2 + 1]);
+    display->mvprintw(i + 7,0, item_desc_txt[cursor_slot.item * 2]);
+    display->mvprintw(i + 8,0, item_desc_txt[cursor_slot.item * 2 + 1]);
   }
 
-  mvprintw(MAX_ROW + 2,0,"Press < to quickly exit the Pokemon Mart");
-  refresh();
+  display->mvprintw(MAX_ROW + 2,0,"Press < to quickly exit the Pokemon Mart");
+  display->refresh();
   return;
 }
 
 void render_mart_message(const char *m) {
-  move(5, 0);
-  clrtoeol();
-  printw(m);
-  refresh();
+  display->move(5, 0);
+  display->clrtoeol();
+  display->printw(m);
+  display->refresh();
   // redraw money
   char r_align[8];
   sprintf(r_align, "$%d", pc->get_poke_dollars());
-  mvprintw(2, 18, "%*s", 9, r_align);
+  display->mvprintw(2, 18, "%*s", 9, r_align);
   // clear submenu
   for (int32_t i = 6; i < MAX_ROW + 2; ++i) {
-    move(i, 0);
-    clrtoeol();
+    display->move(i, 0);
+    display->clrtoeol();
   }
 
   // also wait for keypress
@@ -782,20 +856,20 @@ void render_tnr_overlay(int32_t scroller_pos) {
   int32_t rel_i, rel_j;
   char dir_ns, dir_ew;
 
-  clear(); 
-  attron(A_BOLD);
-  mvprintw(0,0,"Nearby Trainers");
-  attroff(A_BOLD);
+  display->clear(); 
+  display->attron(A_BOLD);
+  display->mvprintw(0,0,"Nearby Trainers");
+  display->attroff(A_BOLD);
 
   for (i = 0; 
        (i < static_cast<int32_t>(r->get_npcs()->size())) && (i < MAX_ROW); 
        i++) {
-    Character *c = &r->get_npcs()->at(scroller_pos + i);
+    Character *c = r->get_npcs()->at(scroller_pos + i);
 
-    mvaddch(i + 1,0, CHAR_SCROLL_BAR);
-    attron(COLOR_PAIR(c->get_color()));
-    mvaddch(i + 1, 2, c->get_ch());
-    attroff(COLOR_PAIR(c->get_color()));
+    display->mvaddch(i + 1,0, CHAR_SCROLL_BAR);
+    display->attron(COLOR_PAIR(c->get_color()));
+    display->mvaddch(i + 1, 2, c->get_ch());
+    display->attroff(COLOR_PAIR(c->get_color()));
 
     rel_i = c->get_i() - pc->get_i();
     rel_j = c->get_j() - pc->get_j();
@@ -811,24 +885,24 @@ void render_tnr_overlay(int32_t scroller_pos) {
     } else {
       dir_ew = 'e';
     }
-    mvprintw(i + 1,4,"(%2d%c, %2d%c)", rel_i, dir_ns, rel_j, dir_ew);
+    display->mvprintw(i + 1,4,"(%2d%c, %2d%c)", rel_i, dir_ns, rel_j, dir_ew);
     
     if (c->is_defeated()) {
-      mvprintw(i + 1,15,"(defeated)");
+      display->mvprintw(i + 1,15,"(defeated)");
     }
     
   }
   
-  mvprintw(i + 2,0,"Press ESC to close trainer overlay");
-  refresh();
+  display->mvprintw(i + 2,0,"Press ESC to close trainer overlay");
+  display->refresh();
   return;
 }
 
 void render_bag_message(const char *m) {
-  move(MAX_ROW - 2, 0);
-  clrtoeol();
-  printw(m);
-  refresh();
+  display->move(MAX_ROW - 2, 0);
+  display->clrtoeol();
+  display->printw(m);
+  display->refresh();
   // also wait for keypress
   getch_next();
 }
@@ -840,28 +914,28 @@ void render_bag(int32_t page_index, int32_t scroller_pos) {
   int32_t i;
   bag_slot_t s, selected_slot;
 
-  clear(); 
-  attron(A_BOLD);
-  mvprintw(0,0,"Bag");
-  attroff(A_BOLD);
+  display->clear(); 
+  display->attron(A_BOLD);
+  display->mvprintw(0,0,"Bag");
+  display->attroff(A_BOLD);
 
   for (i = 0; (i < pc->num_bag_slots() && i < MAX_ROW - 3); ++i) {
     s = pc->peek_bag_slot(i + page_index);
     if (i == scroller_pos - page_index) {
-      mvaddch(i + 1,0, CHAR_CURSOR);
+      display->mvaddch(i + 1,0, CHAR_CURSOR);
       selected_slot = pc->peek_bag_slot(i + page_index); 
     } else {
-      mvaddch(i + 1,0, CHAR_SCROLL_BAR);
+      display->mvaddch(i + 1,0, CHAR_SCROLL_BAR);
     }
     
-    mvprintw(i + 1, 2, "%3dx %s", s.cnt, item_name_txt[s.item]);
+    display->mvprintw(i + 1, 2, "%3dx %s", s.cnt, item_name_txt[s.item]);
   }
 
-  mvprintw(i + 1,0, item_desc_txt[selected_slot.item * 2]);
-  mvprintw(i + 2,0, item_desc_txt[selected_slot.item * 2 + 1]);
+  display->mvprintw(i + 1,0, item_desc_txt[selected_slot.item * 2]);
+  display->mvprintw(i + 2,0, item_desc_txt[selected_slot.item * 2 + 1]);
 
-  mvprintw(MAX_ROW + 2,0,"Choose an ITEM.");
-  refresh();
+  display->mvprintw(MAX_ROW + 2,0,"Choose an ITEM.");
+  display->refresh();
   return;
 }
 
@@ -871,23 +945,23 @@ void render_bag(int32_t page_index, int32_t scroller_pos) {
 void render_pick_starter(int32_t scroller_pos, 
                          Pokemon *p1, Pokemon *p2, Pokemon *p3) { 
 
-  clear(); 
-  attron(A_BOLD);
-  mvprintw(0,0,"Choose a Starter Pokemon");
-  attroff(A_BOLD);
+  display->clear(); 
+  display->attron(A_BOLD);
+  display->mvprintw(0,0,"Choose a Starter Pokemon");
+  display->attroff(A_BOLD);
   
 
-  mvaddch(2,0, CHAR_SCROLL_BAR);
-  mvprintw(2, 2, "%s  Lv.%d", p1->get_nickname(), p1->get_level());
-  mvaddch(3,0, CHAR_SCROLL_BAR);
-  mvprintw(3, 2, "%s  Lv.%d", p2->get_nickname(), p2->get_level());
-  mvaddch(4,0, CHAR_SCROLL_BAR);
-  mvprintw(4, 2, "%s  Lv.%d", p3->get_nickname(), p3->get_level());
+  display->mvaddch(2,0, CHAR_SCROLL_BAR);
+  display->mvprintw(2, 2, "%s  Lv.%d", p1->get_nickname(), p1->get_level());
+  display->mvaddch(3,0, CHAR_SCROLL_BAR);
+  display->mvprintw(3, 2, "%s  Lv.%d", p2->get_nickname(), p2->get_level());
+  display->mvaddch(4,0, CHAR_SCROLL_BAR);
+  display->mvprintw(4, 2, "%s  Lv.%d", p3->get_nickname(), p3->get_level());
 
-  mvaddch(2 + scroller_pos,0, CHAR_CURSOR);
+  display->mvaddch(2 + scroller_pos,0, CHAR_CURSOR);
 
-  mvprintw(6,0,"Press Enter to select a pokemon");
-  refresh();
+  display->mvprintw(6,0,"Press Enter to select a pokemon");
+  display->refresh();
   return;
 }
 
@@ -913,9 +987,9 @@ void process_input_battle(Pokemon *p_pc, int32_t *scroller_pos,
    * move 3
    */
 
-  flushinp();
+  input_flush();
   while (no_op)  {
-    key = getch();
+    key = input_getch();
     if (CTRL_UP) {
       if (*scroller_pos > 0) {
         --(*scroller_pos); 
@@ -959,48 +1033,48 @@ void process_input_battle(Pokemon *p_pc, int32_t *scroller_pos,
  */
 void render_select_move(Pokemon *p, pd_move_t *new_move, int32_t scroller_pos, 
                        const char *m1, const char *m2, const char *m_cancel) {
-  clear();
+  display->clear();
   if (m1 != NULL)
-    mvprintw(0, 0, m1);
+    display->mvprintw(0, 0, m1);
   if (m2 != NULL)
-    mvprintw(2, 0, m2);
+    display->mvprintw(2, 0, m2);
 
   if (p->get_num_moves() > 0) {
-    mvprintw(3,2, "%s", p->get_move(0)->identifier);
-    mvprintw(3,22, "PP");
-    mvprintw(3,29 - digits(p->get_current_pp(0)) - digits(p->get_move(0)->pp), 
+    display->mvprintw(3,2, "%s", p->get_move(0)->identifier);
+    display->mvprintw(3,22, "PP");
+    display->mvprintw(3,29 - digits(p->get_current_pp(0)) - digits(p->get_move(0)->pp), 
              "%d/%d  type/%s", p->get_current_pp(0), 
                                p->get_move(0)->pp,
                                type_name(p->get_move(0)->type_id));
   }
   if (p->get_num_moves() > 1) {
-    mvprintw(4,2, "%s", p->get_move(1)->identifier);
-    mvprintw(4,22, "PP");
-    mvprintw(4,29 - digits(p->get_current_pp(1)) - digits(p->get_move(1)->pp), 
+    display->mvprintw(4,2, "%s", p->get_move(1)->identifier);
+    display->mvprintw(4,22, "PP");
+    display->mvprintw(4,29 - digits(p->get_current_pp(1)) - digits(p->get_move(1)->pp), 
              "%d/%d  type/%s", p->get_current_pp(1), 
                                p->get_move(1)->pp,
                                type_name(p->get_move(1)->type_id));
   }
   if (p->get_num_moves() > 2) {
-    mvprintw(5,2, "%s", p->get_move(2)->identifier);
-    mvprintw(5,22, "PP");
-    mvprintw(5,29 - digits(p->get_current_pp(2)) - digits(p->get_move(2)->pp), 
+    display->mvprintw(5,2, "%s", p->get_move(2)->identifier);
+    display->mvprintw(5,22, "PP");
+    display->mvprintw(5,29 - digits(p->get_current_pp(2)) - digits(p->get_move(2)->pp), 
              "%d/%d  type/%s", p->get_current_pp(2), 
                                p->get_move(2)->pp,
                                type_name(p->get_move(2)->type_id));
   }
   if (p->get_num_moves() > 3) {
-    mvprintw(6,2, "%s", p->get_move(3)->identifier);
-    mvprintw(6,22, "PP");
-    mvprintw(6,29 - digits(p->get_current_pp(3)) - digits(p->get_move(3)->pp), 
+    display->mvprintw(6,2, "%s", p->get_move(3)->identifier);
+    display->mvprintw(6,22, "PP");
+    display->mvprintw(6,29 - digits(p->get_current_pp(3)) - digits(p->get_move(3)->pp), 
              "%d/%d  type/%s", p->get_current_pp(3), 
                                p->get_move(3)->pp,
                                type_name(p->get_move(3)->type_id));
   }
   if (new_move != NULL) {
-    mvprintw(9,0, "%s", new_move->identifier);
-    mvprintw(9,20, "PP");
-    mvprintw(9,27 - digits(p->get_current_pp(3)) - digits(new_move->pp), 
+    display->mvprintw(9,0, "%s", new_move->identifier);
+    display->mvprintw(9,20, "PP");
+    display->mvprintw(9,27 - digits(p->get_current_pp(3)) - digits(new_move->pp), 
              "%d/%d  type/%s", p->get_current_pp(3), 
                                p->get_move(3)->pp,
                                type_name(new_move->type_id));
@@ -1008,19 +1082,19 @@ void render_select_move(Pokemon *p, pd_move_t *new_move, int32_t scroller_pos,
 
   if (scroller_pos != -1) {
     if (m_cancel != NULL) {
-      mvprintw(3 + p->get_num_moves(),2, m_cancel);
+      display->mvprintw(3 + p->get_num_moves(),2, m_cancel);
     }
 
     for (int32_t i = 0; i <= p->get_num_moves(); ++i) {
       if (scroller_pos == i) {
-        mvaddch(i + 3, 0, CHAR_CURSOR);
+        display->mvaddch(i + 3, 0, CHAR_CURSOR);
       } else {
-        mvaddch(i + 3, 0, CHAR_SCROLL_BAR);
+        display->mvaddch(i + 3, 0, CHAR_SCROLL_BAR);
       }
     }
   }
 
-  refresh();
+  display->refresh();
   return;
 }
 
@@ -1030,8 +1104,8 @@ void render_select_move_getch(Pokemon *p, pd_move_t *new_move,
                              const char *m_cancel) {
   render_select_move(p, new_move, scroller_pos, m1, m2, m_cancel);
 
-  usleep(FRAMETIME);
-  flushinp();
+  frame_sleep(FRAMETIME);
+  input_flush();
   getch_next();
 }
 
@@ -1048,9 +1122,9 @@ void process_input_select_move(Pokemon *p, int32_t *scroller_pos,
    * 4 Give up trying to teach a new move to %s?
    */
 
-  flushinp();
+  input_flush();
   while (no_op)  {
-    key = getch();
+    key = input_getch();
     if (CTRL_UP) {
       if (*scroller_pos > 0) {
         --(*scroller_pos); 
@@ -1083,9 +1157,9 @@ void process_input_center(int32_t *exit_center) {
   uint32_t no_op = 1;
   int32_t key = 0;
 
-  flushinp();
+  input_flush();
   while (no_op)  {
-    key = getch();
+    key = input_getch();
     if (CTRL_EXIT_BLDG) {
       *exit_center = 1;
       no_op = 0;
@@ -1106,9 +1180,9 @@ void process_input_mart(int32_t *action_selector, int32_t *item_scroller,
   int32_t key = 0;
   char m[MAX_COL];
 
-  flushinp();
+  input_flush();
   while (no_op)  {
-    key = getch();
+    key = input_getch();
     if (CTRL_EXIT_BLDG) {
       *exit_mart = 1;
       no_op = 0;
@@ -1242,9 +1316,9 @@ void process_input_tnr_overlay(int32_t *scroller_pos, int32_t *close_overlay) {
   uint32_t no_op = 1;
   int32_t key = 0;
 
-  flushinp();
+  input_flush();
   while (no_op)  {
-    key = getch();
+    key = input_getch();
     if (CTRL_TNR_LIST_HIDE) {
       *close_overlay = 1;
       no_op = 0;
@@ -1290,9 +1364,9 @@ void process_input_party(int32_t scenario,
 
   // TODO: block poke switch attempts if there is only 1 pokemon
 
-  flushinp();
+  input_flush();
   while (no_op)  {
-    key = getch();
+    key = input_getch();
     if ((CTRL_CLOSE_PARTY) && scenario == 0 && *selected_opt == -1) {
       *selected_p1 = -1;
       *close_party = 1;
@@ -1440,9 +1514,9 @@ void process_input_bag(int32_t *page_index, int32_t *scroller_pos,
   uint32_t no_op = 1;
   int32_t key = 0;
 
-  flushinp();
+  input_flush();
   while (no_op)  {
-    key = getch();
+    key = input_getch();
     if (CTRL_CLOSE_BAG) {
       *close_bag = 1;
       no_op = 0;
@@ -1480,9 +1554,9 @@ void process_input_pick_starter(int32_t *scroller_pos,
   uint32_t no_op = 1;
   int32_t key = 0;
 
-  flushinp();
+  input_flush();
   while (no_op)  {
-    key = getch();
+    key = input_getch();
     if (CTRL_DOWN) {
       if (*scroller_pos < 2) {
         ++(*scroller_pos);
@@ -1558,9 +1632,12 @@ void process_input_nav() {
   uint32_t no_op = 1;
   int32_t key = 0;
 
-  flushinp();
+  // Only the map keeps keys typed ahead, so a movement key held down is not
+  // lost between turns. Menus drop them, or keys meant for walking would be 
+  // taken as menu choices.
+  input_trim(INPUT_TYPEAHEAD_MAX);
   while (no_op)  {
-    key = getch();
+    key = input_getch();
     if (CTRL_UP) {
       no_op = process_pc_move_attempt(dir_n);
     } else if (CTRL_UP_RIGHT) {
@@ -1601,6 +1678,30 @@ void process_input_nav() {
     } else if (CTRL_VIEW_PARTY) {
       party_view_driver(0);
       render_region(r);
+    } else if (CTRL_SAVE_GAME) {
+      render_region(r);
+      if (world_active()) {
+        world_checkpoint(true);
+        render_region_message("Game saved.");
+      } else if (autosave_active()) {
+        // the writer thread folds its journal into the save file
+        if (autosave_save()) {
+          render_region_message("Game saved.");
+        } else {
+          render_region_message("Failed to save the game!");
+        }
+      } else if (save_game(save_path)) {
+#ifdef AUTOSAVE
+        // the player chose this file, so it is kept up to date from now on,
+        // unless a session log is being written or read
+        if (!replay_active() && !record_active()) {
+          autosave_start(save_path);
+        }
+#endif
+        render_region_message("Game saved.");
+      } else {
+        render_region_message("Failed to save the game!");
+      }
     } else if (CTRL_QUIT_GAME) {
       quit_game();
     }
@@ -1610,23 +1711,36 @@ void process_input_nav() {
 }
 
 void exit_w_message(const char* message) {
-  clear();
-  mvprintw(0,0, message);
-  mvprintw(2,0,"Press any key to exit.");
-  refresh();
+  display->clear();
+  display->mvprintw(0,0, message);
+  display->mvprintw(2,0,"Press any key to exit.");
+  display->refresh();
   int32_t key = 0;
   while (!key)  {
-    key = getch();
+    key = input_getch();
   }
-  endwin();
+  // the autosave writer and the workers are joined before their statics go,
+  // and the last checkpoint still reaches the save file
+  autosave_stop();
+  pool_stop();
+  close_terminal();
   exit(-1);
 }
 
+/*
+ * Sleeps for animations and frame pacing. Replays run at full speed.
+ */
+void frame_sleep(int32_t usec) {
+  if (!replay_active()) {
+    usleep(usec);
+  }
+}
+
 void getch_next() {
   int32_t key;
-  flushinp();
+  input_flush();
   while (true) {
-    key = getch();
+    key = input_getch();
     if (CTRL_SELECT) {
       return;
     } else if (CTRL_BACK) {
@@ -1638,7 +1752,11 @@ void getch_next() {
 }
 
 void quit_game() {
-  endwin();
+  autosave_stop();
+  pool_stop();
+  world_close();
+  replay_end();
+  close_terminal();
   heap_delete(&move_queue);
   free_all_regions();
   exit(1);
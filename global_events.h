@@ -6,13 +6,17 @@
 #include "region.h"
 #include "trainer_events.h"
 #include "pokemon.h"
+#include "render.h"
 
 void pc_next_region(int32_t to_rx,   int32_t to_ry, 
                     int32_t from_rx, int32_t from_ry);
+Region* generate_region(int32_t region_x, int32_t region_y, int32_t num_tnr);
 void load_region(int32_t region_x, int32_t region_y, int32_t num_tnr);
 void free_all_regions();
-void init_terminal();
+void init_terminal(render_mode_t mode);
+void close_terminal();
 void render_region(Region *r);
+void render_region_message(const char* m);
 void render_battle_message(const char* m);
 void render_battle_message_getch(const char* m);
 void render_battle(Pokemon *p_pc, Pokemon *p_opp,
@@ -52,6 +56,7 @@ void process_input_pick_starter(int32_t *scroller_pos,
                                 int32_t *selected_pokemon);
 void process_input_nav();
 void exit_w_message(const char* message);
+void frame_sleep(int32_t usec);
 void getch_next();
 void quit_game();
 
@@ -0,0 +1,183 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ncurses.h>
+#include <poll.h>
+#include <thread>
+#include <unistd.h>
+
+#include "config.h"
+#include "input.h"
+#include "replay.h"
+#include "render.h"
+
+// how long the input thread waits for a key before checking if it should stop
+#define INPUT_POLL_MS 50
+
+static KeyRing key_ring;
+static WINDOW *input_win = NULL;
+static std::thread input_thread;
+static std::mutex input_wake_mutex;
+static std::condition_variable input_wake;
+static std::atomic<bool> input_running(false);
+
+/*******************************************************************************
+* Key Ring
+*******************************************************************************/
+KeyRing::KeyRing() {
+  head.store(0);
+  tail.store(0);
+}
+
+/*
+ * Appends a key, returns false and drops the key if the ring is full
+ */
+bool KeyRing::push(int32_t key) {
+  uint32_t h = head.load(std::memory_order_relaxed);
+  if (h - tail.load(std::memory_order_acquire) >= INPUT_QUEUE_SIZE) {
+    return false;
+  }
+  keys[h % INPUT_QUEUE_SIZE] = key;
+  head.store(h + 1, std::memory_order_release);
+  return true;
+}
+
+/*
+ * Removes the oldest key, returns false if the ring is empty
+ */
+bool KeyRing::pop(int32_t *key) {
+  uint32_t t = tail.load(std::memory_order_relaxed);
+  if (t == head.load(std::memory_order_acquire)) {
+    return false;
+  }
+  *key = keys[t % INPUT_QUEUE_SIZE];
+  tail.store(t + 1, std::memory_order_release);
+  return true;
+}
+
+uint32_t KeyRing::size() {
+  return head.load(std::memory_order_acquire) 
+         - tail.load(std::memory_order_relaxed);
+}
+
+/*
+ * Discards up to n of the oldest keys. Consumer side only.
+ */
+void KeyRing::drop(uint32_t n) {
+  uint32_t s = size();
+  if (n > s) {
+    n = s;
+  }
+  tail.store(tail.load(std::memory_order_relaxed) + n, 
+             std::memory_order_release);
+}
+
+/*******************************************************************************
+* Input Thread
+*******************************************************************************/
+/*
+ * Waits for stdin outside of ncurses, then takes the keys under curses_mutex 
+ * without blocking, so drawing never waits on the player
+ */
+static void input_thread_main() {
+  int32_t key;
+  struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+
+  while (input_running.load()) {
+    if (poll(&pfd, 1, INPUT_POLL_MS) <= 0) {
+      continue;
+    }
+    while (true) {
+      {
+        std::lock_guard<std::mutex> lock(curses_mutex);
+        key = wgetch(input_win);
+      }
+      if (key == ERR) {
+        break;
+      }
+      // keys typed while the queue is full are lost, same as a full tty buffer
+      if (key_ring.push(key)) {
+        std::lock_guard<std::mutex> lock(input_wake_mutex);
+        input_wake.notify_one();
+      }
+    }
+  }
+}
+
+/*
+ * Starts reading keys on a dedicated thread. Must be called after initscr.
+ *
+ * Keys are read from a 1x1 window that is refreshed once here and never drawn
+ * to, so reading input never repaints the screen under the render thread.
+ */
+void input_start() {
+  input_win = newwin(1, 1, 0, 0);
+  keypad(input_win, TRUE);
+  nodelay(input_win, TRUE);
+  wrefresh(input_win);
+
+  input_running.store(true);
+  input_thread = std::thread(input_thread_main);
+}
+
+/*
+ * Stops the input thread. Safe to call when it was never started.
+ */
+void input_stop() {
+  if (!input_running.load()) {
+    return;
+  }
+  input_running.store(false);
+  input_thread.join();
+  delwin(input_win);
+  input_win = NULL;
+}
+
+/*
+ * Returns the next key, waiting for one if none is queued. Keys come from the 
+ * session log instead when replaying, and are logged when recording.
+ * Returns ERR right away if there is no input thread (headless).
+ */
+int32_t input_getch() {
+  int32_t key;
+
+  if (replay_active()) {
+    return replay_next_key();
+  }
+  if (!input_running.load()) {
+    return ERR;
+  }
+  while (!key_ring.pop(&key)) {
+    std::unique_lock<std::mutex> lock(input_wake_mutex);
+    input_wake.wait_for(lock, std::chrono::milliseconds(INPUT_POLL_MS),
+                        [] { return key_ring.size() > 0; });
+  }
+  record_key(key);
+  return key;
+}
+
+/*
+ * Returns the number of keys typed ahead that have not been consumed yet
+ */
+uint32_t input_pending() {
+  return key_ring.size();
+}
+
+/*
+ * Discards all keys typed ahead, replaces flushinp()
+ */
+void input_flush() {
+  key_ring.drop(INPUT_QUEUE_SIZE);
+}
+
+/*
+ * Discards the oldest keys until at most max_pending remain
+ */
+void input_trim(uint32_t max_pending) {
+  uint32_t pending = key_ring.size();
+  if (pending > max_pending) {
+    key_ring.drop(pending - max_pending);
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "config.h"
+
+/*
+ * Lock-free single-producer single-consumer ring of keystrokes
+ *
+ * The input thread is the only producer and the game loop the only consumer.
+ * head is only written by the producer and tail only by the consumer.
+ */
+class KeyRing {
+  int32_t keys[INPUT_QUEUE_SIZE];
+  std::atomic<uint32_t> head, tail;
+
+  public:
+    KeyRing();
+
+    bool push(int32_t key);
+    bool pop(int32_t *key);
+    uint32_t size();
+    void drop(uint32_t n);
+};
+
+void input_start();
+void input_stop();
+int32_t input_getch();
+uint32_t input_pending();
+void input_flush();
+void input_trim(uint32_t max_pending);
+
+#endif
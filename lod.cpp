@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <vector>
+
+#include "config.h"
+#include "character.h"
+#include "region.h"
+#include "pathfinding.h"
+#include "trainer_events.h"
+#include "rng.h"
+#include "pool.h"
+#include "lod.h"
+
+extern Region *region_ptr[WORLD_SIZE][WORLD_SIZE];
+extern Pc *pc;
+extern uint64_t world_tick;
+extern uint64_t world_seed;
+
+// World tick each region was last simulated up to, plus one so 0 is never
+static uint64_t lod_tick_at[WORLD_SIZE][WORLD_SIZE];
+static uint64_t lod_next_step = 0;
+
+typedef struct lod_job {
+  int32_t x, y;
+  // ticks for the chasers and for everyone else, 0 to leave them be
+  int32_t chase;
+  uint64_t elapsed;
+  std::vector<crossing_t> crossings;
+} lod_job_t;
+
+/*
+ * Trainers the coarse step moves. Hikers and rivals only chase the player and
+ * are moved by step_pursuers.
+ */
+static bool lod_moves(TrainerTable *t, int32_t k) {
+  return (t->tnr[k] == tnr_pacer || t->tnr[k] == tnr_wanderer 
+       || t->tnr[k] == tnr_rand_walker) 
+      && !(t->flags[k] & TNR_FLAG_DEFEATED);
+}
+
+/*
+ * Same as is_valid_location, for a region the player is not in
+ */
+static bool lod_valid(Region *r, TrainerTable *t, int32_t i, int32_t j, 
+                      trainer_t tnr) {
+  return i > 0 && i < MAX_ROW - 1 && j > 0 && j < MAX_COL - 1
+      && turn_times[r->get_ter(i, j)][tnr] != INT_MAX
+      && t->find(i, j) == -1;
+}
+
+/*
+ * One turn of row k, by the same rules as process_movement_turn except that
+ * there is no player to run into
+ */
+static void lod_move(Region *r, TrainerTable *t, int32_t k) {
+  int32_t i = t->pos_i[k];
+  int32_t j = t->pos_j[k];
+  int32_t to_i = i + dir_offsets[t->dir[k]][0];
+  int32_t to_j = j + dir_offsets[t->dir[k]][1];
+  bool valid = lod_valid(r, t, to_i, to_j, t->tnr[k]);
+
+  if (t->tnr[k] == tnr_wanderer && valid) {
+    valid = r->get_ter(to_i, to_j) == r->get_ter(i, j);
+  }
+  if (valid) {
+    t->pos_i[k] = to_i;
+    t->pos_j[k] = to_j;
+  } else if (t->tnr[k] == tnr_pacer) {
+    t->dir[k] = static_cast<direction_t>((t->dir[k] + 4) % 8);
+  } else {
+    t->dir[k] = static_cast<direction_t>(rng_rand() % 8);
+  }
+}
+
+/*
+ * Ticks it takes pacer k to walk to both ends of its line and back to where it
+ * is now, every tile on the way is stood on once in each direction
+ */
+static uint64_t lod_pacer_period(Region *r, TrainerTable *t, int32_t k) {
+  uint64_t period = 0;
+  for (int32_t d = 0; d < 8; d += 4) {
+    int32_t di = dir_offsets[(t->dir[k] + d) % 8][0];
+    int32_t dj = dir_offsets[(t->dir[k] + d) % 8][1];
+    int32_t i = t->pos_i[k] + di;
+    int32_t j = t->pos_j[k] + dj;
+    while (lod_valid(r, t, i, j, t->tnr[k])) {
+      period += 2 * turn_times[r->get_ter(i, j)][t->tnr[k]];
+      i += di;
+      j += dj;
+    }
+  }
+  return period + 2 * turn_times[r->get_ter(t->pos_i[k], t->pos_j[k])]
+                                [t->tnr[k]];
+}
+
+/*
+ * Moves the trainers of a region on by elapsed ticks, all turns of one 
+ * trainer at once rather than in turn order.
+ *
+ * A region coming back into range after a long time is fast-forwarded: a 
+ * pacer ends up where it would be, it only has to walk what is left over 
+ * after whole trips along its line, and random walkers take at most 
+ * LOD_CATCHUP_MOVES steps since more of them would not leave them anywhere 
+ * more likely.
+ */
+static void lod_step_region(Region *r, uint64_t elapsed) {
+  TrainerTable *t = r->get_trainers();
+  bool catch_up = elapsed > 2 * LOD_STEP_TICKS;
+  for (int32_t k = 0; k < t->size(); ++k) {
+    if (!lod_moves(t, k)) {
+      continue;
+    }
+    int32_t turn = turn_times[r->get_ter(t->pos_i[k], t->pos_j[k])][t->tnr[k]];
+    uint64_t amount = elapsed;
+    if (catch_up && t->tnr[k] == tnr_pacer) {
+      amount %= lod_pacer_period(r, t, k);
+    } else if (catch_up) {
+      amount = std::min<uint64_t>(amount, (uint64_t) LOD_CATCHUP_MOVES * turn);
+    }
+
+    t->movetime[k] -= amount;
+    while (t->movetime[k] <= 0) {
+      t->movetime[k] += 
+        turn_times[r->get_ter(t->pos_i[k], t->pos_j[k])][t->tnr[k]];
+      lod_move(r, t, k);
+    }
+  }
+}
+
+/*
+ * Advances region k of the jobs in arg, on a worker thread. Regions only 
+ * change themselves, anything that reaches into another region is left in 
+ * the job for the main thread.
+ */
+static void lod_job(int32_t k, void *arg) {
+  lod_job_t *job = &(*(std::vector<lod_job_t>*) arg)[k];
+  Region *r = region_ptr[job->x][job->y];
+  // the same moves no matter which thread steps the region, for replays
+  rng_seed_thread(rng_hash(world_seed ^ world_tick, 
+                           job->x * WORLD_SIZE + job->y));
+  if (job->chase) {
+    step_pursuers(r, job->chase, &job->crossings);
+  }
+  if (job->elapsed) {
+    lod_step_region(r, job->elapsed);
+  }
+}
+
+/*
+ * Keeps the loaded regions around the player's region moving, amount ticks 
+ * after the last frame.
+ *
+ * Every region is a job for the worker pool, and as no trainer ever reaches 
+ * into another region during its turn, regions are stepped in parallel. 
+ * Hikers and rivals within PURSUIT_RADIUS chase the player every frame. The 
+ * rest of the regions within LOD_RADIUS are only stepped every 
+ * LOD_STEP_TICKS, and regions further away are left frozen and catch up on 
+ * the time they missed once they come back into range. Trainers crossing 
+ * into another region are taken across afterwards, on this thread, in the 
+ * same order every time.
+ */
+void lod_tick(int32_t amount) {
+  int32_t pc_x = pc->get_x();
+  int32_t pc_y = pc->get_y();
+  int32_t radius = std::max(LOD_RADIUS, PURSUIT_RADIUS);
+  // the player's region is simulated in full by the move queue
+  lod_tick_at[pc_x][pc_y] = world_tick + 1;
+  if (pc->is_defeated()) {
+    return;
+  }
+  bool step = world_tick >= lod_next_step;
+  if (step) {
+    lod_next_step = world_tick + LOD_STEP_TICKS;
+  }
+  const std::vector<int32_t> &chased = get_pursuit_regions();
+
+  std::vector<lod_job_t> jobs;
+  for (int32_t x = pc_x - radius; x <= pc_x + radius; ++x) {
+    for (int32_t y = pc_y - radius; y <= pc_y + radius; ++y) {
+      if (x < 0 || y < 0 || x >= WORLD_SIZE || y >= WORLD_SIZE
+          || m_dist(x, y, pc_x, pc_y) > radius
+          || region_ptr[x][y] == NULL || (x == pc_x && y == pc_y)) {
+        continue;
+      }
+      lod_job_t job = {x, y, 0, 0, {}};
+      if (std::find(chased.begin(), chased.end(), x * WORLD_SIZE + y) 
+          != chased.end()) {
+        job.chase = amount;
+      }
+      if (step && m_dist(x, y, pc_x, pc_y) <= LOD_RADIUS) {
+        // a region seen for the first time has nothing to catch up on
+        uint64_t last = lod_tick_at[x][y] ? lod_tick_at[x][y] - 1 : world_tick;
+        lod_tick_at[x][y] = world_tick + 1;
+        job.elapsed = world_tick - last;
+      }
+      if (job.chase || job.elapsed) {
+        jobs.push_back(job);
+      }
+    }
+  }
+
+  pool_run(jobs.size(), lod_job, &jobs);
+
+  bool crossed = false;
+  for (size_t k = 0; k < jobs.size(); ++k) {
+    crossed |= cross_regions(jobs[k].x, jobs[k].y, &jobs[k].crossings);
+    region_ptr[jobs[k].x][jobs[k].y]->mark_dirty();
+  }
+  // chasers now in other regions need maps of their own
+  if (crossed) {
+    recalculate_pursuit_maps(pc_x, pc_y);
+  }
+}
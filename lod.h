@@ -0,0 +1,8 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <cstdint>
+
+void lod_tick(int32_t amount);
+
+#endif
@@ -15,6 +15,15 @@
 #include "pathfinding.h"
 #include "global_events.h"
 #include "trainer_events.h"
+#include "render.h"
+#include "input.h"
+#include "replay.h"
+#include "simulate.h"
+#include "save.h"
+#include "autosave.h"
+#include "world.h"
+#include "pregen.h"
+#include "lod.h"
 
 // Global variables
 // 2D array of pointers, each pointer points to one of the regions the world
@@ -22,10 +31,24 @@ Region *region_ptr[WORLD_SIZE][WORLD_SIZE] = {NULL};
 Pc *pc;
 int32_t dist_map_hiker[MAX_ROW][MAX_COL];
 int32_t dist_map_rival[MAX_ROW][MAX_COL];
+// Direction hikers and rivals step in from each tile, built with the maps above
+uint8_t flow_map_hiker[MAX_ROW][MAX_COL];
+uint8_t flow_map_rival[MAX_ROW][MAX_COL];
 heap_t move_queue;
+// Ticks simulated since the start of the game
+uint64_t world_tick = 0;
+// Seed the exits on the borders between regions are derived from
+uint64_t world_seed = 0;
+// Where CTRL_SAVE_GAME writes the game to
+const char *save_path = SAVE_FILE;
 
 void usage(const char *argv0) {
-  std::cout << "Usage: " << argv0 << " [--numtrainers|--seed] <int>" 
+  std::cout << "Usage: " << argv0 << " [--numtrainers <int>] [--seed <int>]"
+            << " [--render ncurses|ansi]" << " [--record <file>]"
+            << " [--replay <file>]" << " [--simulate <battles>]"
+            << " [--sim-player <dist>]" << " [--sim-trainer <dist>]" 
+            << " [--load <file>]" << " [--world <file>]" 
+            << " [--bench-compress <regions>]" << " [--pregen <radius>]" 
             << std::endl;
   exit(-1);
 }
@@ -38,6 +61,16 @@ int main (int argc, char *argv[])
   int32_t loaded_region_y = WORLD_SIZE/2;
   int32_t prev_pc_pos_i = -1;
   int32_t prev_pc_pos_j = -1;
+  render_mode_t render_mode = render_ncurses;
+  const char *record_path = NULL;
+  const char *replay_path = NULL;
+  int64_t simulate_battles_opt = 0;
+  int32_t sim_player_dist = 100;
+  int32_t sim_trainer_dist = 100;
+  const char *load_path = NULL;
+  const char *world_path = NULL;
+  int32_t bench_compress_opt = 0;
+  int32_t pregen_radius_opt = -1;
 
 /*//////////////////////////////////////////////////////////////////////////////
   if (argc == 2) {
@@ -78,47 +111,160 @@ int main (int argc, char *argv[])
   gettimeofday(&t, NULL);
   seed = (t.tv_usec ^ (t.tv_sec << 20)) & 0xffffffff;
 
-  // handle command line inputs
-  if (argc != 1 && argc != 3) {
+  // handle command line inputs, every switch takes exactly one value
+  if (argc % 2 != 1) {
     usage(argv[0]);
   }
-  if (argc == 3) {
-    if (!strcmp(argv[1], "--numtrainers")) {
-      numtrainers_opt = atoi(argv[2]);
-    } else if (!strcmp(argv[1], "--seed")) {
-      seed = atoi(argv[2]);
+  for (int32_t a = 1; a < argc; a += 2) {
+    if (!strcmp(argv[a], "--numtrainers")) {
+      numtrainers_opt = atoi(argv[a + 1]);
+    } else if (!strcmp(argv[a], "--seed")) {
+      seed = atoi(argv[a + 1]);
+    } else if (!strcmp(argv[a], "--render")) {
+      if (!strcmp(argv[a + 1], "ncurses")) {
+        render_mode = render_ncurses;
+      } else if (!strcmp(argv[a + 1], "ansi")) {
+        render_mode = render_ansi;
+      } else {
+        usage(argv[0]);
+      }
+    } else if (!strcmp(argv[a], "--record")) {
+      record_path = argv[a + 1];
+    } else if (!strcmp(argv[a], "--replay")) {
+      replay_path = argv[a + 1];
+    } else if (!strcmp(argv[a], "--simulate")) {
+      simulate_battles_opt = atoll(argv[a + 1]);
+    } else if (!strcmp(argv[a], "--sim-player")) {
+      sim_player_dist = atoi(argv[a + 1]);
+    } else if (!strcmp(argv[a], "--sim-trainer")) {
+      sim_trainer_dist = atoi(argv[a + 1]);
+    } else if (!strcmp(argv[a], "--load")) {
+      load_path = argv[a + 1];
+      save_path = load_path;
+    } else if (!strcmp(argv[a], "--world")) {
+      world_path = argv[a + 1];
+    } else if (!strcmp(argv[a], "--bench-compress")) {
+      bench_compress_opt = atoi(argv[a + 1]);
+    } else if (!strcmp(argv[a], "--pregen")) {
+      pregen_radius_opt = atoi(argv[a + 1]);
     } else {
       usage(argv[0]);
-      return -1;
     }
   }
+  if ((load_path && world_path) || (pregen_radius_opt >= 0 && !world_path)) {
+    usage(argv[0]);
+  }
+  // a session log only holds the seed and trainers of a new game, and a save
+  // or world file would be written over while recording anyway
+  if ((record_path || replay_path) && (load_path || world_path)) {
+    std::cout << "Error: --record and --replay only work with a new game, "
+              << "not with --load or --world." << std::endl;
+    return -1;
+  }
+  if (replay_path) {
+    // the session log decides the seed and trainers, and nothing is shown
+    replay_start(replay_path, &seed, &numtrainers_opt);
+    render_mode = render_headless;
+  }
+  if (record_path) {
+    record_start(record_path, seed, numtrainers_opt);
+  }
   srand(seed);
+  // a loaded game or world file brings the seed it was generated with
+  world_seed = seed;
   std::cout << "Using seed: " << seed << std::endl;
 
   std::cout << "Parsing Pokedex database..."  << std::endl;
   init_pd();
+  init_species_cache();
+
+  if (simulate_battles_opt > 0) {
+    simulate_driver(simulate_battles_opt, sim_player_dist, sim_trainer_dist, 
+                    seed);
+    return 0;
+  }
+  if (bench_compress_opt > 0) {
+    bench_compress(bench_compress_opt, numtrainers_opt);
+    return 0;
+  }
+
+  if (load_path) {
+    std::cout << "Loading " << load_path << "..." << std::endl;
+    if (!load_game(load_path) || !autosave_recover(load_path)) {
+      std::cout << "Error: " << load_path << " is not a valid save file." 
+                << std::endl;
+      return -1;
+    }
+    loaded_region_x = pc->get_x();
+    loaded_region_y = pc->get_y();
+  }
+  if (world_path) {
+    if (!world_open(world_path)) {
+      std::cout << "Error: " << world_path << " is not a valid world file." 
+                << std::endl;
+      return -1;
+    }
+    if (pregen_radius_opt >= 0) {
+      std::cout << "Generating regions into " << world_path << "..." 
+                << std::endl;
+      pregen_driver(pregen_radius_opt, numtrainers_opt, seed);
+      world_close();
+      free_all_regions();
+      return 0;
+    }
+    if (world_has_player()) {
+      std::cout << "Loading " << world_path << "..." << std::endl;
+      if (!world_load_player()) {
+        std::cout << "Error: " << world_path << " is damaged." << std::endl;
+        return -1;
+      }
+      loaded_region_x = pc->get_x();
+      loaded_region_y = pc->get_y();
+    }
+  }
 
   std::cout << "Initializing terminal..." << std::endl;
-  init_terminal();
-
-  // Allocate memory for and generate the starting region
-  Region *new_region = new Region(-1, -1, -1, -1, 1, 1);
-  region_ptr[WORLD_SIZE/2][WORLD_SIZE/2] = new_region;
-  // Pc initialization depends on first region existing
-  pc = new Pc(WORLD_SIZE/2, WORLD_SIZE/2);
-  // Region population depends on player existing 
-  // (Trainer difficulty is calculated by which region the pc is in)
-  new_region->populate(numtrainers_opt);
-
-  pc->pick_starter_driver();
+  init_terminal(render_mode);
+
+  if (pc == NULL) {
+    // A pregenerated world file already has the starting region
+    Region *new_region = world_load_region(WORLD_SIZE/2, WORLD_SIZE/2);
+    bool pregenerated = new_region != NULL;
+    if (!pregenerated) {
+      // Allocate memory for and generate the starting region
+      int32_t exits[4];
+      border_exits(WORLD_SIZE/2, WORLD_SIZE/2, exits);
+      new_region = new Region(exits[0], exits[1], exits[2], exits[3], 1, 1);
+    }
+    region_ptr[WORLD_SIZE/2][WORLD_SIZE/2] = new_region;
+    // Pc initialization depends on first region existing
+    pc = new Pc(WORLD_SIZE/2, WORLD_SIZE/2);
+    // Region population depends on player existing 
+    // (Trainer difficulty is calculated by which region the pc is in)
+    if (!pregenerated) {
+      new_region->populate(numtrainers_opt, WORLD_SIZE/2, WORLD_SIZE/2);
+    }
+
+    pc->pick_starter_driver();
+    world_touch(WORLD_SIZE/2, WORLD_SIZE/2);
+  }
+#ifdef AUTOSAVE
+  // Only a save the player chose is kept up to date, a new game never 
+  // replaces one before 'S' is pressed. A world file does this by itself.
+  if (load_path && !replay_active()) {
+    autosave_start(save_path);
+  }
+#endif
+  Region *new_region = region_ptr[loaded_region_x][loaded_region_y];
   
   Character *c;
   init_trainer_pq(&move_queue, region_ptr[pc->get_x()][pc->get_y()]);
   recalculate_dist_maps(region_ptr[pc->get_x()][pc->get_y()], 
                         pc->get_i(), pc->get_j());
+  recalculate_pursuit_maps(pc->get_x(), pc->get_y());
 
   render_region(new_region);
-  usleep(FRAMETIME);
+  frame_sleep(FRAMETIME);
   gettimeofday(&time_last_frame, NULL);
 
   // Run game
@@ -135,6 +281,7 @@ int main (int argc, char *argv[])
     if (pc->get_i() != prev_pc_pos_i || pc->get_j() != prev_pc_pos_j) {
       recalculate_dist_maps(region_ptr[pc->get_x()][pc->get_y()], 
                             pc->get_i(), pc->get_j());
+      recalculate_pursuit_maps(pc->get_x(), pc->get_y());
       prev_pc_pos_i = pc->get_i();
       prev_pc_pos_j = pc->get_j();
     }
@@ -159,7 +306,16 @@ int main (int argc, char *argv[])
       }
       step_all_movetimes(region_ptr[loaded_region_x][loaded_region_y], step);
       ticks_since_last_frame += step;
+      world_tick += step;
     }
+    // hikers and rivals next door close in on the player, everyone else 
+    // nearby keeps moving at a coarse step
+    if (pc->get_x() == loaded_region_x && pc->get_y() == loaded_region_y) {
+      lod_tick(ticks_since_last_frame);
+    }
+    region_ptr[loaded_region_x][loaded_region_y]->mark_dirty();
+    autosave_tick();
+    world_autosave_tick();
     
     // Render game and modulate frame rate
     ////////////////////////////////////////////////////////////////////////////
@@ -170,9 +326,12 @@ int main (int argc, char *argv[])
     int32_t sleep_time = FRAMETIME - timediff;
     if (sleep_time < 0)
       sleep_time = 0;
+    // don't hold back keys the player has already typed ahead
+    if (input_pending())
+      sleep_time = 0;
     // mvprintw(0,0,"FPS: %f", (1000000.0/((float)sleep_time)));
     // refresh();
-    usleep(sleep_time);
+    frame_sleep(sleep_time);
     gettimeofday(&time_last_frame, NULL);
     ////////////////////////////////////////////////////////////////////////////
   }
@@ -1,6 +1,7 @@
 #include <cstdint>
 #include <cstdio>
 #include <climits>
+#include <vector>
 
 #include "character.h"
 #include "config.h"
@@ -8,8 +9,14 @@
 #include "region.h"
 #include "pathfinding.h"
 
+extern Region *region_ptr[WORLD_SIZE][WORLD_SIZE];
 extern int32_t dist_map_hiker[MAX_ROW][MAX_COL];
 extern int32_t dist_map_rival[MAX_ROW][MAX_COL];
+extern uint8_t flow_map_hiker[MAX_ROW][MAX_COL];
+extern uint8_t flow_map_rival[MAX_ROW][MAX_COL];
+
+// Regions whose chasers pursue the player from outside its region
+static std::vector<int32_t> pursuit_regions;
 
 typedef struct path {
   heap_node_t *hn;
@@ -23,12 +30,17 @@ static int32_t path_cmp(const void *key, const void *with) {
 }
 
 /*
- * Uses dijkstra's algorithm to find an optimal path to a specified location
+ * Uses dijkstra's algorithm to find an optimal path to a specified location,
+ * or to the nearest of several locations that each start at a cost of their 
+ * own.
  *
- * Returns distance in number of steps between the points.
+ * Fills out with the cost of the route from every tile.
  * INT_MAX for no valid route.
  */
-static void dijkstra(Region *r, trainer_t tnr, int32_t pc_i, int32_t pc_j) {
+static void dijkstra(Region *r, trainer_t tnr, int32_t num_src, 
+                     const int32_t *src_i, const int32_t *src_j, 
+                     const int32_t *src_cost, 
+                     int32_t out[MAX_ROW][MAX_COL]) {
 
   static path_t path[MAX_ROW][MAX_COL], *p;
   static uint32_t initialized = 0;
@@ -54,7 +66,9 @@ static void dijkstra(Region *r, trainer_t tnr, int32_t pc_i, int32_t pc_j) {
     }
   }
 
-  path[pc_i][pc_j].cost = 0;
+  for (int32_t k = 0; k < num_src; ++k) {
+    path[src_i[k]][src_j[k]].cost = src_cost[k];
+  }
 
   heap_init(&h, path_cmp, NULL);
 
@@ -145,17 +159,9 @@ static void dijkstra(Region *r, trainer_t tnr, int32_t pc_i, int32_t pc_j) {
     }
   }
 
-  if (tnr == tnr_hiker) {
-    for (int32_t i = 0; i < MAX_ROW; i++) {
-      for (int32_t j = 0; j < MAX_COL; j++) {
-        dist_map_hiker[i][j] = path[i][j].cost;
-      }
-    }
-  } else if (tnr == tnr_rival) {
-    for (int32_t i = 0; i < MAX_ROW; i++) {
-      for (int32_t j = 0; j < MAX_COL; j++) {
-        dist_map_rival[i][j] = path[i][j].cost;
-      }
+  for (int32_t i = 0; i < MAX_ROW; i++) {
+    for (int32_t j = 0; j < MAX_COL; j++) {
+      out[i][j] = path[i][j].cost;
     }
   }
 
@@ -176,7 +182,246 @@ void print_dist_map(int32_t dist_map[][MAX_COL]) {
   }
 }
 
+/*
+ * Fills flow with the direction of the closest neighbour of every tile on 
+ * dist, as move_along_gradient would pick it with no one in the way. 
+ * FLOW_NONE where no neighbour has a route.
+ */
+static void flow_field(int32_t dist[MAX_ROW][MAX_COL], 
+                       uint8_t flow[MAX_ROW][MAX_COL]) {
+  for (int32_t i = 0; i < MAX_ROW; ++i) {
+    for (int32_t j = 0; j < MAX_COL; ++j) {
+      flow[i][j] = FLOW_NONE;
+      if (i == 0 || j == 0 || i == MAX_ROW - 1 || j == MAX_COL - 1) {
+        continue;
+      }
+      int32_t best = INT_MAX;
+      for (int32_t k = 0; k < 8; ++k) {
+        int32_t d = dist[i + dir_offsets[gradient_order[k]][0]]
+                        [j + dir_offsets[gradient_order[k]][1]];
+        if (d < best) {
+          best = d;
+          flow[i][j] = gradient_order[k];
+        }
+      }
+    }
+  }
+}
+
+/*
+ * Rebuilds the distance and flow maps of hikers and rivals towards the player
+ */
 void recalculate_dist_maps(Region *r, int32_t pc_i, int32_t pc_j) {
-  dijkstra(r, tnr_hiker, pc_i, pc_j);
-  dijkstra(r, tnr_rival, pc_i, pc_j);
+  int32_t zero = 0;
+  dijkstra(r, tnr_hiker, 1, &pc_i, &pc_j, &zero, dist_map_hiker);
+  dijkstra(r, tnr_rival, 1, &pc_i, &pc_j, &zero, dist_map_rival);
+  flow_field(dist_map_hiker, flow_map_hiker);
+  flow_field(dist_map_rival, flow_map_rival);
+}
+
+/*
+ * Finds the tile just inside exit k (N, E, S, W) of a region. Returns false 
+ * if the exit was closed off at the edge of the world.
+ */
+bool exit_inner_tile(Region *r, int32_t k, int32_t *i, int32_t *j) {
+  int32_t ei, ej;
+  switch (k) {
+  case 0:
+    ei = 0;
+    ej = r->get_N_exit_j();
+    *i = 1;
+    *j = ej;
+    break;
+  case 1:
+    ei = r->get_E_exit_i();
+    ej = MAX_COL - 1;
+    *i = ei;
+    *j = MAX_COL - 2;
+    break;
+  case 2:
+    ei = MAX_ROW - 1;
+    ej = r->get_S_exit_j();
+    *i = MAX_ROW - 2;
+    *j = ej;
+    break;
+  default:
+    ei = r->get_W_exit_i();
+    ej = 0;
+    *i = ei;
+    *j = 1;
+    break;
+  }
+  return r->get_ter(ei, ej) == ter_path;
+}
+
+/*
+ * Region coordinates of the neighbour behind exit k (N, E, S, W)
+ */
+void exit_neighbor(int32_t x, int32_t y, int32_t k, int32_t *nx, int32_t *ny) {
+  static const int32_t offsets[4][2] = {{0, 1}, {1, 0}, {0, -1}, {-1, 0}};
+  *nx = x + offsets[k][0];
+  *ny = y + offsets[k][1];
+}
+
+/*
+ * Costs between every pair of exits of a region, for both chasers. Terrain 
+ * never changes once a region is generated, so they are worked out once.
+ */
+static pursuit_t* exit_costs(Region *r) {
+  static const trainer_t chasers[2] = {tnr_hiker, tnr_rival};
+  static int32_t map[MAX_ROW][MAX_COL];
+  pursuit_t *p = r->get_pursuit();
+  if (p->exit_cost_valid) {
+    return p;
+  }
+  int32_t ti[4], tj[4];
+  bool open[4];
+  for (int32_t k = 0; k < 4; ++k) {
+    open[k] = exit_inner_tile(r, k, &ti[k], &tj[k]);
+  }
+  int32_t zero = 0;
+  for (int32_t c = 0; c < 2; ++c) {
+    for (int32_t to = 0; to < 4; ++to) {
+      if (open[to]) {
+        dijkstra(r, chasers[c], 1, &ti[to], &tj[to], &zero, map);
+      }
+      for (int32_t from = 0; from < 4; ++from) {
+        p->exit_cost[c][to][from] = (open[to] && open[from]) 
+                                    ? map[ti[from]][tj[from]] : INT_MAX;
+      }
+    }
+  }
+  p->exit_cost_valid = true;
+  return p;
+}
+
+/*
+ * True if the region has a hiker (c = 0) or rival (c = 1) that could chase
+ */
+static bool has_chaser(Region *r, int32_t c) {
+  trainer_t t = c ? tnr_rival : tnr_hiker;
+  for (auto it = r->get_npcs()->begin(); it != r->get_npcs()->end(); ++it) {
+    if ((*it)->get_tnr() == t && !(*it)->is_defeated()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Hierarchical pathfinding towards the player across regions
+ *
+ * The loaded regions within PURSUIT_RADIUS of the player's region form a 
+ * small graph with a node for each exit. Its edges are the precomputed costs
+ * between the exits of a region and the cost of stepping through a border. A
+ * search over it, started from the player's distance map, gives every exit 
+ * its cost to the player. Only then do regions with chasers in them get a 
+ * tile level distance map, started from the exits whose cheapest way leads 
+ * through the border, the only ones chasers cross at. The work grows with the 
+ * number of regions involved, never with the size of the world.
+ */
+void recalculate_pursuit_maps(int32_t pc_x, int32_t pc_y) {
+  static const trainer_t chasers[2] = {tnr_hiker, tnr_rival};
+  int32_t (*pc_maps[2])[MAX_COL] = {dist_map_hiker, dist_map_rival};
+
+  pursuit_regions.clear();
+  std::vector<Region*> regs;
+  int32_t pc_s = -1;
+  for (int32_t x = pc_x - PURSUIT_RADIUS; x <= pc_x + PURSUIT_RADIUS; ++x) {
+    for (int32_t y = pc_y - PURSUIT_RADIUS; y <= pc_y + PURSUIT_RADIUS; ++y) {
+      if (x < 0 || y < 0 || x >= WORLD_SIZE || y >= WORLD_SIZE
+          || m_dist(x, y, pc_x, pc_y) > PURSUIT_RADIUS 
+          || region_ptr[x][y] == NULL) {
+        continue;
+      }
+      if (x == pc_x && y == pc_y) {
+        pc_s = regs.size();
+      }
+      pursuit_regions.push_back(x * WORLD_SIZE + y);
+      regs.push_back(region_ptr[x][y]);
+    }
+  }
+  int32_t n = regs.size() * 4;
+  std::vector<int32_t> cost(n);
+  std::vector<bool> done(n);
+  // the cheapest way to the player leaves through this exit into the
+  // neighbouring region, rather than back across its own region
+  std::vector<bool> leaves(n);
+
+  for (int32_t c = 0; c < 2; ++c) {
+    int32_t cross = 2 * turn_times[ter_path][chasers[c]];
+    for (int32_t v = 0; v < n; ++v) {
+      int32_t i, j;
+      cost[v] = INT_MAX;
+      done[v] = false;
+      leaves[v] = false;
+      if (v / 4 == pc_s && exit_inner_tile(regs[pc_s], v % 4, &i, &j)) {
+        cost[v] = pc_maps[c][i][j];
+      }
+    }
+
+    // few enough nodes that picking the closest by scanning beats a heap
+    while (true) {
+      int32_t v = -1;
+      for (int32_t u = 0; u < n; ++u) {
+        if (!done[u] && cost[u] != INT_MAX && (v < 0 || cost[u] < cost[v])) {
+          v = u;
+        }
+      }
+      if (v < 0) {
+        break;
+      }
+      done[v] = true;
+      int32_t s = v / 4, k = v % 4;
+      int32_t key = pursuit_regions[s];
+
+      // through the border into the neighbour behind this exit
+      int32_t nx, ny, i, j;
+      exit_neighbor(key / WORLD_SIZE, key % WORLD_SIZE, k, &nx, &ny);
+      for (size_t t = 0; t < regs.size(); ++t) {
+        int32_t u = t * 4 + (k + 2) % 4;
+        if (pursuit_regions[t] == nx * WORLD_SIZE + ny 
+            && (int32_t) t != pc_s && !done[u]
+            && exit_inner_tile(regs[t], (k + 2) % 4, &i, &j)
+            && cost[v] + cross < cost[u]) {
+          cost[u] = cost[v] + cross;
+          leaves[u] = true;
+        }
+      }
+      // across this region to its other exits
+      if (s == pc_s) {
+        continue;
+      }
+      pursuit_t *p = exit_costs(regs[s]);
+      for (int32_t m = 0; m < 4; ++m) {
+        int32_t u = s * 4 + m;
+        if (!done[u] && p->exit_cost[c][k][m] != INT_MAX
+            && cost[v] + p->exit_cost[c][k][m] < cost[u]) {
+          cost[u] = cost[v] + p->exit_cost[c][k][m];
+          leaves[u] = false;
+        }
+      }
+    }
+
+    // tile level maps, only where there is someone to follow them
+    for (int32_t s = 0; s < (int32_t) regs.size(); ++s) {
+      if (s == pc_s || !has_chaser(regs[s], c)) {
+        continue;
+      }
+      pursuit_t *p = regs[s]->get_pursuit();
+      int32_t si[4], sj[4], sc[4], num_src = 0;
+      for (int32_t k = 0; k < 4; ++k) {
+        p->exit_dist[c][k] = leaves[s * 4 + k] ? cost[s * 4 + k] : INT_MAX;
+        if (p->exit_dist[c][k] != INT_MAX 
+            && exit_inner_tile(regs[s], k, &si[num_src], &sj[num_src])) {
+          sc[num_src++] = cost[s * 4 + k];
+        }
+      }
+      dijkstra(regs[s], chasers[c], num_src, si, sj, sc, p->dist[c]);
+    }
+  }
+}
+
+const std::vector<int32_t>& get_pursuit_regions() {
+  return pursuit_regions;
 }
\ No newline at end of file
@@ -2,11 +2,19 @@
 #define PATHFINDING_H
 
 #include <cstdint>
+#include <vector>
 
 #include "config.h"
 #include "region.h"
 
+// Flow map entry of a tile with no way towards the player
+#define FLOW_NONE 0xff
+
 void print_dist_map(int32_t dist_map[][MAX_COL]);
 void recalculate_dist_maps(Region *r, int32_t pc_i, int32_t pc_j);
+bool exit_inner_tile(Region *r, int32_t k, int32_t *i, int32_t *j);
+void exit_neighbor(int32_t x, int32_t y, int32_t k, int32_t *nx, int32_t *ny);
+void recalculate_pursuit_maps(int32_t pc_x, int32_t pc_y);
+const std::vector<int32_t>& get_pursuit_regions();
 
 #endif
\ No newline at end of file
@@ -3,58 +3,95 @@
 #include <vector>
 
 #include "pokemon.h"
+#include "rng.h"
+#include "save.h"
 #include "character.h"
 #include "region.h"
 #include "global_events.h"
 
 extern Pc *pc;
 
+// Per species data looked up once from the pokedex, indexed like pd_pokemon
+static species_cache_t species_cache[POKEDEX_POKEMON_ENTRIES];
+static std::vector<learnset_entry_t> species_learnset;
+// Species wild and trainer pokemon are drawn from, uniformly
+static int32_t species_pool[POKEDEX_POKEMON_ENTRIES];
+static int32_t species_pool_size = 0;
+
 /*
- * Helper method to look up and initialize a pokemon's type
+ * Builds the species cache so generating a pokemon never has to scan the 
+ * pokedex tables. Must be called after the pokedex is parsed.
  */
-void Pokemon::lookup_type() {
-  // initialize types to 0
-  type[0] = -1; // primary type
-  type[1] = -1; // secondary type
-  
-  // Lookup types
-  for (int32_t i = 0; i < POKEDEX_POKEMON_TYPES_ENTRIES; ++i) {
-    if (pd_pokemon_types[i].pokemon_id == pd_entry->id) {
-      // we assume that the pokemon_types.csv lists type slots in order for one 
-      // pokemon at a time.
-      type[0] = pd_pokemon_types[i].type_id;
-      if (pd_pokemon_types[i+1].pokemon_id == pd_entry->id) {
-        type[1] = pd_pokemon_types[i+1].type_id;
+void init_species_cache() {
+  species_learnset.clear();
+  species_pool_size = 0;
+
+  for (int32_t p = 0; p < POKEDEX_POKEMON_ENTRIES; ++p) {
+    species_cache_t *sc = &species_cache[p];
+    pd_pokemon_t *pd_entry = &pd_pokemon[p];
+
+    // we assume that the pokemon_types.csv lists type slots in order for one 
+    // pokemon at a time.
+    sc->type[0] = -1;
+    sc->type[1] = -1;
+    for (int32_t i = 0; i < POKEDEX_POKEMON_TYPES_ENTRIES; ++i) {
+      if (pd_pokemon_types[i].pokemon_id == pd_entry->id) {
+        sc->type[0] = pd_pokemon_types[i].type_id;
+        if (i + 1 < POKEDEX_POKEMON_TYPES_ENTRIES
+         && pd_pokemon_types[i+1].pokemon_id == pd_entry->id) {
+          sc->type[1] = pd_pokemon_types[i+1].type_id;
+        }
+        break;
+      }
+    }
+    sc->type_pair = type_pair_index(sc->type[0], sc->type[1]);
+
+    // we assume that the pokemon_stats.csv lists stat ids in order for one 
+    // pokemon at a time
+    for (int32_t s = 0; s < 6; s++) {
+      sc->base_stats[s] = 0;
+    }
+    for (int32_t i = 0; i < POKEDEX_POKEMON_STATS_ENTRIES; ++i) {
+      if (pd_pokemon_stats[i].pokemon_id == pd_entry->id) {
+        for (int32_t s = 0; s < 6; s++) {
+          sc->base_stats[s] = pd_pokemon_stats[i + s].base_stat;
+        }
+        break;
       }
-      break;
     }
+
+    // level up moves, in pokedex order
+    sc->learnset_start = species_learnset.size();
+    for (int32_t i = 0; i < POKEDEX_POKEMON_MOVES_ENTRIES; ++i) {
+      if (pd_entry->species_id == pd_pokemon_moves[i].pokemon_id) {
+        learnset_entry_t e;
+        e.level = pd_pokemon_moves[i].level;
+        e.move_id = pd_pokemon_moves[i].move_id;
+        e.move = NULL;
+        for (int32_t m = 0; m < POKEDEX_MOVES_ENTRIES; ++m) {
+          if (pd_moves[m].id == e.move_id) {
+            e.move = &pd_moves[m];
+            break;
+          }
+        }
+        species_learnset.push_back(e);
+      }
+    }
+    sc->learnset_end = species_learnset.size();
+
+    species_pool[species_pool_size++] = p;
   }
-  return;
 }
+
 /*
  * Helper method to generate a pokemon's level
  * Called when initializing a pokemon
  */
 void Pokemon::generate_level() {
+  int32_t min_level, max_level;
   int32_t dist = m_dist(WORLD_SIZE/2, WORLD_SIZE/2, pc->get_x(), pc->get_y());
-  int32_t min_level;
-  int32_t max_level;
-  if (dist <= 200) {
-    min_level = POKEMON_MIN_LEVEL;
-    max_level = dist / 2;
-    if (max_level > POKEMON_MAX_LEVEL)
-      max_level = POKEMON_MAX_LEVEL;
-    if (max_level < 1)
-      max_level = 1;
-  } else {
-    min_level = ((dist - 200) / 2);
-    max_level = POKEMON_MAX_LEVEL;
-    if (min_level > POKEMON_MAX_LEVEL)
-      min_level = POKEMON_MAX_LEVEL;
-    if (min_level < 1)
-      min_level = 1;
-  }
-  level = min_level + (rand() % (max_level - min_level + 1));
+  level_range(dist, &min_level, &max_level);
+  level = min_level + (rng_rand() % (max_level - min_level + 1));
   return;
 }
 /*
@@ -70,42 +107,34 @@ void Pokemon::populate_moveset() {
   num_moves = 0;
 
   // 2. Find levelup learnset
-  std::vector<int32_t> levelup_learnset;
-  for (int32_t i = 0; i < POKEDEX_POKEMON_MOVES_ENTRIES; ++i) {
-    if ((pd_entry->species_id == pd_pokemon_moves[i].pokemon_id)
-     && (level >= pd_pokemon_moves[i].level)) {
+  species_cache_t *sc = &species_cache[species];
+  std::vector<learnset_entry_t*> levelup_learnset;
+  for (int32_t i = sc->learnset_start; i < sc->learnset_end; ++i) {
+    if (level >= species_learnset[i].level) {
       // check if move is already in learnset
       bool is_dup = false;
       for (auto it  = levelup_learnset.begin(); 
                 it != levelup_learnset.end(); ++it) {
-        if (*it == pd_pokemon_moves[i].move_id) {
+        if ((*it)->move_id == species_learnset[i].move_id) {
           is_dup = true;
           break;
         }
       }
 
       if (!is_dup) {
-        levelup_learnset.push_back(pd_pokemon_moves[i].move_id);
+        levelup_learnset.push_back(&species_learnset[i]);
       }
     }
   }
 
   // 3. Randomly select and assign up to 4 moves
   while (levelup_learnset.size() > 0 && num_moves < 4) {
-    int32_t new_move_index = rand() % levelup_learnset.size();
-
-    bool move_found = false;
-    for (int32_t i = 0; i < POKEDEX_MOVES_ENTRIES; ++i) {
-      if (pd_moves[i].id == levelup_learnset[new_move_index]) {
-        learn_move(&pd_moves[i]);
-        levelup_learnset.erase(levelup_learnset.begin() + new_move_index);
-        move_found = true;
-        break;
-      }
-    }
-    if (!move_found) {
+    int32_t new_move_index = rng_rand() % levelup_learnset.size();
+    if (levelup_learnset[new_move_index]->move == NULL) {
       exit_w_message("Error: Move exists in learnset, but not in moves!");
     }
+    learn_move(levelup_learnset[new_move_index]->move);
+    levelup_learnset.erase(levelup_learnset.begin() + new_move_index);
   }
   return;
 }
@@ -114,26 +143,10 @@ void Pokemon::populate_moveset() {
  * Called when initializing a pokemon
  */
 void Pokemon::generate_ivs() {
+  for (int32_t i = 0; i < 3; ++i)
+    ivs[i] = 0;
   for (int32_t i = 0; i < 6; ++i)
-    ivs[i] = rand() % 16;
-  return;
-}
-/*
- * Helper method to lookup and update a pokemon's stats
- * Called when initializing a pokemon
- */
-void Pokemon::lookup_base_stats() {
-  // Lookup Base Stats
-  for (int32_t i = 0; i < POKEDEX_POKEMON_STATS_ENTRIES; ++i) {
-    if (pd_pokemon_stats[i].pokemon_id == pd_entry->id) {
-      // we assume that the pokemon_stats.csv lists stat ids in order for one 
-      // pokemon at a time
-      for (int32_t s = 0; s < 6; s++) {
-        base_stats[s] = pd_pokemon_stats[i + s].base_stat;
-      }
-      break;
-    }
-  }
+    ivs[i / 2] |= (rng_rand() % 16) << (4 * (i % 2));
   return;
 }
 /*
@@ -141,46 +154,133 @@ void Pokemon::lookup_base_stats() {
  * Called when initializing a pokemon and after level up
  */
 void Pokemon::calculate_stats() {
+  const int32_t *base_stats = species_cache[species].base_stats;
+  stat_id_t hp = stat_hp;
+
   // Calculate HP
-  stats[stat_hp] = ( ((base_stats[stat_hp] + ivs[stat_hp]) * 2 * level) / 100 ) 
+  stats[stat_hp] = ( ((base_stats[stat_hp] + get_iv(hp)) * 2 * level) / 100 ) 
                    + level + 10;
 
   // Calculate Other Stats
   for (int32_t s = 1; s < 6; s++) {
-    stats[s] = ( ((base_stats[s] + ivs[s]) * 2 * level) / 100 ) + 5;
+    stat_id_t id = static_cast<stat_id_t>(s);
+    stats[s] = ( ((base_stats[s] + get_iv(id)) * 2 * level) / 100 ) + 5;
   }
   return;
 }
 
+/*
+ * Helper method to pick a random species
+ * Called when initializing a pokemon
+ */
+void Pokemon::pick_species() {
+  species = species_pool[rng_rand() % species_pool_size];
+  strncpy(nickname, pd_pokemon[species].identifier, 12);
+  nickname[12] = '\0';
+}
+
 /*
  * Pokemon constructor
+ * Level is based on how far the player is from the center of the world
  */
 Pokemon::Pokemon() {
-  // pointer arithmetic to select a random pokemon in the pd_pokemon array
-  pd_entry = &pd_pokemon[rand() % POKEDEX_POKEMON_ENTRIES];
-  strncpy(nickname, pd_entry->identifier, 12);
-  pd_species_entry = &pd_pokemon_species[pd_entry->id - 1];
-
+  pick_species();
   generate_level();
+  generate();
+}
+
+/*
+ * Pokemon constructor for a given level, does not depend on the player
+ */
+Pokemon::Pokemon(int32_t level) {
+  pick_species();
+  if (level < POKEMON_MIN_LEVEL)
+    level = POKEMON_MIN_LEVEL;
+  if (level > POKEMON_MAX_LEVEL)
+    level = POKEMON_MAX_LEVEL;
+  this->level = level;
+  generate();
+}
+
+/*
+ * Pokemon constructor that restores a pokemon from a save file
+ */
+Pokemon::Pokemon(SaveReader *in) {
+  species = in->u16();
+  level = in->u8();
+  exp = in->u32();
+  num_moves = in->u8();
+  for (int32_t i = 0; i < 4; ++i) {
+    moveset[i] = 0;
+    current_pp[i] = 0;
+  }
+  for (int32_t i = 0; i < num_moves && i < 4; ++i) {
+    moveset[i] = in->u16();
+    current_pp[i] = in->u8();
+  }
+  current_hp = in->u16();
+  in->bytes(ivs, 3);
+  flags = in->u8();
+  in->str(nickname, 13);
+  nickname[12] = '\0';
+
+  // never index past the pokedex, even for a damaged save
+  if (species >= POKEDEX_POKEMON_ENTRIES || num_moves > 4 
+      || level < POKEMON_MIN_LEVEL || level > POKEMON_MAX_LEVEL) {
+    species = 0;
+    num_moves = 0;
+    level = POKEMON_MIN_LEVEL;
+  }
+  for (int32_t i = 0; i < num_moves; ++i) {
+    if (moveset[i] >= POKEDEX_MOVES_ENTRIES) {
+      moveset[i] = 0;
+    }
+  }
+  calculate_stats();
+  if (current_hp > stats[stat_hp]) {
+    current_hp = stats[stat_hp];
+  }
+}
+
+void Pokemon::save(SaveWriter *out) {
+  out->u16(species);
+  out->u8(level);
+  out->u32(exp);
+  out->u8(num_moves);
+  for (int32_t i = 0; i < num_moves; ++i) {
+    out->u16(moveset[i]);
+    out->u8(current_pp[i]);
+  }
+  out->u16(current_hp);
+  out->bytes(ivs, 3);
+  out->u8(flags);
+  out->str(nickname, 13);
+}
+
+/*
+ * Helper method to generate everything that follows from species and level
+ * Called when initializing a pokemon
+ */
+void Pokemon::generate() {
   populate_moveset();
   generate_ivs();
-  lookup_base_stats();
   calculate_stats();
-  lookup_type();
 
-  exp = pd_experience[(pd_species_entry->growth_rate_id - 1) * 100 + level - 1]
-          .experience;
+  exp = pd_experience[(get_pd_species_entry()->growth_rate_id - 1) * 100 
+                      + level - 1].experience;
   current_hp = stats[stat_hp];
-  gender = static_cast<gender_t>(rand() % 2);
-  shiny = rand() % POKEMON_SHINY_RATE == 0 ? true : false;
-  has_owner = false;
+  flags = 0;
+  if (rng_rand() % 2 == gender_female)
+    flags |= POKEMON_FLAG_FEMALE;
+  if (rng_rand() % POKEMON_SHINY_RATE == 0)
+    flags |= POKEMON_FLAG_SHINY;
 }
 
 pd_pokemon_t* Pokemon::get_pd_entry() {
-  return pd_entry;
+  return &pd_pokemon[species];
 }
 pd_pokemon_species_t* Pokemon::get_pd_species_entry() {
-  return pd_species_entry;
+  return &pd_pokemon_species[pd_pokemon[species].id - 1];
 }
 const char* Pokemon::get_nickname() {
   return nickname;
@@ -198,118 +298,77 @@ int32_t Pokemon::get_exp() {
 if (level >= POKEMON_MAX_LEVEL) {
     return 0;
   }
+  int32_t growth = get_pd_species_entry()->growth_rate_id - 1;
   return 
     exp
-    - pd_experience[(pd_species_entry->growth_rate_id - 1) * 100 + level - 1]
-      .experience;
+    - pd_experience[growth * 100 + level - 1].experience;
 }
 int32_t Pokemon::get_total_exp_next_level() {
   if (level >= POKEMON_MAX_LEVEL) {
     return 0;
   }
+  int32_t growth = get_pd_species_entry()->growth_rate_id - 1;
   return 
-    pd_experience[(pd_species_entry->growth_rate_id - 1) * 100 + level]
-      .experience;
+    pd_experience[growth * 100 + level].experience;
 }
 int32_t Pokemon::get_exp_next_level() {
   if (level >= POKEMON_MAX_LEVEL) {
     return 0;
   }
+  int32_t growth = get_pd_species_entry()->growth_rate_id - 1;
   return 
-    pd_experience[(pd_species_entry->growth_rate_id - 1) * 100 + level]
-      .experience
-    - pd_experience[(pd_species_entry->growth_rate_id - 1) * 100 + level - 1]
-        .experience;
+    pd_experience[growth * 100 + level].experience
+    - pd_experience[growth * 100 + level - 1].experience;
 }
 void Pokemon::give_exp(int32_t amount) {
   if (level < POKEMON_MAX_LEVEL) {
     exp += amount;
   }
 }
-bool Pokemon::process_level_up() { 
+/*
+ * Levels up the pokemon if it has enough exp, without any user interaction.
+ * Moves the pokemon can now learn are appended to new_moves, if not NULL.
+ * Returns true if the pokemon leveled up.
+ */
+bool Pokemon::level_up(std::vector<pd_move_t*> *new_moves) { 
   if (exp >= get_total_exp_next_level() && level < POKEMON_MAX_LEVEL) {
     ++level;
     int32_t old_hp = stats[stat_hp];
     calculate_stats();
     current_hp += stats[stat_hp] - old_hp;
+
+    if (new_moves == NULL) {
+      return true;
+    }
     
     // 1. Find levelup learnset
-    std::vector<int32_t> levelup_learnset;
-    for (int32_t i = 0; i < POKEDEX_POKEMON_MOVES_ENTRIES; ++i) {
-      if ((pd_entry->species_id == pd_pokemon_moves[i].pokemon_id)
-      && (level == pd_pokemon_moves[i].level)) {
+    species_cache_t *sc = &species_cache[species];
+    for (int32_t i = sc->learnset_start; i < sc->learnset_end; ++i) {
+      if (level == species_learnset[i].level) {
         // check if move is already in learnset
         bool is_dup = false;
-        for (auto it  = levelup_learnset.begin(); 
-                  it != levelup_learnset.end(); ++it) {
-          if (*it == pd_pokemon_moves[i].move_id) {
+        for (auto it  = new_moves->begin(); it != new_moves->end(); ++it) {
+          if ((*it)->id == species_learnset[i].move_id) {
             is_dup = true;
             break;
           }
         }
         // check if move is already in moveset
         for (int32_t m = 0; m < num_moves; ++m) {
-          if (get_move(m)->id == pd_pokemon_moves[i].move_id) {
+          if (get_move(m)->id == species_learnset[i].move_id) {
             is_dup = true;
             break;
           }
         }
 
         if (!is_dup) {
-          levelup_learnset.push_back(pd_pokemon_moves[i].move_id);
-        }
-      }
-    }
-
-    // 2. Teach moves in learnset
-    while (levelup_learnset.size() > 0) {
-      // 2a. Find move in database
-      bool move_found = false;
-      for (int32_t i = 0; i < POKEDEX_MOVES_ENTRIES; ++i) {
-        if (pd_moves[i].id == levelup_learnset[0]) {
-          // 2b. Move found now there are two cases
-          //     Open teach pokemon view
-          
-          char m1[MAX_COL], m2[MAX_COL], m_cancel[MAX_COL];
-          if (num_moves < 4) {
-            // 2ba. No player choice, move is learned in first available slot
-            learn_move(&pd_moves[i]);
-            sprintf(m1, "%s learned %s!", nickname, pd_moves[i].identifier);
-            render_select_move_getch(this, NULL, -1, m1, NULL, NULL);
-          } else {
-            // 2bb. Player must select move to forget
-            sprintf(m1, "%s wants to learn the move %s.",
-                    nickname, pd_moves[i].identifier);
-            sprintf(m2, "Which move should be forgotten?");
-            sprintf(m_cancel, "STOP LEARNING %s", pd_moves[i].identifier);
-            int32_t scroller_pos = 
-              select_move_driver(this, &pd_moves[i], m1, m2, m_cancel);
-
-            if (scroller_pos < num_moves && scroller_pos >= 0) {
-              // player choose to replace a move
-              sprintf(m2, "%s forgot %s and... learned %s",
-                    nickname, get_move(scroller_pos)->identifier, 
-                    pd_moves[i].identifier);
-              overwrite_move(scroller_pos, &pd_moves[i]);
-              render_select_move_getch(this, &pd_moves[i], -1, m1, m2, NULL);
-            } else if (scroller_pos == num_moves) {
-              // cancel was selected
-              sprintf(m2, "%s did not learn %s.",
-                    nickname, pd_moves[i].identifier);
-              render_select_move_getch(this, &pd_moves[i], -1, m1, m2, NULL);
-            }
-            
+          // 2. Make sure the move is in the database
+          if (species_learnset[i].move == NULL) {
+            exit_w_message("Error: Move exists in learnset, but not in moves!");
           }
-          
-          // 2c. Move has been handles now, Remove move from learnset
-          levelup_learnset.erase(levelup_learnset.begin());
-          move_found = true;
-          break;
+          new_moves->push_back(species_learnset[i].move);
         }
       }
-      if (!move_found) {
-        exit_w_message("Error: Move exists in learnset, but not in moves!");
-      }
     }
 
     return true;
@@ -317,32 +376,138 @@ bool Pokemon::process_level_up() {
     return false;
   }
 }
+
+/*
+ * Opens the teach pokemon view for a move the pokemon wants to learn
+ */
+void Pokemon::teach_move(pd_move_t *new_move) {
+  char m1[MAX_COL], m2[MAX_COL], m_cancel[MAX_COL];
+  if (num_moves < 4) {
+    // No player choice, move is learned in first available slot
+    learn_move(new_move);
+    sprintf(m1, "%s learned %s!", nickname, new_move->identifier);
+    render_select_move_getch(this, NULL, -1, m1, NULL, NULL);
+  } else {
+    // Player must select move to forget
+    sprintf(m1, "%s wants to learn the move %s.",
+            nickname, new_move->identifier);
+    sprintf(m2, "Which move should be forgotten?");
+    sprintf(m_cancel, "STOP LEARNING %s", new_move->identifier);
+    int32_t scroller_pos = 
+      select_move_driver(this, new_move, m1, m2, m_cancel);
+
+    if (scroller_pos < num_moves && scroller_pos >= 0) {
+      // player choose to replace a move
+      sprintf(m2, "%s forgot %s and... learned %s",
+            nickname, get_move(scroller_pos)->identifier, 
+            new_move->identifier);
+      overwrite_move(scroller_pos, new_move);
+      render_select_move_getch(this, new_move, -1, m1, m2, NULL);
+    } else if (scroller_pos == num_moves) {
+      // cancel was selected
+      sprintf(m2, "%s did not learn %s.",
+            nickname, new_move->identifier);
+      render_select_move_getch(this, new_move, -1, m1, m2, NULL);
+    }
+  }
+}
+
+/*
+ * Levels up the pokemon if it has enough exp, and lets the player teach it any
+ * new moves.
+ * Returns true if the pokemon leveled up.
+ */
+bool Pokemon::process_level_up() { 
+  std::vector<pd_move_t*> new_moves;
+  if (!level_up(&new_moves)) {
+    return false;
+  }
+  for (auto it = new_moves.begin(); it != new_moves.end(); ++it) {
+    teach_move(*it);
+  }
+  return true;
+}
 pd_move_t* Pokemon::get_move(int32_t move_slot) {
   if (move_slot < 0 || move_slot > num_moves) {
     return &pd_moves[164]; // struggle id 165
   }
-  return moveset[move_slot];
+  return &pd_moves[moveset[move_slot]];
 }
-int32_t Pokemon::ai_select_move_slot() {
-  if (num_moves > 0 && has_pp()) {
-    bool found_move = false;
-    int32_t randy;
-    while (!found_move) {
-      randy = rand() % num_moves;
-      if (current_pp[randy] > 0) {
-        return randy;
-      }
+int32_t Pokemon::get_max_pp(int32_t move_slot) {
+  return pd_moves[moveset[move_slot]].pp;
+}
+/*
+ * Chooses the move the pokemon will use against defender.
+ * 
+ * ai_random picks any move with pp left. ai_expected_damage picks the move 
+ * with the highest expected damage, falling back to random if no move deals 
+ * damage. Both look at each of the at most 4 moves once.
+ * Returns -1 for struggle if no move has pp left.
+ */
+int32_t Pokemon::ai_select_move_slot(Pokemon *defender, ai_policy_t policy) {
+  int32_t usable[4];
+  int32_t num_usable = 0;
+
+  for (int32_t m = 0; m < num_moves; ++m) {
+    if (current_pp[m] > 0) {
+      usable[num_usable++] = m;
     }
   }
   // if no pp or no moves then pokemon uses struggle
-  return -1;
+  if (num_usable == 0) {
+    return -1;
+  }
+  if (policy == ai_random || defender == NULL) {
+    return usable[rng_rand() % num_usable];
+  }
+
+  // expected damage, without the random roll that is the same for every move
+  int32_t lv[4], atk[4], sp_atk[4], t0[4], t1[4], def[4], sp_def[4];
+  int32_t def_pair[4], power[4], cls[4], move_type[4], roll[4], dmg[4];
+  bool crit[4];
+  for (int32_t k = 0; k < num_usable; ++k) {
+    lv[k] = level;
+    atk[k] = stats[stat_attack];
+    sp_atk[k] = stats[stat_sp_atk];
+    t0[k] = get_type(0);
+    t1[k] = get_type(1);
+    def[k] = defender->get_stat(stat_defense);
+    sp_def[k] = defender->get_stat(stat_sp_def);
+    def_pair[k] = defender->get_type_pair();
+    power[k] = get_move(usable[k])->power;
+    cls[k] = get_move(usable[k])->damage_class_id;
+    move_type[k] = get_move(usable[k])->type_id;
+    roll[k] = 100;
+    crit[k] = false;
+  }
+  damage_batch_t batch = { num_usable, lv, atk, sp_atk, t0, t1, def, sp_def,
+                           def_pair, power, cls, move_type, crit, roll };
+  calculate_damage_batch(&batch, dmg);
+
+  float crit_chance = min(get_base_stat(stat_speed) / 2, 256) / 256.0;
+  int32_t best = -1;
+  float best_score = 0;
+  for (int32_t k = 0; k < num_usable; ++k) {
+    pd_move_t *m = get_move(usable[k]);
+    float accuracy = m->accuracy == -1 ? 1 : m->accuracy / 100.0;
+    float score = dmg[k] * accuracy * (1 + 0.5 * crit_chance);
+    if (score > best_score) {
+      best_score = score;
+      best = k;
+    }
+  }
+  if (best == -1) {
+    // only status moves left
+    return usable[rng_rand() % num_usable];
+  }
+  return usable[best];
 }
 int32_t Pokemon::get_num_moves() {
   return num_moves;
 }
 void Pokemon::learn_move(pd_move_t *m) {
   if (num_moves < 4) {
-    moveset[num_moves] = m;
+    moveset[num_moves] = m - pd_moves;
     current_pp[num_moves] = m->pp;
     ++num_moves;
   }
@@ -350,19 +515,19 @@ void Pokemon::learn_move(pd_move_t *m) {
 }
 void Pokemon::overwrite_move(int32_t move_slot, pd_move_t *m) {
   if (move_slot < num_moves && move_slot >= 0) {
-    moveset[move_slot] = m;
+    moveset[move_slot] = m - pd_moves;
     current_pp[move_slot] = m->pp;
   }
   return;
 }
 int32_t Pokemon::get_base_stat(stat_id_t stat_id) {
-  return base_stats[stat_id];
+  return species_cache[species].base_stats[stat_id];
 }
 int32_t Pokemon::get_stat(stat_id_t stat_id) {
   return stats[stat_id];
 }
 int32_t Pokemon::get_iv(stat_id_t stat_id) {
-  return ivs[stat_id];
+  return (ivs[stat_id / 2] >> (4 * (stat_id % 2))) & 0xf;
 }
 int32_t Pokemon::get_current_hp() {
   return current_hp;
@@ -381,17 +546,18 @@ int32_t Pokemon::use_pp(int32_t move_slot) {
   return 1;
 }
 int32_t Pokemon::restore_pp(int32_t m, int32_t amount) {
-  if (current_pp[m] == moveset[m]->pp) {
+  int32_t max_pp = get_max_pp(m);
+  if (current_pp[m] == max_pp) {
     return 0;
   }
   // protects against overflowing if amount + move pp > INT_MAX
   // we can fully heal a pokemon by passing amount = INT_MAX
-  if (amount >= moveset[m]->pp) {
-    current_pp[m] = moveset[m]->pp;
+  if (amount >= max_pp) {
+    current_pp[m] = max_pp;
     return 1;
   }
-  if (current_pp[m] + amount >= moveset[m]->pp) {
-    current_pp[m] = moveset[m]->pp;
+  if (current_pp[m] + amount >= max_pp) {
+    current_pp[m] = max_pp;
     return 1;
   }
   current_pp[m] += amount;
@@ -405,7 +571,7 @@ bool Pokemon::has_pp() {
 }
 bool Pokemon::has_all_pp() {
   for (int32_t i = 0; i < num_moves; ++i)
-    if (current_pp[i] != moveset[i]->pp)
+    if (current_pp[i] != get_max_pp(i))
       return false;
   return true;
 }
@@ -416,13 +582,16 @@ void Pokemon::restore_all_pp(int32_t amount) {
 }
 
 gender_t Pokemon::get_gender() {
-  return gender;
+  return flags & POKEMON_FLAG_FEMALE ? gender_female : gender_male;
 }
 bool Pokemon::is_shiny() {
-  return shiny;
+  return flags & POKEMON_FLAG_SHINY;
 }
 int32_t Pokemon::get_type(int32_t slot) {
-  return type[slot];
+  return species_cache[species].type[slot];
+}
+int32_t Pokemon::get_type_pair() {
+  return species_cache[species].type_pair;
 }
 int32_t Pokemon::heal(int32_t amount) {
   if (current_hp == stats[stat_hp]) {
@@ -455,10 +624,14 @@ void Pokemon::take_damage(int32_t amount) {
   return;
 }
 bool Pokemon::get_has_owner() {
-  return has_owner;
+  return flags & POKEMON_FLAG_HAS_OWNER;
 }
 void Pokemon::set_has_owner(bool new_value) {
-  has_owner = new_value;
+  if (new_value) {
+    flags |= POKEMON_FLAG_HAS_OWNER;
+  } else {
+    flags &= ~POKEMON_FLAG_HAS_OWNER;
+  }
   return;
 }
 bool Pokemon::is_fainted() {
@@ -505,23 +678,78 @@ int32_t move_priority(int32_t move_priority_1, int32_t poke_speed_1,
   }
 
   // 3. Random chance
-  return ((rand() % 2) ? 1 : -1);
+  return ((rng_rand() % 2) ? 1 : -1);
+}
+
+/*
+ * Range of levels that pokemon are generated with at a manhattan distance 
+ * from the center of the world.
+ */
+void level_range(int32_t dist, int32_t *min_level, int32_t *max_level) {
+  if (dist <= 200) {
+    *min_level = POKEMON_MIN_LEVEL;
+    *max_level = dist / 2;
+    if (*max_level > POKEMON_MAX_LEVEL)
+      *max_level = POKEMON_MAX_LEVEL;
+    if (*max_level < 1)
+      *max_level = 1;
+  } else {
+    *min_level = ((dist - 200) / 2);
+    *max_level = POKEMON_MAX_LEVEL;
+    if (*min_level > POKEMON_MAX_LEVEL)
+      *min_level = POKEMON_MAX_LEVEL;
+    if (*min_level < 1)
+      *min_level = 1;
+  }
+}
+
+typedef struct type_chart {
+  uint8_t eff[18][NUM_TYPE_PAIRS];
+} type_chart_t;
+
+/*
+ * Combines both defensive types of the type chart into one fixed-point 
+ * multiplier per attacking type and defensive type pair
+ */
+static constexpr type_chart_t make_type_chart() {
+  type_chart_t chart = {};
+  for (int32_t a = 0; a < 18; ++a) {
+    for (int32_t t0 = 0; t0 < 18; ++t0) {
+      for (int32_t t1 = 0; t1 < 19; ++t1) {
+        // index 18 is no second type
+        float eff = type_effectiveness[a][t0] 
+                    * (t1 == 18 ? 1 : type_effectiveness[a][t1]);
+        chart.eff[a][t0 * 19 + t1] = static_cast<uint8_t>(eff * TYPE_EFF_ONE);
+      }
+    }
+  }
+  return chart;
+}
+
+static constexpr type_chart_t type_chart = make_type_chart();
+
+/*
+ * Returns the index of a defensive type pair. Type ids start at 1, a second 
+ * type of -1 means none.
+ */
+int32_t type_pair_index(int32_t type0, int32_t type1) {
+  return (type0 - 1) * 19 + (type1 > 0 ? type1 - 1 : 18);
+}
+
+/*
+ * Returns the type effectiveness multiplier of a move type against a 
+ * defensive type pair
+ */
+float type_multiplier(int32_t move_type, int32_t def_type_pair) {
+  return type_chart.eff[move_type - 1][def_type_pair] 
+         * (1.0f / TYPE_EFF_ONE);
 }
 
 /*
  * Returns the type effectiveness multiplier of a move against another pokemon
  */
 float effectiveness(pd_move_t *attacking_move, Pokemon *defender) {
-  int32_t atk_tid = attacking_move->type_id - 1;
-  int32_t def_tid_0 = defender->get_type(0) - 1;
-  int32_t def_tid_1 = defender->get_type(1) - 1;
-  
-  float eff = type_effectiveness[atk_tid][def_tid_0];
-  // if pokemon has two types
-  if (def_tid_1 >= 0) {
-    eff *= type_effectiveness[atk_tid][def_tid_1];
-  }
-  return eff;
+  return type_multiplier(attacking_move->type_id, defender->get_type_pair());
 }
 
 /*
@@ -529,11 +757,7 @@ float effectiveness(pd_move_t *attacking_move, Pokemon *defender) {
  */
 int32_t calculate_damage(Pokemon *attacker, pd_move_t *attacking_move, 
                          Pokemon *defender, bool is_critical) {
-  float level = attacker->get_level();
-  float power = attacking_move->power;
-  if (power == -1)
-    power = 0;
-  float attack, defense;
+  int32_t attack, defense;
   if (attacking_move->damage_class_id == 2) {
     // physical attack
     attack = attacker->get_stat(stat_attack);
@@ -546,19 +770,96 @@ int32_t calculate_damage(Pokemon *attacker, pd_move_t *attacking_move,
     // status (not implemented)
     return 0;
   }
+  int32_t roll = (rng_rand() % (100 - 85 + 1)) + 85;
+  bool stab = attacking_move->type_id == attacker->get_type(0) 
+           || attacking_move->type_id == attacker->get_type(1);
+
+  return damage_formula(attacker->get_level(), attacking_move->power, 
+                        attack, defense, is_critical, roll, stab,
+                        effectiveness(attacking_move, defender));
+}
+
+/*
+ * Damage formula of a physical or special attack, roll is the random 
+ * 85-100% damage roll.
+ */
+int32_t damage_formula(int32_t level, int32_t power, int32_t attack, 
+                       int32_t defense, bool is_critical, int32_t roll, 
+                       bool stab, float type) {
+  float f_level = level;
+  float f_power = power == -1 ? 0 : power;
+  float f_attack = attack;
+  float f_defense = defense;
   float critical = is_critical ? 1.5 : 1.0;
-  float random = ((rand() % (100 - 85 + 1)) + 85) / 100.0;
-  float stab = attacking_move->type_id == attacker->get_type(0) 
-            || attacking_move->type_id == attacker->get_type(1)
-             ? 1.5 : 1;
-  float type = effectiveness(attacking_move, defender);
-                           
+  float random = roll / 100.0;
+  float f_stab = stab ? 1.5 : 1;
+
   return static_cast<int32_t>(
-        ( ( (2.0 * level) / 5.0 * power * (attack / defense) ) / 50.0 + 2.0) 
-         * critical * random * stab * type
+        ( ( (2.0 * f_level) / 5.0 * f_power * (f_attack / f_defense) ) / 50.0 
+          + 2.0) 
+         * critical * random * f_stab * type
         );
 }
 
+typedef double  v4d_t __attribute__((vector_size(4 * sizeof (double))));
+typedef float   v4f_t __attribute__((vector_size(4 * sizeof (float))));
+typedef int32_t v4i_t __attribute__((vector_size(4 * sizeof (int32_t))));
+
+/*
+ * Computes the damage of in->n attacks at once, 4 at a time in SIMD lanes.
+ * 
+ * Every lane performs exactly the operations of damage_formula() in the same
+ * order and precision, so the results are identical to calculate_damage() 
+ * given the same critical hits and rolls. Status moves deal 0 damage.
+ */
+void calculate_damage_batch(const damage_batch_t *in, int32_t *out) {
+  for (int32_t i = 0; i < in->n; i += 4) {
+    v4f_t attack, defense;
+    v4d_t level, power, critical, roll, stab, type;
+    int32_t lanes = in->n - i < 4 ? in->n - i : 4;
+    
+    for (int32_t k = 0; k < 4; ++k) {
+      int32_t x = i + k;
+      // unused lanes are filled with harmless values
+      attack[k] = 0;
+      defense[k] = 1;
+      level[k] = power[k] = 0;
+      critical[k] = stab[k] = type[k] = 1;
+      roll[k] = 100;
+      if (k >= lanes) {
+        continue;
+      }
+      if (in->damage_class[x] == 2) {
+        attack[k] = in->attack[x];
+        defense[k] = in->defense[x];
+      } else if (in->damage_class[x] == 3) {
+        attack[k] = in->sp_atk[x];
+        defense[k] = in->sp_def[x];
+      }
+      level[k] = static_cast<float>(in->level[x]);
+      power[k] = in->power[x] == -1 ? 0 : static_cast<float>(in->power[x]);
+      critical[k] = in->critical[x] ? 1.5 : 1.0;
+      roll[k] = in->roll[x];
+      stab[k] = in->move_type[x] == in->atk_type0[x]
+             || in->move_type[x] == in->atk_type1[x] ? 1.5 : 1;
+      type[k] = type_multiplier(in->move_type[x], in->def_type_pair[x]);
+    }
+
+    // the random multiplier is rounded to float like in the scalar path
+    v4d_t random = __builtin_convertvector(
+                     __builtin_convertvector(roll / 100.0, v4f_t), v4d_t);
+    v4d_t ratio = __builtin_convertvector(attack / defense, v4d_t);
+    v4d_t damage = ( ( (2.0 * level) / 5.0 * power * ratio ) / 50.0 + 2.0) 
+                   * critical * random * stab * type;
+    v4i_t result = __builtin_convertvector(damage, v4i_t);
+
+    for (int32_t k = 0; k < lanes; ++k) {
+      int32_t c = in->damage_class[i + k];
+      out[i + k] = (c == 2 || c == 3) ? result[k] : 0;
+    }
+  }
+}
+
 /*
  * Returns a boolean, calculated with the appropriate random odds, to indicate
  * if a critical hit occurs.
@@ -567,7 +868,7 @@ bool is_critical (Pokemon *attacker, pd_move_t *attacking_move) {
   // status moves can not crit
   if (attacking_move->damage_class_id == 1) 
     return false;
-  return (rand() % 256) < attacker->get_base_stat(stat_speed)/2;
+  return (rng_rand() % 256) < attacker->get_base_stat(stat_speed)/2;
 }
 
 /*
@@ -578,7 +879,7 @@ bool is_miss (pd_move_t *attacking_move) {
   // accuracy not specified means this attack cannot miss
   if (attacking_move->accuracy == -1)
     return false;
-  return !( (rand() % 100) < attacking_move->accuracy );
+  return !( (rng_rand() % 100) < attacking_move->accuracy );
 }
 
 /*
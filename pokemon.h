@@ -2,12 +2,13 @@
 #define POKEMON_H
 
 #include <cstdint>
+#include <vector>
 #include "config.h"
 #include "pokedex.h"
 
 // Uses Gen 2-5 type chart, 
 // We are using gen 3 pokemon so fiary type should never be used
-static const float type_effectiveness[18][18] = {
+static constexpr float type_effectiveness[18][18] = {
 /* AKv/DE> Nor Fig Fly Poi Gro Roc Bug Gho Ste Fir Wat Gra Ele Psy Ice Dra Dar Fai */
 /* Nor */ {1  ,1  ,1  ,1  ,1  ,0.5,1  ,0  ,0.5,1  ,1  ,1  ,1  ,1  ,1  ,1  ,1  ,1  },
 /* Fig */ {2  ,1  ,0.5,0.5,1  ,2  ,0.5,0  ,2  ,1  ,1  ,1  ,1  ,0.5,2  ,1  ,2  ,1  },
@@ -29,6 +30,17 @@ static const float type_effectiveness[18][18] = {
 /* Fai */ {1  ,1  ,1  ,1  ,1  ,1  ,1  ,1  ,1  ,1  ,1  ,1  ,1  ,1  ,1  ,1  ,1  ,1  }
 };
 
+// Number of defensive type combinations, the second type can also be none
+#define NUM_TYPE_PAIRS (18 * 19)
+// Fixed-point scale of the precomputed effectiveness table, every product of
+// two multipliers from the type chart is an exact multiple of 1/4
+#define TYPE_EFF_ONE 4
+
+typedef enum ai_policy {
+  ai_random,
+  ai_expected_damage
+} ai_policy_t;
+
 typedef enum gender {
   gender_male,
   gender_female
@@ -43,33 +55,84 @@ typedef enum stat_id {
   stat_speed
 } stat_id_t;
 
-class Pokemon {
-  pd_pokemon_t *pd_entry;
-  pd_pokemon_species_t *pd_species_entry;
-  char nickname[13];
+/*
+ * Structure of arrays input for calculate_damage_batch(), one entry per attack
+ */
+typedef struct damage_batch {
+  int32_t n;
+  // attacker
+  const int32_t *level;
+  const int32_t *attack;
+  const int32_t *sp_atk;
+  const int32_t *atk_type0;
+  const int32_t *atk_type1;
+  // defender
+  const int32_t *defense;
+  const int32_t *sp_def;
+  const int32_t *def_type_pair;
+  // move
+  const int32_t *power;
+  const int32_t *damage_class;
+  const int32_t *move_type;
+  // random outcomes
+  const bool *critical;
+  const int32_t *roll;      // 85-100
+} damage_batch_t;
+
+typedef struct learnset_entry {
   int32_t level;
-  int32_t exp;
-  pd_move_t *moveset[4];
-  int32_t current_pp[4];
-  int32_t num_moves;
-  int32_t base_stats[6];
-  int32_t stats[6];
-  int32_t ivs[6];
-  int32_t current_hp;
-  gender_t gender;
-  bool shiny;
+  int32_t move_id;
+  pd_move_t *move; // NULL if the move is missing from the moves table
+} learnset_entry_t;
+
+typedef struct species_cache {
   int32_t type[2];
-  bool has_owner;
+  int32_t type_pair;
+  int32_t base_stats[6];
+  // range of this species' level up moves in the learnset table
+  int32_t learnset_start;
+  int32_t learnset_end;
+} species_cache_t;
+
+#define POKEMON_FLAG_FEMALE    0x1
+#define POKEMON_FLAG_SHINY     0x2
+#define POKEMON_FLAG_HAS_OWNER 0x4
+
+/*
+ * Pokemon are stored packed since every trainer in the world carries a party.
+ * Pokedex entries are referenced by index instead of by pointer, base stats 
+ * and types are read from the species cache, and only the stats are cached
+ * since battles read them constantly. The getters convert back to the 
+ * pokedex types for everything else.
+ */
+class SaveWriter;
+class SaveReader;
+
+class Pokemon {
+  int32_t exp;
+  uint16_t species;      // index into pd_pokemon
+  uint16_t moveset[4];   // indices into pd_moves
+  uint16_t stats[6];
+  uint16_t current_hp;
+  uint8_t current_pp[4];
+  uint8_t ivs[3];        // two 4 bit ivs per byte, even stat ids in the low bits
+  uint8_t level;
+  uint8_t num_moves;
+  uint8_t flags;
+  char nickname[13];
 
-  void lookup_type();
+  void pick_species();
   void generate_level();
+  void generate();
   void populate_moveset();
   void generate_ivs();
-  void lookup_base_stats();
   void calculate_stats();
 
   public:
     Pokemon();
+    Pokemon(int32_t level);
+    Pokemon(SaveReader *in);
+    void save(SaveWriter *out);
     pd_pokemon_t* get_pd_entry();
     pd_pokemon_species_t* get_pd_species_entry();
     const char* get_nickname();
@@ -80,9 +143,12 @@ class Pokemon {
     int32_t get_total_exp();
     int32_t get_total_exp_next_level();
     void give_exp(int32_t amount);
+    bool level_up(std::vector<pd_move_t*> *new_moves);
+    void teach_move(pd_move_t *new_move);
     bool process_level_up();
     pd_move_t* get_move(int32_t move_slot);
-    int32_t ai_select_move_slot();
+    int32_t get_max_pp(int32_t move_slot);
+    int32_t ai_select_move_slot(Pokemon *defender, ai_policy_t policy);
     int32_t get_num_moves();
     void learn_move(pd_move_t *m);
     void overwrite_move(int32_t move_slot, pd_move_t *m);
@@ -99,6 +165,7 @@ class Pokemon {
     gender_t get_gender();
     bool is_shiny();
     int32_t get_type(int32_t slot);
+    int32_t get_type_pair();
     int32_t heal(int32_t amount);
     void take_damage(int32_t amount);
     bool get_has_owner();
@@ -107,11 +174,19 @@ class Pokemon {
 };
 
 const char* type_name(int32_t type_id);
+void init_species_cache();
+void level_range(int32_t dist, int32_t *min_level, int32_t *max_level);
 int32_t move_priority(int32_t move_priority_1, int32_t poke_speed_1,
                       int32_t move_priority_2, int32_t poke_speed_2);
+int32_t type_pair_index(int32_t type0, int32_t type1);
+float type_multiplier(int32_t move_type, int32_t def_type_pair);
 float effectiveness(pd_move_t *attacking_move, Pokemon *defender);
 int32_t calculate_damage(Pokemon *attacker, pd_move_t *attacking_move, 
                          Pokemon *defender, bool is_critical);
+int32_t damage_formula(int32_t level, int32_t power, int32_t attack, 
+                       int32_t defense, bool is_critical, int32_t roll, 
+                       bool stab, float type);
+void calculate_damage_batch(const damage_batch_t *in, int32_t *out);
 bool is_critical(Pokemon *attacker, pd_move_t *attacking_move);
 bool is_miss(pd_move_t *attacking_move);
 int32_t experience_gain(Pokemon *opp);
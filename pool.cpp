@@ -0,0 +1,151 @@
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "pool.h"
+
+/*
+ * Worker threads that run batches of independent jobs, kept for the whole 
+ * game so a batch every frame costs no thread startup.
+ *
+ * Every worker has its own queue of jobs. It takes its jobs from the back and
+ * when it runs out it steals from the front of the others, so uneven jobs 
+ * (a busy region next to an empty one) still keep every core working.
+ */
+typedef struct pool_queue {
+  std::mutex lock;
+  std::deque<int32_t> jobs;
+} pool_queue_t;
+
+/*
+ * Everything the workers share. Lives on the heap from the first batch until
+ * pool_stop, so no static destructor ever runs under a waiting worker.
+ */
+typedef struct pool {
+  std::vector<std::thread> workers;
+  std::vector<pool_queue_t*> queues;
+  std::mutex lock;
+  std::condition_variable work_cv;
+  std::condition_variable done_cv;
+  uint64_t generation = 0;
+  bool stopping = false;
+  std::atomic<int32_t> pending{0};
+  void (*job)(int32_t k, void *arg) = NULL;
+  void *arg = NULL;
+} pool_t;
+
+static pool_t *pool = NULL;
+
+/*
+ * Takes a job for worker w, its own newest or the oldest of another worker
+ */
+static bool pool_take(int32_t w, int32_t *k) {
+  int32_t n = pool->queues.size();
+  for (int32_t v = 0; v < n; ++v) {
+    pool_queue_t *q = pool->queues[(w + v) % n];
+    std::lock_guard<std::mutex> l(q->lock);
+    if (!q->jobs.empty()) {
+      if (v == 0) {
+        *k = q->jobs.back();
+        q->jobs.pop_back();
+      } else {
+        *k = q->jobs.front();
+        q->jobs.pop_front();
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+static void pool_worker(int32_t w) {
+  uint64_t seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> l(pool->lock);
+      pool->work_cv.wait(l, [&] { 
+        return pool->stopping || pool->generation != seen; 
+      });
+      if (pool->stopping) {
+        return;
+      }
+      seen = pool->generation;
+    }
+    int32_t k;
+    while (pool_take(w, &k)) {
+      pool->job(k, pool->arg);
+      if (pool->pending.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> l(pool->lock);
+        pool->done_cv.notify_all();
+      }
+    }
+  }
+}
+
+/*
+ * Runs job(k, arg) for every k below num_jobs on the worker threads and 
+ * returns once all of them are done. The calling thread only waits.
+ */
+void pool_run(int32_t num_jobs, void (*job)(int32_t k, void *arg), void *arg) {
+  static bool stop_at_exit = false;
+  if (num_jobs <= 0) {
+    return;
+  }
+  if (!pool) {
+    // every way out of the game, not only quit_game, has to join the workers
+    if (!stop_at_exit) {
+      atexit(pool_stop);
+      stop_at_exit = true;
+    }
+    int32_t num_threads = std::thread::hardware_concurrency();
+    if (num_threads < 1) {
+      num_threads = 1;
+    }
+    pool = new pool_t;
+    for (int32_t w = 0; w < num_threads; ++w) {
+      pool->queues.push_back(new pool_queue_t);
+    }
+    for (int32_t w = 0; w < num_threads; ++w) {
+      pool->workers.push_back(std::thread(pool_worker, w));
+    }
+  }
+
+  std::unique_lock<std::mutex> l(pool->lock);
+  pool->job = job;
+  pool->arg = arg;
+  pool->pending = num_jobs;
+  for (int32_t k = 0; k < num_jobs; ++k) {
+    pool_queue_t *q = pool->queues[k % pool->queues.size()];
+    std::lock_guard<std::mutex> ql(q->lock);
+    q->jobs.push_back(k);
+  }
+  ++pool->generation;
+  pool->work_cv.notify_all();
+  pool->done_cv.wait(l, [] { return pool->pending == 0; });
+}
+
+/*
+ * Stops and joins the worker threads. Safe to call more than once, the next
+ * batch starts them again.
+ */
+void pool_stop() {
+  if (!pool) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> l(pool->lock);
+    pool->stopping = true;
+  }
+  pool->work_cv.notify_all();
+  for (size_t w = 0; w < pool->workers.size(); ++w) {
+    pool->workers[w].join();
+    delete pool->queues[w];
+  }
+  delete pool;
+  pool = NULL;
+}
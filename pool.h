@@ -0,0 +1,9 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <cstdint>
+
+void pool_run(int32_t num_jobs, void (*job)(int32_t k, void *arg), void *arg);
+void pool_stop();
+
+#endif
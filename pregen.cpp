@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "region.h"
+#include "global_events.h"
+#include "rng.h"
+#include "world.h"
+#include "pregen.h"
+
+extern Region *region_ptr[WORLD_SIZE][WORLD_SIZE];
+
+/*
+ * Every region gets its own random number stream, so a region comes out the 
+ * same no matter which thread generates it or when
+ */
+static uint64_t region_seed(uint64_t seed, int32_t x, int32_t y) {
+  return (seed << 32) ^ (x * WORLD_SIZE + y);
+}
+
+/*
+ * Generates the regions in batch, taking the next one until none are left
+ */
+static void pregen_worker(std::vector<int32_t> *batch, 
+                          std::vector<Region*> *built,
+                          std::atomic<size_t> *next, int32_t num_tnr, 
+                          uint64_t seed) {
+  size_t k;
+  while ((k = next->fetch_add(1)) < batch->size()) {
+    int32_t x = (*batch)[k] / WORLD_SIZE;
+    int32_t y = (*batch)[k] % WORLD_SIZE;
+    rng_seed_thread(region_seed(seed, x, y));
+    if (x == WORLD_SIZE/2 && y == WORLD_SIZE/2) {
+      // the starting region, as a new game generates it
+      int32_t exits[4];
+      border_exits(x, y, exits);
+      (*built)[k] = new Region(exits[0], exits[1], exits[2], exits[3], 1, 1);
+      (*built)[k]->populate(num_tnr, x, y);
+    } else {
+      (*built)[k] = generate_region(x, y, num_tnr);
+    }
+  }
+}
+
+/*
+ * Generates every region within manhattan distance radius of the center of 
+ * the world into the open world file, on all cores.
+ *
+ * Exits come from the world seed, so regions do not depend on each other and
+ * any of them can be built at the same time. They are built in batches of 
+ * PREGEN_BATCH, which are published and written out between batches, so only
+ * a batch is in memory at once. Regions already in the world file are kept.
+ */
+void pregen_driver(int32_t radius, int32_t num_tnr, uint64_t seed) {
+  int32_t num_threads = std::thread::hardware_concurrency();
+  if (num_threads < 1) {
+    num_threads = 1;
+  }
+  int32_t c = WORLD_SIZE / 2;
+
+  // center first and outwards, like a player would find them
+  std::vector<int32_t> todo;
+  for (int32_t d = 0; d <= radius && d <= 2 * c; ++d) {
+    for (int32_t x = c - d; x <= c + d; ++x) {
+      int32_t dy = d - abs(x - c);
+      for (int32_t y = c - dy; y <= c + dy; y += (dy ? 2 * dy : 1)) {
+        int32_t exits[4];
+        if (x >= 0 && y >= 0 && x < WORLD_SIZE && y < WORLD_SIZE
+            && region_ptr[x][y] == NULL && !world_region_exits(x, y, exits)) {
+          todo.push_back(x * WORLD_SIZE + y);
+        }
+      }
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t b = 0; b < todo.size(); b += PREGEN_BATCH) {
+    std::vector<int32_t> batch(todo.begin() + b, 
+                               todo.begin() + std::min<size_t>(b + PREGEN_BATCH, 
+                                                               todo.size()));
+    std::vector<Region*> built(batch.size(), NULL);
+    std::vector<std::thread> threads;
+    std::atomic<size_t> next(0);
+    int32_t batch_threads = std::min<size_t>(num_threads, batch.size());
+    for (int32_t t = 0; t < batch_threads; ++t) {
+      threads.push_back(std::thread(pregen_worker, &batch, &built, &next, 
+                                    num_tnr, seed));
+    }
+    for (int32_t t = 0; t < batch_threads; ++t) {
+      threads[t].join();
+    }
+
+    // back on one thread, the batch is published and written out
+    for (size_t k = 0; k < batch.size(); ++k) {
+      region_ptr[batch[k] / WORLD_SIZE][batch[k] % WORLD_SIZE] = built[k];
+    }
+    world_touch_all(batch);
+  }
+  std::chrono::duration<double> elapsed = 
+    std::chrono::steady_clock::now() - start;
+
+  printf("Generated %lld regions within distance %d on %d threads in %.2f s"
+         " (%.0f regions/s)\n", (long long) todo.size(), radius, num_threads,
+         elapsed.count(), todo.size() / elapsed.count());
+}
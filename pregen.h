@@ -0,0 +1,8 @@
+#ifndef PREGEN_H
+#define PREGEN_H
+
+#include <cstdint>
+
+void pregen_driver(int32_t radius, int32_t num_tnr, uint64_t seed);
+
+#endif
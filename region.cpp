@@ -2,9 +2,15 @@
 #include <cstdint>
 #include <cstdlib>
 #include <iostream>
+#include <new>
 
 #include "config.h"
 #include "region.h"
+#include "pokemon.h"
+#include "rng.h"
+#include "save.h"
+
+extern uint64_t world_seed;
 
 /*
  * returns the distance between 2 points
@@ -25,7 +31,29 @@ int32_t m_dist(int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
  * returns 1 if an event should happen, otherwise 0.
  */
 int32_t rand_outcome(double probability) {
-   return rand() < probability * ((double)RAND_MAX + 1.0);
+   return rng_rand() < probability * ((double)RAND_MAX + 1.0);
+}
+
+/*
+ * Hashes the border on the north side (vertical = 0) or east side 
+ * (vertical = 1) of region x, y. Regions on the edge of the world hash the
+ * border just outside it, which is never used.
+ */
+static uint64_t border_hash(int32_t x, int32_t y, int32_t vertical) {
+  uint64_t border = (static_cast<uint64_t>(x + 1) * (WORLD_SIZE + 1) + (y + 1));
+  return rng_hash(world_seed, border * 2 + vertical);
+}
+
+/*
+ * Gives the exits of region x, y in the order N, E, S, W. Every border is 
+ * shared with a neighbouring region and its exit only depends on the world 
+ * seed and the border, so both regions agree without looking at each other.
+ */
+void border_exits(int32_t x, int32_t y, int32_t exits[4]) {
+  exits[0] = border_hash(x, y, 0) % (MAX_COL - 2) + 1;
+  exits[1] = border_hash(x, y, 1) % (MAX_ROW - 2) + 1;
+  exits[2] = border_hash(x, y - 1, 0) % (MAX_COL - 2) + 1;
+  exits[3] = border_hash(x - 1, y, 1) % (MAX_ROW - 2) + 1;
 }
 
 /*******************************************************************************
@@ -46,10 +74,10 @@ Region::Region(int32_t N_exit_j, int32_t E_exit_i,
                int32_t S_exit_j, int32_t W_exit_i,
                int32_t place_center, int32_t place_mart)
 {
-  int32_t randy; // note... int num = (rand() % (upper - lower + 1)) + lower;
+  int32_t randy; // note... int num = (rng_rand() % (upper - lower + 1)) + lower;
 
   // create a random number of random seeds
-  int32_t num_seeds = (rand() % (MAX_SEEDS_PER_REGION - MIN_SEEDS_PER_REGION + 1)) 
+  int32_t num_seeds = (rng_rand() % (MAX_SEEDS_PER_REGION - MIN_SEEDS_PER_REGION + 1)) 
                       + MIN_SEEDS_PER_REGION;
 
   // allocate memory for seeds, each seed has x and y
@@ -57,24 +85,24 @@ Region::Region(int32_t N_exit_j, int32_t E_exit_i,
   
   // initialize each seed with a random set of cordinates
   // at least 2 grass and 2 clearings seeds. (req)
-  seed_arr[0].i = rand() % MAX_ROW;
-  seed_arr[0].j = rand() % MAX_COL;
+  seed_arr[0].i = rng_rand() % MAX_ROW;
+  seed_arr[0].j = rng_rand() % MAX_COL;
   seed_arr[0].ter = ter_clearing;
-  seed_arr[1].i = rand() % MAX_ROW;
-  seed_arr[1].j = rand() % MAX_COL;
+  seed_arr[1].i = rng_rand() % MAX_ROW;
+  seed_arr[1].j = rng_rand() % MAX_COL;
   seed_arr[1].ter = ter_clearing;
-  seed_arr[2].i = rand() % MAX_ROW;
-  seed_arr[2].j = rand() % MAX_COL;
+  seed_arr[2].i = rng_rand() % MAX_ROW;
+  seed_arr[2].j = rng_rand() % MAX_COL;
   seed_arr[2].ter = ter_grass; 
-  seed_arr[3].i = rand() % MAX_ROW;
-  seed_arr[3].j = rand() % MAX_COL;
+  seed_arr[3].i = rng_rand() % MAX_ROW;
+  seed_arr[3].j = rng_rand() % MAX_COL;
   seed_arr[3].ter = ter_grass;
 
   //  remaining seeds get random terrain type
   for (int32_t i = 4; i < num_seeds; i++) {
-    randy = rand() % 100; 
-    seed_arr[i].i = rand() % MAX_ROW;
-    seed_arr[i].j = rand() % MAX_COL;
+    randy = rng_rand() % 100; 
+    seed_arr[i].i = rng_rand() % MAX_ROW;
+    seed_arr[i].j = rng_rand() % MAX_COL;
     if (randy >= 0 && randy < 25) {
       seed_arr[i].ter = ter_grass;
     } else if (randy >= 25 && randy < 50) {
@@ -109,7 +137,7 @@ Region::Region(int32_t N_exit_j, int32_t E_exit_i,
 
         tile_arr[i][j].ter = seed_arr[closest_seed].ter;
         if (tile_arr[i][j].ter == ter_mixed) {
-          randy = rand() % 10;
+          randy = rng_rand() % 10;
           if (randy <= 3) {// 40%  grass
             tile_arr[i][j].ter = ter_grass;
           } else if (randy >= 4 && randy <= 6) { //30% clearing
@@ -129,25 +157,25 @@ Region::Region(int32_t N_exit_j, int32_t E_exit_i,
   // generate random exits if specified exit is -1.
   // exit cannot be a corner
   if (N_exit_j == -1) {
-    this->N_exit_j = (rand() % (MAX_COL - 2)) + 1;
+    this->N_exit_j = (rng_rand() % (MAX_COL - 2)) + 1;
   } else {
     this->N_exit_j = N_exit_j;
   }
   tile_arr[0][this->N_exit_j].ter = ter_path;
   if (E_exit_i == -1) {
-    this->E_exit_i = (rand() % (MAX_ROW - 2)) + 1;
+    this->E_exit_i = (rng_rand() % (MAX_ROW - 2)) + 1;
   } else {
     this->E_exit_i = E_exit_i;
   }
   tile_arr[this->E_exit_i][MAX_COL - 1].ter = ter_path;
   if (S_exit_j == -1) {
-    this->S_exit_j = (rand() % (MAX_COL - 2)) + 1;
+    this->S_exit_j = (rng_rand() % (MAX_COL - 2)) + 1;
   } else {
     this->S_exit_j = S_exit_j;
   }
   tile_arr[MAX_ROW - 1][this->S_exit_j].ter = ter_path;
   if (W_exit_i == -1) {
-    this->W_exit_i = (rand() % (MAX_ROW - 2)) + 1;
+    this->W_exit_i = (rng_rand() % (MAX_ROW - 2)) + 1;
   } else {
     this->W_exit_i = W_exit_i;
   }
@@ -182,7 +210,7 @@ Region::Region(int32_t N_exit_j, int32_t E_exit_i,
                                path_j, path_i);
     double dist_to_exit = dist(MAX_COL - 1, this->E_exit_i, path_j, path_i);
     E_path_weight = 0.2*(dist(seed_arr[closest_seed].j, seed_arr[closest_seed].i, path_j + 1, path_i) - dist_to_seed) // prefer terrain boarders
-                  + 0.5*(rand() % 10); // ensure random progress is made towards exit
+                  + 0.5*(rng_rand() % 10); // ensure random progress is made towards exit
     if (path_i - 1 != 0 && tile_arr[path_i - 1][path_j].ter != ter_path) {
       N_path_weight = 0.2*(dist(seed_arr[closest_seed].j, seed_arr[closest_seed].i, path_j,  path_i - 1) - dist_to_seed) // prefer terrain boarders
                     + 0.05*path_j*(dist_to_exit - dist(MAX_COL - 1, this->E_exit_i, path_j, path_i - 1)) // head towards the exit especially near the end
@@ -241,7 +269,7 @@ Region::Region(int32_t N_exit_j, int32_t E_exit_i,
                                path_j, path_i);
     double dist_to_exit = dist(this->S_exit_j, MAX_ROW - 1, path_j, path_i);
     S_path_weight = 0.2*(dist(seed_arr[closest_seed].j, seed_arr[closest_seed].i, path_j, path_i + 1) - dist_to_seed)
-                  + 0.5*(rand() % 10);
+                  + 0.5*(rng_rand() % 10);
     if (path_j + 1 != MAX_COL - 1 && tile_arr[path_i][path_j + 1].ter != ter_path) {
       E_path_weight = 0.2*(dist(seed_arr[closest_seed].j, seed_arr[closest_seed].i, path_j + 1,  path_i) - dist_to_seed)
                     + 0.1*path_i*(dist_to_exit - dist(this->S_exit_j, MAX_ROW - 1, path_j + 1, path_i))
@@ -263,7 +291,7 @@ Region::Region(int32_t N_exit_j, int32_t E_exit_i,
 
     // if we interest the W->E path, the follow it for a random amount of tiles
     if (tile_arr[path_i][path_j].ter == ter_path) {
-      int32_t num_tiles_to_trace = rand() % (MAX_COL/2);
+      int32_t num_tiles_to_trace = rng_rand() % (MAX_COL/2);
       // follow either E or W, whatever will lead us closer the the S exit
       int32_t heading = 1; // 1 is E, -1 is W
       if (path_j > S_exit_j) {
@@ -299,8 +327,8 @@ Region::Region(int32_t N_exit_j, int32_t E_exit_i,
   // poke centers must be placed next to a path'
   while (place_center != 0) {
     pos_t c_seed;
-    c_seed.i = (rand() % (MAX_ROW - 4)) + 1;
-    c_seed.j = (rand() % (MAX_COL - 4)) + 1;
+    c_seed.i = (rng_rand() % (MAX_ROW - 4)) + 1;
+    c_seed.j = (rng_rand() % (MAX_COL - 4)) + 1;
 
     if ( tile_arr[c_seed.i][c_seed.j].ter != ter_path
       && tile_arr[c_seed.i + 1][c_seed.j].ter != ter_path
@@ -326,8 +354,8 @@ Region::Region(int32_t N_exit_j, int32_t E_exit_i,
 
   while (place_mart != 0) {
     pos_t c_seed;
-    c_seed.i = (rand() % (MAX_ROW - 4)) + 1;
-    c_seed.j = (rand() % (MAX_COL - 4)) + 1;
+    c_seed.i = (rng_rand() % (MAX_ROW - 4)) + 1;
+    c_seed.j = (rng_rand() % (MAX_COL - 4)) + 1;
 
     if ( tile_arr[c_seed.i][c_seed.j].ter != ter_path
       && tile_arr[c_seed.i + 1][c_seed.j].ter != ter_path
@@ -355,7 +383,78 @@ Region::Region(int32_t N_exit_j, int32_t E_exit_i,
     }
   }
 
-  // Assign tile character symbols and colors
+  assign_tile_chars();
+}
+
+/*
+ * True if every exit is on its border and not in a corner
+ */
+bool valid_exits(int32_t N_exit_j, int32_t E_exit_i, 
+                 int32_t S_exit_j, int32_t W_exit_i) {
+  return N_exit_j >= 1 && N_exit_j <= MAX_COL - 2 
+      && S_exit_j >= 1 && S_exit_j <= MAX_COL - 2
+      && E_exit_i >= 1 && E_exit_i <= MAX_ROW - 2 
+      && W_exit_i >= 1 && W_exit_i <= MAX_ROW - 2;
+}
+
+/*
+ * Region constructor that restores a region and its trainers from a save file
+ * without generating anything
+ */
+Region::Region(SaveReader *in) {
+  N_exit_j = in->u8();
+  E_exit_i = in->u8();
+  S_exit_j = in->u8();
+  W_exit_i = in->u8();
+  if (!valid_exits(N_exit_j, E_exit_i, S_exit_j, W_exit_i)) {
+    in->fail();
+    N_exit_j = S_exit_j = 1;
+    E_exit_i = W_exit_i = 1;
+  }
+  uint8_t ter[MAX_ROW][MAX_COL];
+  in->rle(&ter[0][0], MAX_ROW * MAX_COL);
+  for (int32_t i = 0; i < MAX_ROW; i++) {
+    for (int32_t j = 0; j < MAX_COL; j++) {
+      // anything unknown is a wall rather than an index out of bounds
+      tile_arr[i][j].ter = ter[i][j] <= ter_mixed 
+                           ? static_cast<terrain_t>(ter[i][j]) : ter_border;
+    }
+  }
+  assign_tile_chars();
+
+  int32_t num_npcs = in->u16();
+  for (int32_t k = 0; k < num_npcs && in->good(); ++k) {
+    Npc *npc = arena.alloc_array<Npc>(1);
+    npc_arr.push_back(new (npc) Npc(&trainers, in, &arena));
+  }
+}
+
+/*
+ * Writes the region and its trainers to a save file
+ */
+void Region::save(SaveWriter *out) {
+  out->u8(N_exit_j);
+  out->u8(E_exit_i);
+  out->u8(S_exit_j);
+  out->u8(W_exit_i);
+  uint8_t ter[MAX_ROW][MAX_COL];
+  for (int32_t i = 0; i < MAX_ROW; i++) {
+    for (int32_t j = 0; j < MAX_COL; j++) {
+      ter[i][j] = tile_arr[i][j].ter;
+    }
+  }
+  out->rle(&ter[0][0], MAX_ROW * MAX_COL);
+
+  out->u16(npc_arr.size());
+  for (auto it = npc_arr.begin(); it != npc_arr.end(); ++it) {
+    (*it)->save(out);
+  }
+}
+
+/*
+ * Assigns every tile the character symbol and color of its terrain
+ */
+void Region::assign_tile_chars() {
   for (int32_t i = 0; i < MAX_ROW ; i++) {
     for (int32_t j = 0; j < MAX_COL; j++) {   
       switch (tile_arr[i][j].ter) {
@@ -403,6 +502,7 @@ Region::Region(int32_t N_exit_j, int32_t E_exit_i,
         tile_arr[i][j].ch =  CHAR_UNDEFINED;
         tile_arr[i][j].color = CHAR_COLOR_UNDEFINED;
       }
+      update_render_tile(i, j);
     }
   }
 }
@@ -412,25 +512,29 @@ Region::Region(int32_t N_exit_j, int32_t E_exit_i,
  * 
  * For random number of trainers, specify -1
  */
-void Region::populate(int32_t num_tnrs) 
+void Region::populate(int32_t num_tnrs, int32_t region_x, int32_t region_y) 
 {
   if (num_tnrs < 0) {
     // generate a random number of npcs to attempt to spawn
-    num_tnrs = (rand() % (MAX_TRAINERS - MIN_TRAINERS + 1)) + MIN_TRAINERS;
+    num_tnrs = (rng_rand() % (MAX_TRAINERS - MIN_TRAINERS + 1)) + MIN_TRAINERS;
   }
-  
+
+  // 1. place trainers and decide how many pokemon each one gets
+  // at least 1, then 60% chance for n+1 pokemon, max of 6 pokemon
+  std::vector<int32_t> party_sizes;
+  int32_t total_pokemon = 0;
   for (int32_t m = 0; m < num_tnrs; m++) {
     int32_t spawn_attempts = 5;
     while (spawn_attempts != 0) {
-      int32_t ti = (rand() % (MAX_ROW - 2)) + 1;
-      int32_t tj = (rand() % (MAX_COL - 2)) + 1;
+      int32_t ti = (rng_rand() % (MAX_ROW - 2)) + 1;
+      int32_t tj = (rng_rand() % (MAX_COL - 2)) + 1;
       trainer_t tt;
       if (m == 0) {
         tt = tnr_rival;
       } else if (m == 1) {
         tt = tnr_hiker;
       } else {
-        tt = static_cast<trainer_t>((rand() % (tnr_rand_walker - tnr_hiker + 1)) + tnr_hiker);
+        tt = static_cast<trainer_t>((rng_rand() % (tnr_rand_walker - tnr_hiker + 1)) + tnr_hiker);
       }
       int32_t is_valid = 1;
 
@@ -440,27 +544,22 @@ void Region::populate(int32_t num_tnrs)
       }
 
       // verify no other npcs occupy this space
-      if (is_valid) {
-        for (auto it = npc_arr.begin(); it != npc_arr.end(); ++it) {
-          if (it->get_i() == ti && it->get_j() == tj) {
-            is_valid = 0;
-            break;
-          }
-        }
+      if (is_valid && trainers.find(ti, tj) != -1) {
+        is_valid = 0;
       }
 
       int32_t tmt = turn_times[tile_arr[ti][tj].ter][tt];
 
       if (is_valid) {
-        npc_arr.push_back(Npc(tt, ti, tj, tmt));
-        
-        // give new trainer some pokemon 
-        // at least 1, then 60% chance for n+1 pokemon, max of 6 pokemon
-        npc_arr.back().add_pokemon(new Pokemon());
-        while (rand() % 100 < TRAINER_EXTRA_POKEMON_CHANCE
-            && npc_arr.back().get_party_size() < 6) {
-          npc_arr.back().add_pokemon(new Pokemon());
+        Npc *npc = arena.alloc_array<Npc>(1);
+        npc_arr.push_back(new (npc) Npc(&trainers, tt, ti, tj, tmt));
+
+        int32_t party_size = 1;
+        while (rng_rand() % 100 < TRAINER_EXTRA_POKEMON_CHANCE && party_size < 6) {
+          ++party_size;
         }
+        party_sizes.push_back(party_size);
+        total_pokemon += party_size;
 
         spawn_attempts = 0;
       } else {
@@ -469,6 +568,21 @@ void Region::populate(int32_t num_tnrs)
 
     }
   }
+
+  // 2. generate every trainer pokemon in one batch, contiguous in the arena.
+  // All of them share the level band of this region.
+  int32_t min_level, max_level;
+  level_range(m_dist(WORLD_SIZE/2, WORLD_SIZE/2, region_x, region_y),
+              &min_level, &max_level);
+  Pokemon *pool = arena.alloc_array<Pokemon>(total_pokemon);
+  int32_t n = 0;
+  for (size_t t = 0; t < party_sizes.size(); ++t) {
+    for (int32_t k = 0; k < party_sizes[t]; ++k, ++n) {
+      new (&pool[n]) Pokemon(min_level 
+                             + rng_rand() % (max_level - min_level + 1));
+      npc_arr[t]->add_pokemon(&pool[n]);
+    }
+  }
   return;
 }
 
@@ -481,6 +595,16 @@ char Region::get_ch(int32_t i, int32_t j) {
 int32_t Region::get_color(int32_t i, int32_t j) {
   return tile_arr[i][j].color;
 }
+const chtype* Region::get_render_row(int32_t i) {
+  return render_buf[i];
+}
+/*
+ * Rebuilds the cached screen character of a tile from its symbol and color
+ */
+void Region::update_render_tile(int32_t i, int32_t j) {
+  render_buf[i][j] = static_cast<unsigned char>(tile_arr[i][j].ch)
+                   | COLOR_PAIR(tile_arr[i][j].color);
+}
 int32_t Region::get_N_exit_j() {
   return N_exit_j;
 }
@@ -497,25 +621,69 @@ void Region::close_N_exit() {
   tile_arr[0][N_exit_j].ter = ter_border;
   tile_arr[0][N_exit_j].ch = CHAR_BORDER;
   tile_arr[0][N_exit_j].color = CHAR_COLOR_BORDER;
+  update_render_tile(0, N_exit_j);
+  dirty = true;
 }
 void Region::close_E_exit() {
   tile_arr[E_exit_i][MAX_COL - 1].ter = ter_border;
   tile_arr[E_exit_i][MAX_COL - 1].ch = CHAR_BORDER;
   tile_arr[E_exit_i][MAX_COL - 1].color = CHAR_COLOR_BORDER;
+  update_render_tile(E_exit_i, MAX_COL - 1);
+  dirty = true;
 }
 void Region::close_S_exit() {
   tile_arr[MAX_ROW - 1][S_exit_j].ter = ter_border;
   tile_arr[MAX_ROW - 1][S_exit_j].ch = CHAR_BORDER;
   tile_arr[MAX_ROW - 1][S_exit_j].color = CHAR_COLOR_BORDER;
+  update_render_tile(MAX_ROW - 1, S_exit_j);
+  dirty = true;
 }
 void Region::close_W_exit(){
   tile_arr[W_exit_i][0].ter = ter_border;
   tile_arr[W_exit_i][0].ch = CHAR_BORDER;
   tile_arr[W_exit_i][0].color = CHAR_COLOR_BORDER;
+  update_render_tile(W_exit_i, 0);
+  dirty = true;
 }
-std::vector<Character>* Region::get_npcs() {
+std::vector<Npc*>* Region::get_npcs() {
   return &npc_arr;
 }
+TrainerTable* Region::get_trainers() {
+  return &trainers;
+}
+Arena* Region::get_arena() {
+  return &arena;
+}
+/*
+ * Returns the cross-region pathfinding state, allocated the first time a 
+ * trainer in this region chases the player from outside it
+ */
+pursuit_t* Region::get_pursuit() {
+  if (pursuit == NULL) {
+    pursuit = arena.alloc_array<pursuit_t>(1);
+    pursuit->exit_cost_valid = false;
+    for (int32_t c = 0; c < 2; ++c) {
+      for (int32_t k = 0; k < 4; ++k) {
+        pursuit->exit_dist[c][k] = INT_MAX;
+      }
+      for (int32_t i = 0; i < MAX_ROW; ++i) {
+        for (int32_t j = 0; j < MAX_COL; ++j) {
+          pursuit->dist[c][i][j] = INT_MAX;
+        }
+      }
+    }
+  }
+  return pursuit;
+}
+bool Region::is_dirty() {
+  return dirty;
+}
+void Region::mark_dirty() {
+  dirty = true;
+}
+void Region::clear_dirty() {
+  dirty = false;
+}
 Region::~Region() {
   npc_arr.clear();
   return;
@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "config.h"
+#include "arena.h"
 #include "character.h"
 #include "heap.h"
 
@@ -37,21 +38,54 @@ typedef struct pos {
   int32_t i, j;
 } pos_t;
 
+/*
+ * Cross-region pathfinding state of a region, indexed by chaser (0 for 
+ * hikers, 1 for rivals) and exit (N, E, S, W). Derived from the terrain and 
+ * the player's position, so it is never saved.
+ */
+typedef struct pursuit {
+  // cost between the tiles just inside two exits, from exit_cost[c][to][from]
+  int32_t exit_cost[2][4][4];
+  bool exit_cost_valid;
+  // cost from the tile just inside each exit to the player, INT_MAX unless
+  // the way to the player leaves through that exit
+  int32_t exit_dist[2][4];
+  // cost from every tile to the player, through the neighbouring regions
+  int32_t dist[2][MAX_ROW][MAX_COL];
+} pursuit_t;
+
 class Region {
   private:
     tile_t tile_arr[MAX_ROW][MAX_COL];
+    // tile characters with their color attributes already applied, ready to be
+    // copied to the screen one row at a time
+    chtype render_buf[MAX_ROW][MAX_COL];
     int32_t N_exit_j, E_exit_i, S_exit_j, W_exit_i;
-    std::vector<Character> npc_arr;
+    // changed since the last autosave checkpoint
+    bool dirty = true;
+    // movement state of the npcs, row k belongs to npc_arr[k]
+    TrainerTable trainers;
+    // npcs and their pokemon live in the arena and are freed all at once with
+    // the region
+    std::vector<Npc*> npc_arr;
+    Arena arena;
+    pursuit_t *pursuit = NULL;
+
+    void update_render_tile(int32_t i, int32_t j);
+    void assign_tile_chars();
 
   public:
     Region(int32_t N_exit_j, int32_t E_exit_i,
            int32_t S_exit_j, int32_t W_exit_i,
            int32_t place_center, int32_t place_mart);
+    Region(SaveReader *in);
+    void      save(SaveWriter *out);
 
-    void      populate(int32_t num_tnrs);
+    void      populate(int32_t num_tnrs, int32_t region_x, int32_t region_y);
     terrain_t get_ter(int32_t i, int32_t j);
     char      get_ch(int32_t i, int32_t j);
     int32_t   get_color(int32_t i, int32_t j);
+    const chtype* get_render_row(int32_t i);
     int32_t   get_N_exit_j();
     int32_t   get_E_exit_i();
     int32_t   get_S_exit_j();
@@ -60,7 +94,13 @@ class Region {
     void      close_E_exit();
     void      close_S_exit();
     void      close_W_exit();
-    std::vector<Character>* get_npcs();
+    std::vector<Npc*>* get_npcs();
+    TrainerTable* get_trainers();
+    Arena*    get_arena();
+    pursuit_t* get_pursuit();
+    bool      is_dirty();
+    void      mark_dirty();
+    void      clear_dirty();
 
     ~Region();
 };
@@ -68,5 +108,8 @@ class Region {
 double dist(int32_t x1, int32_t y1, int32_t x2, int32_t y2);
 int32_t m_dist(int32_t x1, int32_t y1, int32_t x2, int32_t y2);
 int32_t rand_outcome(double probability) ;
+void border_exits(int32_t x, int32_t y, int32_t exits[4]);
+bool valid_exits(int32_t N_exit_j, int32_t E_exit_i, 
+                 int32_t S_exit_j, int32_t W_exit_i);
 
 #endif
\ No newline at end of file
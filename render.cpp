@@ -0,0 +1,481 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#include "config.h"
+#include "render.h"
+
+// marks a frame in the mailbox slot that the consumer has not taken yet
+#define FRAME_NEW 0x4
+
+RenderBackend *display = NULL;
+std::mutex curses_mutex;
+
+static FrameMailbox *render_mailbox = NULL;
+static RenderBackend *render_presenter = NULL;
+static std::thread render_thread;
+static std::mutex render_wake_mutex;
+static std::condition_variable render_wake;
+static std::atomic<bool> render_running(false);
+
+/*******************************************************************************
+* Abstract Render Backend Base-Class
+*******************************************************************************/
+RenderBackend::RenderBackend() {
+  cur_y = 0;
+  cur_x = 0;
+  attrs = A_NORMAL;
+}
+
+/*
+ * Moves the cursor forward one cell, wrapping to the next line like ncurses
+ */
+void RenderBackend::advance() {
+  if (++cur_x >= SCREEN_COLS) {
+    cur_x = 0;
+    if (++cur_y >= SCREEN_ROWS) {
+      cur_y = SCREEN_ROWS - 1;
+      cur_x = SCREEN_COLS - 1;
+    }
+  }
+}
+
+/*
+ * Blanks the screen. Backends that draw to a terminal may also force a full
+ * repaint on the next refresh.
+ */
+void RenderBackend::clear() {
+  erase();
+}
+
+/*
+ * Copies n cells to row y starting at column x, without moving the cursor
+ */
+void RenderBackend::addchnstr(int32_t y, int32_t x, const chtype *s, int32_t n) {
+  if (y < 0 || y >= SCREEN_ROWS) {
+    return;
+  }
+  for (int32_t k = 0; k < n && x + k < SCREEN_COLS; ++k) {
+    put(y, x + k, s[k]);
+  }
+}
+
+void RenderBackend::move(int32_t y, int32_t x) {
+  cur_y = y;
+  cur_x = x;
+}
+void RenderBackend::attron(attr_t a) {
+  attrs |= a;
+}
+void RenderBackend::attroff(attr_t a) {
+  attrs &= ~a;
+}
+
+void RenderBackend::addch(chtype c) {
+  if (cur_y < 0 || cur_y >= SCREEN_ROWS || cur_x < 0 || cur_x >= SCREEN_COLS) {
+    return;
+  }
+  if ((c & A_CHARTEXT) == '\n') {
+    clrtoeol();
+    cur_x = 0;
+    if (cur_y < SCREEN_ROWS - 1) {
+      ++cur_y;
+    }
+    return;
+  }
+  // attributes given with the character take priority, same as ncurses
+  if (c & A_COLOR) {
+    put(cur_y, cur_x, c | (attrs & ~A_COLOR));
+  } else {
+    put(cur_y, cur_x, c | attrs);
+  }
+  advance();
+}
+void RenderBackend::mvaddch(int32_t y, int32_t x, chtype c) {
+  move(y, x);
+  addch(c);
+}
+void RenderBackend::addstr(const char *s) {
+  for (; *s; ++s) {
+    addch(static_cast<unsigned char>(*s));
+  }
+}
+void RenderBackend::printw(const char *fmt, ...) {
+  char buf[SCREEN_ROWS * SCREEN_COLS + 1];
+  va_list ap;
+
+  va_start(ap, fmt);
+  vsnprintf(buf, sizeof (buf), fmt, ap);
+  va_end(ap);
+  addstr(buf);
+}
+void RenderBackend::mvprintw(int32_t y, int32_t x, const char *fmt, ...) {
+  char buf[SCREEN_ROWS * SCREEN_COLS + 1];
+  va_list ap;
+
+  move(y, x);
+  va_start(ap, fmt);
+  vsnprintf(buf, sizeof (buf), fmt, ap);
+  va_end(ap);
+  addstr(buf);
+}
+
+/*******************************************************************************
+* Ncurses Render Backend Sub-Class
+*******************************************************************************/
+void NcursesBackend::put(int32_t y, int32_t x, chtype c) {
+  std::lock_guard<std::mutex> lock(curses_mutex);
+  ::mvaddch(y, x, c);
+}
+void NcursesBackend::clear() {
+  std::lock_guard<std::mutex> lock(curses_mutex);
+  ::clear();
+}
+void NcursesBackend::erase() {
+  std::lock_guard<std::mutex> lock(curses_mutex);
+  ::erase();
+}
+void NcursesBackend::clrtoeol() {
+  std::lock_guard<std::mutex> lock(curses_mutex);
+  ::move(cur_y, cur_x);
+  ::clrtoeol();
+}
+void NcursesBackend::addchnstr(int32_t y, int32_t x,
+                               const chtype *s, int32_t n) {
+  std::lock_guard<std::mutex> lock(curses_mutex);
+  ::mvaddchnstr(y, x, s, n);
+}
+void NcursesBackend::refresh() {
+  std::lock_guard<std::mutex> lock(curses_mutex);
+  ::refresh();
+}
+
+/*******************************************************************************
+* In-Memory Framebuffer Render Backend Sub-Class
+*******************************************************************************/
+FramebufferBackend::FramebufferBackend() {
+  frame_cnt = 0;
+  erase();
+}
+
+void FramebufferBackend::put(int32_t y, int32_t x, chtype c) {
+  cells[y][x] = c;
+}
+void FramebufferBackend::erase() {
+  for (int32_t i = 0; i < SCREEN_ROWS; ++i) {
+    for (int32_t j = 0; j < SCREEN_COLS; ++j) {
+      cells[i][j] = ' ';
+    }
+  }
+}
+void FramebufferBackend::clrtoeol() {
+  if (cur_y < 0 || cur_y >= SCREEN_ROWS) {
+    return;
+  }
+  for (int32_t j = cur_x; j < SCREEN_COLS; ++j) {
+    cells[cur_y][j] = ' ';
+  }
+}
+void FramebufferBackend::addchnstr(int32_t y, int32_t x,
+                                   const chtype *s, int32_t n) {
+  if (y < 0 || y >= SCREEN_ROWS || x < 0 || x >= SCREEN_COLS) {
+    return;
+  }
+  if (n > SCREEN_COLS - x) {
+    n = SCREEN_COLS - x;
+  }
+  memcpy(&cells[y][x], s, n * sizeof (chtype));
+}
+void FramebufferBackend::refresh() {
+  ++frame_cnt;
+}
+
+chtype FramebufferBackend::get_cell(int32_t y, int32_t x) {
+  return cells[y][x];
+}
+const chtype* FramebufferBackend::get_row(int32_t y) {
+  return cells[y];
+}
+uint64_t FramebufferBackend::get_frame_cnt() {
+  return frame_cnt;
+}
+
+/*
+ * Returns the characters on screen, one line per row, with attributes
+ * stripped. Cells that hold no printable character are shown as spaces.
+ */
+std::string FramebufferBackend::snapshot() {
+  std::string s;
+  s.reserve(SCREEN_ROWS * (SCREEN_COLS + 1));
+  for (int32_t i = 0; i < SCREEN_ROWS; ++i) {
+    for (int32_t j = 0; j < SCREEN_COLS; ++j) {
+      char ch = cells[i][j] & A_CHARTEXT;
+      if (cells[i][j] & A_ALTCHARSET) {
+        // line drawing characters are only used for the scroll bar
+        ch = '|';
+      }
+      s.push_back((ch >= ' ' && ch <= '~') ? ch : ' ');
+    }
+    s.push_back('\n');
+  }
+  return s;
+}
+
+/*******************************************************************************
+* ANSI Escape Sequence Render Backend Sub-Class
+*******************************************************************************/
+AnsiBackend::AnsiBackend() {
+  presented_valid = false;
+  out.reserve(SCREEN_ROWS * SCREEN_COLS * 8);
+}
+
+void AnsiBackend::clear() {
+  erase();
+  presented_valid = false;
+}
+
+/*
+ * Appends the escape sequences needed to switch to the attributes of c
+ */
+void AnsiBackend::emit_attrs(chtype c) {
+  char seq[24];
+
+  out.append("\033[0");
+  if (c & A_BOLD) {
+    out.append(";1");
+  }
+  if (PAIR_NUMBER(c)) {
+    // color pairs are initialized with pair n as color n on the background
+    sprintf(seq, ";%d;%d", 30 + static_cast<int32_t>(PAIR_NUMBER(c)),
+            30 + 10 + CHAR_COLOR_BACKGROUND);
+    out.append(seq);
+  }
+  out.push_back('m');
+  out.append((c & A_ALTCHARSET) ? "\033(0" : "\033(B");
+}
+
+void AnsiBackend::refresh() {
+  const chtype attr_mask = A_ATTRIBUTES & ~A_CHARTEXT;
+  int32_t at_y = -1, at_x = -1;
+  chtype cur_attrs = ~static_cast<chtype>(0);
+  char seq[24];
+
+  out.clear();
+  if (!presented_valid) {
+    // hide the cursor and wipe whatever was there before
+    out.append("\033[?25l\033[2J");
+  }
+
+  for (int32_t i = 0; i < SCREEN_ROWS; ++i) {
+    for (int32_t j = 0; j < SCREEN_COLS; ++j) {
+      chtype c = cells[i][j];
+      if (presented_valid && presented[i][j] == c) {
+        continue;
+      }
+      if (at_y != i || at_x != j) {
+        sprintf(seq, "\033[%d;%dH", i + 1, j + 1);
+        out.append(seq);
+      }
+      if ((c & attr_mask) != cur_attrs) {
+        cur_attrs = c & attr_mask;
+        emit_attrs(c);
+      }
+      char ch = c & A_CHARTEXT;
+      out.push_back(ch ? ch : ' ');
+      presented[i][j] = c;
+      at_y = i;
+      at_x = j + 1;
+    }
+  }
+  presented_valid = true;
+
+  if (!out.empty()) {
+    out.append("\033[0m\033(B");
+    const char *p = out.data();
+    size_t left = out.size();
+    while (left > 0) {
+      ssize_t n = write(STDOUT_FILENO, p, left);
+      if (n <= 0) {
+        break;
+      }
+      p += n;
+      left -= n;
+    }
+  }
+  ++frame_cnt;
+}
+
+/*
+ * Returns a newly allocated render backend of the requested type
+ */
+RenderBackend* new_render_backend(render_mode_t mode) {
+  switch (mode) {
+    case render_ansi:
+      return new AnsiBackend();
+    case render_headless:
+      return new FramebufferBackend();
+    case render_ncurses:
+    default:
+      return new NcursesBackend();
+  }
+}
+
+/*******************************************************************************
+* Frame Mailbox
+*******************************************************************************/
+FrameMailbox::FrameMailbox() {
+  back = 0;
+  slot.store(1);
+  front = 2;
+  published_cnt.store(0);
+  coalesced_cnt.store(0);
+}
+
+/*
+ * Returns the frame the producer may currently write to
+ */
+frame_t* FrameMailbox::get_back() {
+  return &frames[back];
+}
+
+/*
+ * Hands the back frame to the consumer. If the previous frame in the slot was 
+ * never taken it is dropped and becomes the new back frame, and a full 
+ * repaint it asked for is carried over to the frame that replaces it.
+ */
+void FrameMailbox::publish() {
+  frame_t *f = &frames[back];
+  bool repaint = f->full_repaint;
+  uint32_t prev = slot.load(std::memory_order_acquire);
+  do {
+    // frames in the slot are only ever read, so the flag can be looked at 
+    // even if the consumer takes the frame at the same time
+    f->full_repaint = repaint || ((prev & FRAME_NEW) 
+                                  && frames[prev & ~FRAME_NEW].full_repaint);
+  } while (!slot.compare_exchange_weak(prev, back | FRAME_NEW, 
+                                       std::memory_order_acq_rel,
+                                       std::memory_order_acquire));
+  if (prev & FRAME_NEW) {
+    coalesced_cnt.fetch_add(1, std::memory_order_relaxed);
+  }
+  back = prev & ~FRAME_NEW;
+  published_cnt.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool FrameMailbox::has_new() {
+  return slot.load(std::memory_order_acquire) & FRAME_NEW;
+}
+
+/*
+ * Returns the newest published frame, or NULL if nothing new was published 
+ * since the last call. The frame stays valid until the next call.
+ */
+frame_t* FrameMailbox::take() {
+  if (!has_new()) {
+    return NULL;
+  }
+  front = slot.exchange(front, std::memory_order_acq_rel) & ~FRAME_NEW;
+  return &frames[front];
+}
+
+uint64_t FrameMailbox::get_published_cnt() {
+  return published_cnt.load(std::memory_order_relaxed);
+}
+uint64_t FrameMailbox::get_coalesced_cnt() {
+  return coalesced_cnt.load(std::memory_order_relaxed);
+}
+
+/*******************************************************************************
+* Frame Recorder Render Backend Sub-Class
+*******************************************************************************/
+FrameRecorder::FrameRecorder(FrameMailbox *mailbox) {
+  this->mailbox = mailbox;
+  pending_repaint = true;
+}
+
+void FrameRecorder::clear() {
+  erase();
+  pending_repaint = true;
+}
+
+void FrameRecorder::refresh() {
+  frame_t *f = mailbox->get_back();
+  memcpy(f->cells, cells, sizeof (cells));
+  f->full_repaint = pending_repaint;
+  pending_repaint = false;
+  mailbox->publish();
+  ++frame_cnt;
+
+  std::lock_guard<std::mutex> lock(render_wake_mutex);
+  render_wake.notify_one();
+}
+
+/*******************************************************************************
+* Render Thread
+*******************************************************************************/
+/*
+ * Copies a frame to the terminal through the presenting backend
+ */
+static void present_frame(frame_t *f) {
+  if (f->full_repaint) {
+    render_presenter->clear();
+  }
+  for (int32_t i = 0; i < SCREEN_ROWS; ++i) {
+    render_presenter->addchnstr(i, 0, f->cells[i], SCREEN_COLS);
+  }
+  render_presenter->refresh();
+}
+
+static void render_thread_main() {
+  frame_t *f;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(render_wake_mutex);
+      render_wake.wait_for(lock, std::chrono::microseconds(FRAMETIME), 
+        [] { return render_mailbox->has_new() || !render_running.load(); });
+    }
+    if ((f = render_mailbox->take())) {
+      present_frame(f);
+    } else if (!render_running.load()) {
+      return;
+    }
+  }
+}
+
+/*
+ * Starts presenting frames on a dedicated thread. After this call the global
+ * display records frames instead of drawing to the terminal directly, so a 
+ * slow terminal can never stall the simulation.
+ */
+void render_thread_start(render_mode_t mode) {
+  render_mailbox = new FrameMailbox();
+  render_presenter = new_render_backend(mode);
+  display = new FrameRecorder(render_mailbox);
+  render_running.store(true);
+  render_thread = std::thread(render_thread_main);
+}
+
+/*
+ * Presents the last published frame and stops the render thread.
+ * Safe to call when the render thread was never started.
+ */
+void render_thread_stop() {
+  if (!render_running.load()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(render_wake_mutex);
+    render_running.store(false);
+    render_wake.notify_one();
+  }
+  render_thread.join();
+}
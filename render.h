@@ -0,0 +1,168 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "config.h"
+
+typedef enum render_mode {
+  render_ncurses,
+  render_ansi,
+  render_headless
+} render_mode_t;
+
+/*
+ * Abstract render backend
+ *
+ * Mirrors the small subset of ncurses drawing calls used by the game. The
+ * cursor, attribute state and line wrapping are tracked here so that every
+ * backend only needs to implement the primitive cell operations.
+ */
+class RenderBackend {
+  protected:
+    int32_t cur_y, cur_x;
+    attr_t attrs;
+
+    virtual void put(int32_t y, int32_t x, chtype c) = 0;
+    void advance();
+
+  public:
+    RenderBackend();
+    virtual ~RenderBackend() {}
+
+    virtual void clear();
+    virtual void erase() = 0;
+    virtual void clrtoeol() = 0;
+    virtual void addchnstr(int32_t y, int32_t x, const chtype *s, int32_t n);
+    virtual void refresh() = 0;
+
+    void move(int32_t y, int32_t x);
+    void attron(attr_t a);
+    void attroff(attr_t a);
+    void addch(chtype c);
+    void mvaddch(int32_t y, int32_t x, chtype c);
+    void addstr(const char *s);
+    void printw(const char *fmt, ...)
+      __attribute__((format(printf, 2, 3)));
+    void mvprintw(int32_t y, int32_t x, const char *fmt, ...)
+      __attribute__((format(printf, 4, 5)));
+};
+
+/*
+ * Draws straight to the ncurses standard screen
+ */
+class NcursesBackend : public RenderBackend {
+  protected:
+    void put(int32_t y, int32_t x, chtype c);
+
+  public:
+    void clear();
+    void erase();
+    void clrtoeol();
+    void addchnstr(int32_t y, int32_t x, const chtype *s, int32_t n);
+    void refresh();
+};
+
+/*
+ * Keeps the screen in memory only. Used headless for benchmarks and for
+ * snapshotting screens without a terminal.
+ */
+class FramebufferBackend : public RenderBackend {
+  protected:
+    chtype cells[SCREEN_ROWS][SCREEN_COLS];
+    uint64_t frame_cnt;
+
+    void put(int32_t y, int32_t x, chtype c);
+
+  public:
+    FramebufferBackend();
+
+    void erase();
+    void clrtoeol();
+    void addchnstr(int32_t y, int32_t x, const chtype *s, int32_t n);
+    void refresh();
+
+    chtype get_cell(int32_t y, int32_t x);
+    const chtype* get_row(int32_t y);
+    uint64_t get_frame_cnt();
+    std::string snapshot();
+};
+
+/*
+ * Writes raw ANSI escape sequences to stdout. Only the cells that changed
+ * since the last refresh are emitted, and a whole frame goes out in a single
+ * write call.
+ */
+class AnsiBackend : public FramebufferBackend {
+  chtype presented[SCREEN_ROWS][SCREEN_COLS];
+  bool presented_valid;
+  std::string out;
+
+  void emit_attrs(chtype c);
+
+  public:
+    AnsiBackend();
+
+    void clear();
+    void refresh();
+};
+
+typedef struct frame {
+  chtype cells[SCREEN_ROWS][SCREEN_COLS];
+  bool full_repaint;
+} frame_t;
+
+/*
+ * Lock-free single-slot mailbox that hands finished frames from the 
+ * simulation to the render thread.
+ *
+ * Three frames rotate between the producer (back), the mailbox slot and the 
+ * consumer (front). Publishing swaps the back frame into the slot, so a frame 
+ * that was never picked up is simply overwritten by the newer one.
+ */
+class FrameMailbox {
+  frame_t frames[3];
+  std::atomic<uint32_t> slot;
+  uint32_t back, front;
+  std::atomic<uint64_t> published_cnt, coalesced_cnt;
+
+  public:
+    FrameMailbox();
+
+    frame_t* get_back();
+    void publish();
+    bool has_new();
+    frame_t* take();
+    uint64_t get_published_cnt();
+    uint64_t get_coalesced_cnt();
+};
+
+/*
+ * Draws into memory like the framebuffer backend, but every refresh publishes 
+ * an immutable copy of the screen to a mailbox for the render thread.
+ */
+class FrameRecorder : public FramebufferBackend {
+  FrameMailbox *mailbox;
+  bool pending_repaint;
+
+  public:
+    FrameRecorder(FrameMailbox *mailbox);
+
+    void clear();
+    void refresh();
+};
+
+// Global render backend that all render_* procedures draw to
+extern RenderBackend *display;
+// ncurses is not thread safe, every call into it once the input thread runs 
+// is made holding this
+extern std::mutex curses_mutex;
+
+RenderBackend* new_render_backend(render_mode_t mode);
+void render_thread_start(render_mode_t mode);
+void render_thread_stop();
+
+#endif
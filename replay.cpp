@@ -0,0 +1,273 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "config.h"
+#include "character.h"
+#include "region.h"
+#include "replay.h"
+
+extern Region *region_ptr[WORLD_SIZE][WORLD_SIZE];
+extern Pc *pc;
+extern uint64_t world_tick;
+
+/*
+ * Session log format, all integers little-endian
+ *
+ *   header:  "PKRP" | u8 version | u32 seed | u32 numtrainers
+ *   key:     varint ticks since previous key | varint (key + 1)
+ *   trailer: varint 0 | varint 0 | u64 state hash
+ *
+ * The trailer is only written when the game is quit normally, a log that ends
+ * without one is still replayable but its final state can't be verified.
+ */
+
+static FILE *record_f = NULL;
+static FILE *replay_f = NULL;
+static uint64_t last_key_tick = 0;
+static uint64_t keys_cnt = 0;
+
+static void write_u32(FILE *f, uint32_t v) {
+  for (int32_t b = 0; b < 4; ++b) {
+    fputc((v >> (8 * b)) & 0xff, f);
+  }
+}
+
+static void write_u64(FILE *f, uint64_t v) {
+  for (int32_t b = 0; b < 8; ++b) {
+    fputc((v >> (8 * b)) & 0xff, f);
+  }
+}
+
+static void write_varint(FILE *f, uint64_t v) {
+  while (v >= 0x80) {
+    fputc((v & 0x7f) | 0x80, f);
+    v >>= 7;
+  }
+  fputc(v, f);
+}
+
+/*
+ * Readers return false if the log ends early
+ */
+static bool read_u32(FILE *f, uint32_t *v) {
+  int32_t c;
+  *v = 0;
+  for (int32_t b = 0; b < 4; ++b) {
+    if ((c = fgetc(f)) == EOF) {
+      return false;
+    }
+    *v |= static_cast<uint32_t>(c) << (8 * b);
+  }
+  return true;
+}
+
+static bool read_u64(FILE *f, uint64_t *v) {
+  int32_t c;
+  *v = 0;
+  for (int32_t b = 0; b < 8; ++b) {
+    if ((c = fgetc(f)) == EOF) {
+      return false;
+    }
+    *v |= static_cast<uint64_t>(c) << (8 * b);
+  }
+  return true;
+}
+
+static bool read_varint(FILE *f, uint64_t *v) {
+  int32_t c;
+  *v = 0;
+  for (int32_t shift = 0; shift < 64; shift += 7) {
+    if ((c = fgetc(f)) == EOF) {
+      return false;
+    }
+    *v |= static_cast<uint64_t>(c & 0x7f) << shift;
+    if (!(c & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void fnv1a(uint64_t *h, int64_t v) {
+  for (int32_t b = 0; b < 8; ++b) {
+    *h ^= (v >> (8 * b)) & 0xff;
+    *h *= 0x100000001b3ULL;
+  }
+}
+
+/*
+ * Hashes the state a replay has to reproduce: the world clock, the player, 
+ * their party and bag, the region they are in with its trainers, and the 
+ * position of the random number generator.
+ */
+uint64_t state_hash() {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  Region *r = region_ptr[pc->get_x()][pc->get_y()];
+
+  fnv1a(&h, world_tick);
+  fnv1a(&h, pc->get_x());
+  fnv1a(&h, pc->get_y());
+  fnv1a(&h, pc->get_i());
+  fnv1a(&h, pc->get_j());
+  fnv1a(&h, pc->get_poke_dollars());
+
+  for (int32_t k = 0; k < pc->get_party_size(); ++k) {
+    Pokemon *p = pc->get_pokemon(k);
+    fnv1a(&h, p->get_pd_entry()->id);
+    fnv1a(&h, p->get_level());
+    fnv1a(&h, p->get_total_exp());
+    fnv1a(&h, p->get_current_hp());
+    for (int32_t m = 0; m < p->get_num_moves(); ++m) {
+      fnv1a(&h, p->get_move(m)->id);
+      fnv1a(&h, p->get_current_pp(m));
+    }
+  }
+
+  for (int32_t k = 0; k < pc->num_bag_slots(); ++k) {
+    bag_slot_t s = pc->peek_bag_slot(k);
+    fnv1a(&h, s.item);
+    fnv1a(&h, s.cnt);
+  }
+
+  for (int32_t i = 0; i < MAX_ROW; ++i) {
+    for (int32_t j = 0; j < MAX_COL; ++j) {
+      fnv1a(&h, r->get_ter(i, j));
+    }
+  }
+  TrainerTable *t = r->get_trainers();
+  for (int32_t k = 0; k < t->size(); ++k) {
+    fnv1a(&h, t->pos_i[k]);
+    fnv1a(&h, t->pos_j[k]);
+    fnv1a(&h, t->movetime[k]);
+    fnv1a(&h, (t->flags[k] & TNR_FLAG_DEFEATED) != 0);
+  }
+
+  // any divergence in the number of random draws shows up here
+  fnv1a(&h, rand());
+  return h;
+}
+
+/*
+ * Starts logging every consumed key to path
+ */
+void record_start(const char *path, int32_t seed, int32_t numtrainers) {
+  if (!(record_f = fopen(path, "wb"))) {
+    std::cout << "Error: Failed to open " << path << " for recording." 
+              << std::endl;
+    exit(-1);
+  }
+  fwrite(REPLAY_MAGIC, 1, 4, record_f);
+  fputc(REPLAY_VERSION, record_f);
+  write_u32(record_f, seed);
+  write_u32(record_f, numtrainers);
+  fflush(record_f);
+}
+
+void record_key(int32_t key) {
+  if (!record_f) {
+    return;
+  }
+  write_varint(record_f, world_tick - last_key_tick);
+  write_varint(record_f, static_cast<uint32_t>(key) + 1);
+  // flushed per key so the log survives a crash, which is when it is needed
+  fflush(record_f);
+  last_key_tick = world_tick;
+  ++keys_cnt;
+}
+
+/*
+ * Opens a session log for replay and returns the seed and trainer count that 
+ * the session was recorded with
+ */
+void replay_start(const char *path, int32_t *seed, int32_t *numtrainers) {
+  char magic[4];
+  uint32_t s, n;
+
+  if (!(replay_f = fopen(path, "rb"))) {
+    std::cout << "Error: Failed to open " << path << " for replay." 
+              << std::endl;
+    exit(-1);
+  }
+  if (fread(magic, 1, 4, replay_f) != 4 || memcmp(magic, REPLAY_MAGIC, 4)
+      || fgetc(replay_f) != REPLAY_VERSION
+      || !read_u32(replay_f, &s) || !read_u32(replay_f, &n)) {
+    std::cout << "Error: " << path << " is not a session log." << std::endl;
+    exit(-1);
+  }
+  *seed = s;
+  *numtrainers = n;
+}
+
+bool replay_active() {
+  return replay_f != NULL;
+}
+
+bool record_active() {
+  return record_f != NULL;
+}
+
+/*
+ * Returns the next key of the replayed session, exits if the log runs out
+ */
+int32_t replay_next_key() {
+  uint64_t delta, key;
+
+  if (!read_varint(replay_f, &delta) || !read_varint(replay_f, &key)) {
+    std::cout << "Replay ended after " << keys_cnt << " keys and " 
+              << world_tick << " ticks, no final state was recorded." 
+              << std::endl;
+    exit(0);
+  }
+  if (key == 0) {
+    printf("Replay diverged at key %llu: the recorded session quit here\n",
+           (unsigned long long) keys_cnt);
+    exit(-1);
+  }
+  if (last_key_tick + delta != world_tick) {
+    printf("Replay diverged at key %llu: tick %llu, recorded %llu\n",
+           (unsigned long long) keys_cnt, (unsigned long long) world_tick,
+           (unsigned long long) (last_key_tick + delta));
+    exit(-1);
+  }
+  last_key_tick = world_tick;
+  ++keys_cnt;
+  return key - 1;
+}
+
+/*
+ * Called when the game is quit. Seals the session log with the final state 
+ * when recording, or verifies the final state and exits when replaying.
+ */
+void replay_end() {
+  uint64_t delta, key, hash, replayed;
+
+  if (record_f) {
+    write_varint(record_f, 0);
+    write_varint(record_f, 0);
+    write_u64(record_f, state_hash());
+    fclose(record_f);
+    record_f = NULL;
+  }
+
+  if (replay_f) {
+    if (!read_varint(replay_f, &delta) || !read_varint(replay_f, &key)
+        || key != 0 || !read_u64(replay_f, &hash)) {
+      printf("Replay diverged: quit after %llu keys, the session went on\n",
+             (unsigned long long) keys_cnt);
+      exit(-1);
+    }
+    replayed = state_hash();
+    if (replayed != hash) {
+      printf("Replay diverged: state hash %016llx, recorded %016llx\n",
+             (unsigned long long) replayed, (unsigned long long) hash);
+      exit(-1);
+    }
+    printf("Replay OK: %llu keys, %llu ticks, state hash %016llx\n",
+           (unsigned long long) keys_cnt, (unsigned long long) world_tick,
+           (unsigned long long) hash);
+    exit(0);
+  }
+}
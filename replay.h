@@ -0,0 +1,18 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <cstdint>
+
+#define REPLAY_MAGIC "PKRP"
+#define REPLAY_VERSION 1
+
+void record_start(const char *path, int32_t seed, int32_t numtrainers);
+void record_key(int32_t key);
+void replay_start(const char *path, int32_t *seed, int32_t *numtrainers);
+bool replay_active();
+bool record_active();
+int32_t replay_next_key();
+void replay_end();
+uint64_t state_hash();
+
+#endif
@@ -0,0 +1,54 @@
+#include <cstdint>
+#include <cstdlib>
+
+#include "rng.h"
+
+// Each thread that seeds its own stream gets an independent generator, all 
+// other threads share the C library generator seeded by srand().
+static thread_local bool rng_local = false;
+static thread_local uint64_t rng_state;
+
+/*
+ * splitmix64, spreads nearby seeds far apart
+ */
+static uint64_t rng_mix(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/*
+ * Hashes key under seed, for values that have to be the same no matter who 
+ * asks or when
+ */
+uint64_t rng_hash(uint64_t seed, uint64_t key) {
+  return rng_mix(seed ^ rng_mix(key));
+}
+
+/*
+ * Gives the calling thread its own random number stream
+ */
+void rng_seed_thread(uint64_t seed) {
+  rng_state = rng_mix(seed);
+  if (rng_state == 0) {
+    rng_state = 1;
+  }
+  rng_local = true;
+}
+
+/*
+ * Drop in replacement for rand() used by the pokemon and battle rules. 
+ * Returns rand() unless the calling thread seeded its own stream, so the game
+ * itself draws the exact same sequence for a given --seed.
+ */
+int32_t rng_rand() {
+  if (!rng_local) {
+    return rand();
+  }
+  // xorshift64*
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return static_cast<int32_t>((rng_state * 0x2545f4914f6cdd1dULL) >> 33);
+}
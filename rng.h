@@ -0,0 +1,10 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+
+void rng_seed_thread(uint64_t seed);
+int32_t rng_rand();
+uint64_t rng_hash(uint64_t seed, uint64_t key);
+
+#endif
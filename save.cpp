@@ -0,0 +1,368 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "character.h"
+#include "region.h"
+#include "global_events.h"
+#include "save.h"
+
+extern Region *region_ptr[WORLD_SIZE][WORLD_SIZE];
+extern Pc *pc;
+extern uint64_t world_tick;
+extern uint64_t world_seed;
+
+/*
+ * Save file format, all integers little-endian
+ *
+ *   header:    "PKSV" | u8 version | u64 world tick | u64 world seed 
+ *              | u32 region count
+ *   player:    character | u16 region x | u16 region y | u32 poke dollars
+ *   region:    u16 x | u16 y | u8 exits N, E, S, W | rle terrain
+ *              | u16 npc count | npc character...
+ *   character: u8 trainer | u8 i | u8 j | u32 movetime | u8 dir | u8 flags 
+ *              | str nickname | u8 bag slots | (u8 item | u16 cnt)...
+ *              | u8 party size | pokemon...
+ *   pokemon:   u16 species | u8 level | u32 exp | u8 moves 
+ *              | (u16 move | u8 pp)... | u16 hp | u8 ivs[3] | u8 flags 
+ *              | str nickname
+ *   rle:       (u8 run length | u8 value)... covering every tile, row by row
+ *   str:       u8 length | chars, without the terminator
+ *
+ * Version 1 saves store the terrain as one u8 per tile and nicknames as
+ * char[13]. Version 1 and 2 saves have no world seed, new regions then take
+ * the exits of the regions next to them. Both are still loaded, and written
+ * back as the current version.
+ *
+ * Stats, tile symbols and the move queue are derived data and are rebuilt 
+ * when loading. Pokedex entries are stored as indices into the pokedex 
+ * tables, so a save is only valid with the pokedex it was written with.
+ */
+
+SaveWriter::SaveWriter(FILE *f, bool packed) {
+  this->f = f;
+  this->packed = packed;
+}
+void SaveWriter::u8(uint8_t v) {
+  fputc(v, f);
+}
+void SaveWriter::u16(uint16_t v) {
+  fputc(v & 0xff, f);
+  fputc(v >> 8, f);
+}
+void SaveWriter::u32(uint32_t v) {
+  for (int32_t b = 0; b < 4; ++b) {
+    fputc((v >> (8 * b)) & 0xff, f);
+  }
+}
+void SaveWriter::u64(uint64_t v) {
+  for (int32_t b = 0; b < 8; ++b) {
+    fputc((v >> (8 * b)) & 0xff, f);
+  }
+}
+void SaveWriter::bytes(const void *p, size_t n) {
+  fwrite(p, 1, n, f);
+}
+/*
+ * Writes n bytes as runs of equal bytes. Terrain is made of large blobs, so
+ * a region's tiles shrink to a few hundred bytes.
+ */
+void SaveWriter::rle(const uint8_t *p, size_t n) {
+  if (!packed) {
+    bytes(p, n);
+    return;
+  }
+  for (size_t k = 0; k < n; ) {
+    size_t run = 1;
+    while (k + run < n && run < UINT8_MAX && p[k + run] == p[k]) {
+      ++run;
+    }
+    u8(run);
+    u8(p[k]);
+    k += run;
+  }
+}
+/*
+ * Writes the string in s, a buffer of n chars
+ */
+void SaveWriter::str(const char *s, size_t n) {
+  if (!packed) {
+    bytes(s, n);
+    return;
+  }
+  size_t len = strnlen(s, n);
+  u8(len);
+  bytes(s, len);
+}
+
+SaveReader::SaveReader(FILE *f, bool packed) {
+  this->f = f;
+  this->packed = packed;
+  failed = false;
+}
+uint8_t SaveReader::u8() {
+  int32_t c = fgetc(f);
+  if (c == EOF) {
+    failed = true;
+    return 0;
+  }
+  return c;
+}
+uint16_t SaveReader::u16() {
+  uint16_t v = u8();
+  return v | (u8() << 8);
+}
+uint32_t SaveReader::u32() {
+  uint32_t v = 0;
+  for (int32_t b = 0; b < 4; ++b) {
+    v |= static_cast<uint32_t>(u8()) << (8 * b);
+  }
+  return v;
+}
+uint64_t SaveReader::u64() {
+  uint64_t v = 0;
+  for (int32_t b = 0; b < 8; ++b) {
+    v |= static_cast<uint64_t>(u8()) << (8 * b);
+  }
+  return v;
+}
+void SaveReader::bytes(void *p, size_t n) {
+  if (fread(p, 1, n, f) != n) {
+    failed = true;
+    memset(p, 0, n);
+  }
+}
+void SaveReader::rle(uint8_t *p, size_t n) {
+  if (!packed) {
+    bytes(p, n);
+    return;
+  }
+  for (size_t k = 0; k < n; ) {
+    size_t run = u8();
+    uint8_t v = u8();
+    if (!good() || run == 0 || run > n - k) {
+      failed = true;
+      memset(p + k, 0, n - k);
+      return;
+    }
+    memset(p + k, v, run);
+    k += run;
+  }
+}
+/*
+ * Reads a string into s, a buffer of n chars, padding it with terminators
+ */
+void SaveReader::str(char *s, size_t n) {
+  if (!packed) {
+    bytes(s, n);
+    return;
+  }
+  size_t len = u8();
+  if (len > n) {
+    failed = true;
+    len = 0;
+  }
+  bytes(s, len);
+  memset(s + len, 0, n - len);
+}
+/*
+ * Marks the save as damaged, for values that were read fine but make no sense
+ */
+void SaveReader::fail() {
+  failed = true;
+}
+bool SaveReader::good() {
+  return !failed;
+}
+
+/*
+ * Writes the whole world to path, streaming one region at a time.
+ * Returns false if the file could not be written.
+ */
+bool save_game(const char *path) {
+  FILE *f;
+  // written to a temporary file first so a failed save keeps the old one
+  char tmp_path[4096];
+  snprintf(tmp_path, sizeof (tmp_path), "%s.tmp", path);
+  if (!(f = fopen(tmp_path, "wb"))) {
+    return false;
+  }
+  setvbuf(f, NULL, _IOFBF, SAVE_BUFFER_SIZE);
+  SaveWriter out(f);
+
+  uint32_t num_regions = 0;
+  for (int32_t x = 0; x < WORLD_SIZE; ++x) {
+    for (int32_t y = 0; y < WORLD_SIZE; ++y) {
+      if (region_ptr[x][y] != NULL) {
+        ++num_regions;
+      }
+    }
+  }
+
+  out.bytes(SAVE_MAGIC, 4);
+  out.u8(SAVE_VERSION);
+  out.u64(world_tick);
+  out.u64(world_seed);
+  out.u32(num_regions);
+  pc->save(&out);
+
+  for (int32_t x = 0; x < WORLD_SIZE; ++x) {
+    for (int32_t y = 0; y < WORLD_SIZE; ++y) {
+      if (region_ptr[x][y] != NULL) {
+        out.u16(x);
+        out.u16(y);
+        region_ptr[x][y]->save(&out);
+      }
+    }
+  }
+
+  bool ok = !ferror(f);
+  ok = (fclose(f) == 0) && ok;
+  if (!ok || rename(tmp_path, path) != 0) {
+    remove(tmp_path);
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Restores the world saved in path, without generating anything. 
+ * Returns false if the file is missing, from another version or truncated.
+ */
+bool load_game(const char *path) {
+  FILE *f;
+  char magic[4];
+
+  if (!(f = fopen(path, "rb"))) {
+    return false;
+  }
+  setvbuf(f, NULL, _IOFBF, SAVE_BUFFER_SIZE);
+  // the header is the same in every version
+  SaveReader head(f);
+  head.bytes(magic, 4);
+  uint8_t version = head.u8();
+  if (!head.good() || memcmp(magic, SAVE_MAGIC, 4) 
+      || version < 1 || version > SAVE_VERSION) {
+    fclose(f);
+    return false;
+  }
+  SaveReader in(f, version >= 2);
+  world_tick = in.u64();
+  if (version >= 3) {
+    world_seed = in.u64();
+  }
+  uint32_t num_regions = in.u32();
+  pc = new Pc(&in);
+
+  bool ok = true;
+  for (uint32_t r = 0; r < num_regions && ok && in.good(); ++r) {
+    int32_t x = in.u16();
+    int32_t y = in.u16();
+    if (x >= WORLD_SIZE || y >= WORLD_SIZE || region_ptr[x][y] != NULL) {
+      ok = false;
+      break;
+    }
+    region_ptr[x][y] = new Region(&in);
+  }
+
+  fclose(f);
+  return ok && in.good() 
+         && pc->get_x() < WORLD_SIZE && pc->get_y() < WORLD_SIZE
+         && region_ptr[pc->get_x()][pc->get_y()] != NULL;
+}
+
+/*
+ * Serializes every region in regs, packed or not, into bufs. Returns the 
+ * time it took in seconds.
+ */
+static double bench_encode(std::vector<Region*> &regs, 
+                           std::vector<std::string> &bufs, bool packed) {
+  auto start = std::chrono::steady_clock::now();
+  bufs.clear();
+  for (auto it = regs.begin(); it != regs.end(); ++it) {
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream(&buf, &len);
+    SaveWriter out(f, packed);
+    (*it)->save(&out);
+    fclose(f);
+    bufs.push_back(std::string(buf, len));
+    free(buf);
+  }
+  std::chrono::duration<double> elapsed = 
+    std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+static double bench_decode(std::vector<std::string> &bufs, bool packed) {
+  auto start = std::chrono::steady_clock::now();
+  for (auto it = bufs.begin(); it != bufs.end(); ++it) {
+    FILE *f = fmemopen(&(*it)[0], it->size(), "rb");
+    SaveReader in(f, packed);
+    Region *r = new Region(&in);
+    fclose(f);
+    delete r;
+  }
+  std::chrono::duration<double> elapsed = 
+    std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+/*
+ * Generates num_regions regions around the center of the world, then 
+ * measures how small region snapshots get and how fast they are written and 
+ * read back, packed and unpacked. Throughput is in unpacked bytes, so the 
+ * two rows compare directly.
+ */
+void bench_compress(int32_t num_regions, int32_t num_tnr) {
+  int32_t c = WORLD_SIZE / 2;
+  std::vector<Region*> regs;
+
+  auto start = std::chrono::steady_clock::now();
+  region_ptr[c][c] = new Region(-1, -1, -1, -1, 1, 1);
+  pc = new Pc(c, c);
+  region_ptr[c][c]->populate(num_tnr, c, c);
+  regs.push_back(region_ptr[c][c]);
+  // ring by ring, so exits line up like they do for a player walking out
+  for (int32_t d = 1; d <= WORLD_SIZE && (int32_t) regs.size() < num_regions;
+       ++d) {
+    for (int32_t x = c - d; x <= c + d; ++x) {
+      int32_t dy = d - abs(x - c);
+      for (int32_t y = c - dy; y <= c + dy; y += (dy ? 2 * dy : 1)) {
+        if ((int32_t) regs.size() >= num_regions || x < 0 || y < 0 
+            || x >= WORLD_SIZE || y >= WORLD_SIZE) {
+          continue;
+        }
+        load_region(x, y, num_tnr);
+        regs.push_back(region_ptr[x][y]);
+      }
+    }
+  }
+  std::chrono::duration<double> elapsed = 
+    std::chrono::steady_clock::now() - start;
+  printf("Generated %d regions in %.2f s\n", (int32_t) regs.size(), 
+         elapsed.count());
+
+  std::vector<std::string> bufs;
+  double raw_bytes = 0;
+  printf("            bytes/region   ratio   encode MB/s   decode MB/s\n");
+  for (int32_t packed = 0; packed <= 1; ++packed) {
+    double enc = bench_encode(regs, bufs, packed);
+    double bytes = 0;
+    for (auto it = bufs.begin(); it != bufs.end(); ++it) {
+      bytes += it->size();
+    }
+    if (!packed) {
+      raw_bytes = bytes;
+    }
+    double dec = bench_decode(bufs, packed);
+    printf("  %-8s  %12.0f  %6.2f  %12.1f  %12.1f\n", 
+           packed ? "packed" : "unpacked", bytes / regs.size(), 
+           raw_bytes / bytes, raw_bytes / enc / 1e6, raw_bytes / dec / 1e6);
+  }
+}
@@ -0,0 +1,61 @@
+#ifndef SAVE_H
+#define SAVE_H
+
+#include <cstdint>
+#include <cstdio>
+
+#define SAVE_MAGIC "PKSV"
+#define SAVE_VERSION 3
+
+/*
+ * Little-endian writer over a buffered stdio stream
+ *
+ * Packed streams run-length encode terrain and store strings with their 
+ * length. Unpacked streams write both as fixed-size byte arrays, which is 
+ * the layout of version 1 saves.
+ */
+class SaveWriter {
+  FILE *f;
+  bool packed;
+
+  public:
+    SaveWriter(FILE *f, bool packed = true);
+
+    void u8(uint8_t v);
+    void u16(uint16_t v);
+    void u32(uint32_t v);
+    void u64(uint64_t v);
+    void bytes(const void *p, size_t n);
+    void rle(const uint8_t *p, size_t n);
+    void str(const char *s, size_t n);
+};
+
+/*
+ * Little-endian reader over a buffered stdio stream. Reads past the end of 
+ * the file return 0 and mark the reader as failed, so callers can read a 
+ * whole record and check good() once.
+ */
+class SaveReader {
+  FILE *f;
+  bool packed;
+  bool failed;
+
+  public:
+    SaveReader(FILE *f, bool packed = true);
+
+    uint8_t u8();
+    uint16_t u16();
+    uint32_t u32();
+    uint64_t u64();
+    void bytes(void *p, size_t n);
+    void rle(uint8_t *p, size_t n);
+    void str(char *s, size_t n);
+    void fail();
+    bool good();
+};
+
+bool save_game(const char *path);
+bool load_game(const char *path);
+void bench_compress(int32_t num_regions, int32_t num_tnr);
+
+#endif
@@ -0,0 +1,169 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "battle.h"
+#include "pokemon.h"
+#include "rng.h"
+#include "simulate.h"
+
+/*
+ * Generates a trainer party the same way regions populate trainers, with the 
+ * levels trainers get at a manhattan distance from the center of the world.
+ * Returns the party size.
+ */
+static int32_t generate_party(Pokemon *party[6], int32_t dist) {
+  int32_t min_level, max_level;
+  int32_t size = 0;
+
+  level_range(dist, &min_level, &max_level);
+  // at least 1, then a chance for n+1 pokemon, max of 6 pokemon
+  do {
+    party[size] = new Pokemon(min_level 
+                              + rng_rand() % (max_level - min_level + 1));
+    party[size]->set_has_owner(true);
+    ++size;
+  } while (rng_rand() % 100 < TRAINER_EXTRA_POKEMON_CHANCE && size < 6);
+  return size;
+}
+
+/*
+ * Returns the first pokemon in the party that can still battle, or NULL
+ */
+static Pokemon* next_active(Pokemon *party[6], int32_t size) {
+  for (int32_t i = 0; i < size; ++i) {
+    if (!party[i]->is_fainted()) {
+      return party[i];
+    }
+  }
+  return NULL;
+}
+
+static double hp_left(Pokemon *party[6], int32_t size) {
+  int32_t hp = 0, max_hp = 0;
+  for (int32_t i = 0; i < size; ++i) {
+    hp += party[i]->get_current_hp();
+    max_hp += party[i]->get_stat(stat_hp);
+  }
+  return max_hp ? static_cast<double>(hp) / max_hp : 0;
+}
+
+/*
+ * Plays battles between two randomly generated trainer parties until one runs 
+ * out of pokemon. Both sides pick their moves with the trainer AI.
+ */
+static void simulate_worker(int64_t num_battles, int32_t player_dist, 
+                            int32_t trainer_dist, uint64_t seed, 
+                            sim_result_t *result) {
+  Pokemon *player[6], *trainer[6];
+  int32_t player_size, trainer_size;
+
+  rng_seed_thread(seed);
+  for (int64_t n = 0; n < num_battles; ++n) {
+    player_size = generate_party(player, player_dist);
+    trainer_size = generate_party(trainer, trainer_dist);
+
+    Battle b(player[0], trainer[0], NULL, NULL);
+    int32_t turn;
+    for (turn = 0; turn < SIM_MAX_TURNS; ++turn) {
+      Pokemon *p_active = b.get_active(side_pc);
+      Pokemon *t_active = b.get_active(side_opp);
+      if (b.fight(p_active->ai_select_move_slot(t_active, TRAINER_AI_POLICY), 
+                  t_active->ai_select_move_slot(p_active, TRAINER_AI_POLICY))) {
+        Pokemon *p = next_active(player, player_size);
+        Pokemon *t = next_active(trainer, trainer_size);
+        if (p == NULL || t == NULL) {
+          if (p != NULL) {
+            ++result->player_wins;
+          }
+          break;
+        }
+        b.set_active(side_pc, p);
+        b.set_active(side_opp, t);
+      }
+    }
+    if (turn == SIM_MAX_TURNS) {
+      // only moves that deal no damage left
+      ++result->draws;
+    } else {
+      ++turn;
+    }
+
+    ++result->battles;
+    result->turns += turn;
+    result->player_hp_left += hp_left(player, player_size);
+    result->trainer_hp_left += hp_left(trainer, trainer_size);
+
+    for (int32_t i = 0; i < player_size; ++i) {
+      delete player[i];
+    }
+    for (int32_t i = 0; i < trainer_size; ++i) {
+      delete trainer[i];
+    }
+  }
+}
+
+/*
+ * Splits the battles over num_threads threads, each with its own random number
+ * stream derived from seed, and returns the combined results.
+ */
+sim_result_t simulate_battles(int64_t num_battles, int32_t player_dist,
+                              int32_t trainer_dist, uint64_t seed,
+                              int32_t num_threads) {
+  std::vector<sim_result_t> results(num_threads, sim_result_t());
+  std::vector<std::thread> threads;
+  sim_result_t total = sim_result_t();
+
+  for (int32_t t = 0; t < num_threads; ++t) {
+    int64_t share = num_battles / num_threads 
+                    + (t < num_battles % num_threads ? 1 : 0);
+    threads.push_back(std::thread(simulate_worker, share, player_dist, 
+                                  trainer_dist, seed + t, &results[t]));
+  }
+  for (int32_t t = 0; t < num_threads; ++t) {
+    threads[t].join();
+    total.battles += results[t].battles;
+    total.player_wins += results[t].player_wins;
+    total.draws += results[t].draws;
+    total.turns += results[t].turns;
+    total.player_hp_left += results[t].player_hp_left;
+    total.trainer_hp_left += results[t].trainer_hp_left;
+  }
+  return total;
+}
+
+/*
+ * Runs the simulator on every core and prints a report
+ */
+void simulate_driver(int64_t num_battles, int32_t player_dist, 
+                     int32_t trainer_dist, uint64_t seed) {
+  int32_t num_threads = std::thread::hardware_concurrency();
+  if (num_threads < 1) {
+    num_threads = 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  sim_result_t r = simulate_battles(num_battles, player_dist, trainer_dist, 
+                                    seed, num_threads);
+  std::chrono::duration<double> elapsed = 
+    std::chrono::steady_clock::now() - start;
+
+  if (r.battles == 0) {
+    printf("No battles simulated.\n");
+    return;
+  }
+  printf("Simulated %lld battles on %d threads in %.2f s (%.0f battles/s)\n",
+         (long long) r.battles, num_threads, elapsed.count(),
+         r.battles / elapsed.count());
+  printf("Player party at distance %d vs trainer party at distance %d\n",
+         player_dist, trainer_dist);
+  printf("  player win rate   %6.2f %%\n", 100.0 * r.player_wins / r.battles);
+  printf("  draws             %6.2f %%\n", 100.0 * r.draws / r.battles);
+  printf("  mean turns        %6.2f\n", (double) r.turns / r.battles);
+  printf("  player HP left    %6.2f %%\n", 100.0 * r.player_hp_left / r.battles);
+  printf("  trainer HP left   %6.2f %%\n", 
+         100.0 * r.trainer_hp_left / r.battles);
+}
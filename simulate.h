@@ -0,0 +1,21 @@
+#ifndef SIMULATE_H
+#define SIMULATE_H
+
+#include <cstdint>
+
+typedef struct sim_result {
+  int64_t battles;
+  int64_t player_wins;
+  int64_t draws;
+  int64_t turns;
+  double player_hp_left;  // sum of the fraction of party HP left at the end
+  double trainer_hp_left;
+} sim_result_t;
+
+sim_result_t simulate_battles(int64_t num_battles, int32_t player_dist,
+                              int32_t trainer_dist, uint64_t seed,
+                              int32_t num_threads);
+void simulate_driver(int64_t num_battles, int32_t player_dist, 
+                     int32_t trainer_dist, uint64_t seed);
+
+#endif
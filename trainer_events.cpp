@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <climits>
 #include <cstdint>
 #include <cstdlib>
@@ -8,12 +9,15 @@
 #include "config.h"
 #include "heap.h"
 #include "region.h"
+#include "pathfinding.h"
 #include "global_events.h"
 #include "trainer_events.h"
 #include "items.h"
+#include "battle.h"
 
 extern Region *region_ptr[WORLD_SIZE][WORLD_SIZE];
 extern Pc *pc;
+extern heap_t move_queue;
 extern int32_t dist_map_hiker[MAX_ROW][MAX_COL];
 extern int32_t dist_map_rival[MAX_ROW][MAX_COL];
 
@@ -52,7 +56,7 @@ void init_trainer_pq(heap_t *queue, Region *r) {
   heap_init(queue, movetime_cmp, NULL);
   heap_insert(queue, pc);
   for (auto it = r->get_npcs()->begin(); it != r->get_npcs()->end(); ++it) {
-    heap_insert(queue, (Character*) &(*it));
+    heap_insert(queue, (Character*) *it);
   }
 }
 
@@ -76,39 +80,6 @@ item_t bag_driver() {
   return item_empty;
 }
 
-/*
- * Determines if a catch is successful
- * https://bulbapedia.bulbagarden.net/wiki/Catch_rate#Capture_method_.28Generation_III-IV.29
- */
-bool is_catch_success(item_t ball, Pokemon *opp) {
-  float bonus_ball;
-  switch (ball) {
-    case item_poke_ball:
-      bonus_ball = 1;
-      break;
-    case item_great_ball:
-      bonus_ball = 1.5;
-      break;
-    case item_ultra_ball:
-      bonus_ball = 2;
-      break;
-    case item_master_ball:
-      // master ball has 100% catch rate
-      // bonus_ball = 255;
-      return true;
-    default:
-      // this item is not a poke ball
-      return false;
-  }
-  
-  float bonus_status = 1; // status effects are not implemented
-  int32_t a = ( (3 * opp->get_base_stat(stat_hp) - 2 * opp->get_current_hp())
-                * opp->get_pd_species_entry()->capture_rate * bonus_ball)
-              / (3.0 * opp->get_base_stat(stat_hp)) 
-              * bonus_status;
-  return (rand() % 256) <= a;
-}
-
 /*
  * Drives move selection of a specific pokemon
  * Returns scroller position.
@@ -144,35 +115,8 @@ int32_t use_item(Character *user, Pokemon *user_poke, Pokemon *opp_poke,
     case item_great_ball:
     case item_ultra_ball:
     case item_master_ball:
-      if (opp_poke != NULL) {
-        // we are in a battle
-        user->remove_item_from_bag(item, 1);
-        if (opp_poke->get_has_owner()) {
-          // We are in a battle with another trainer
-          sprintf(m1, "%s", catch_illegal_txt[rand() % NUM_CATCH_ILLEGAL_TXT]);
-          render_battle_message_getch(m1);
-        } else {
-          // We are in a battle with a wild encounter
-          sprintf(m1, "%s used %s", user->get_nickname(), item_name_txt[item]);
-          render_battle_message_getch(m1);
-          if (is_catch_success(item, opp_poke)) {
-            sprintf(m1, "Gotcha! %s was caught!", opp_poke->get_nickname());
-            render_battle_message_getch(m1);
-            if (user->get_party_size() < 6) {
-              user->add_pokemon(opp_poke);
-            } else {
-              // TODO: pokemon PC box mechanics. sent to box
-              sprintf(m1, "%s will be sent to BOX %d.", 
-                      opp_poke->get_nickname(), 1);
-              render_battle_message_getch(m1);
-            }
-          } else {
-            sprintf(m1, "Oh, no! The POKEMON broke free!");
-            render_battle_message_getch(m1);
-          }
-        }
-        return 0;
-      } else {
+      // balls are thrown by the battle driver, never through here
+      if (opp_poke == NULL) {
         // we are not in a battle
         render_bag_message("Can't use that here.");
       }
@@ -345,132 +289,126 @@ bool check_trainer_battle(int32_t to_i, int32_t to_j) {
     return false;
   }
 
-  for (auto it = r->get_npcs()->begin(); it != r->get_npcs()->end(); ++it) {
-    if (it->get_i() == to_i
-     && it->get_j() == to_j
-     && !(it->is_defeated())) {
-      battle_driver(pc, &(*it));
-      return true;
-    }
+  TrainerTable *t = r->get_trainers();
+  int32_t k = t->find(to_i, to_j);
+  if (k != -1 && !(t->flags[k] & TNR_FLAG_DEFEATED)) {
+    battle_driver(pc, r->get_npcs()->at(k));
+    return true;
   }
   return false;
 }
 
 /*
- * Process a single fighting turn.
- * Returns true if the defending pokemon fainted
+ * Battle listener that draws each battle event as it happens.
+ * ctx is the battle message buffer, the message of a used move is kept there
+ * until the outcome of the move is known.
  */
-bool do_fight_turn(Pokemon *attacker, int32_t attacking_move_slot, 
-                   Pokemon *defender, bool pc_is_attacker) {
-  int32_t damage;
-  float type;
-  bool critical;
-  char m[MAX_COL];
-  Pokemon *pc_poke, *opp_poke;
-
-  if (pc_is_attacker) {
-    pc_poke = attacker;
-    opp_poke = defender;
-  } else {
-    pc_poke = defender;
-    opp_poke = attacker;
-  }
-
-  if (!attacker->has_pp()) {
-    sprintf(m, "%s has no moves left!", attacker->get_nickname());
-    render_battle_message_getch(m);
-  }
-
-  if (pc_is_attacker) {
-    sprintf(m, "%s used %s!", attacker->get_nickname(), 
-            attacker->get_move(attacking_move_slot)->identifier);
-  } else {
-    if (!attacker->get_has_owner()) {
-      sprintf(m, "Wild %s used %s!", attacker->get_nickname(), 
-              attacker->get_move(attacking_move_slot)->identifier);
-    } else {
-      sprintf(m, "Foe %s used %s!", attacker->get_nickname(), 
-              attacker->get_move(attacking_move_slot)->identifier);
-    }
-  }
-
-  attacker->use_pp(attacking_move_slot);
-
-  if (is_miss(attacker->get_move(attacking_move_slot))) {
-    // MISS
-    render_battle_message_getch(m);
-    sprintf(m, "%s's attack missed!", attacker->get_nickname());
-    render_battle(pc_poke, opp_poke, m, false, 0, 0);
-  } else if (attacker->get_move(attacking_move_slot)->damage_class_id == 1) {
-    // STATUS MOVES ARE NOT IMPLEMENTED
-    render_battle_message_getch(m);
-    sprintf(m, "Status effects are not implemented yet. It had no effect!");
-    render_battle_getch(pc_poke, opp_poke, m, false, 0, 0);
-  } else {
-    // HIT
-    critical = is_critical(attacker, attacker->get_move(attacking_move_slot));
-    damage = calculate_damage(attacker, attacker->get_move(attacking_move_slot),
-                              defender, critical);
-    defender->take_damage(damage);
-    render_battle_message(m);
-    usleep(BATTLE_ANIMATION_TIME);
-    render_battle_getch(pc_poke, opp_poke, m, false, 0, 0);
-    type = effectiveness(attacker->get_move(attacking_move_slot), defender);
-    if (critical && type != 0) {
-      sprintf(m, "A critical hit!");
+static void render_battle_event(Battle *b, const battle_event_t *e, 
+                                void *ctx) {
+  char *m = (char*) ctx;
+  Pokemon *pc_poke = b->get_active(side_pc);
+  Pokemon *opp_poke = b->get_active(side_opp);
+
+  switch (e->type) {
+    case bev_no_pp:
+      sprintf(m, "%s has no moves left!", e->p->get_nickname());
+      render_battle_message_getch(m);
+      break;
+    case bev_use_move:
+      // shown together with the outcome of the move
+      if (e->side == side_pc) {
+        sprintf(m, "%s used %s!", e->p->get_nickname(), e->move->identifier);
+      } else if (b->is_wild()) {
+        sprintf(m, "Wild %s used %s!", e->p->get_nickname(), 
+                e->move->identifier);
+      } else {
+        sprintf(m, "Foe %s used %s!", e->p->get_nickname(), 
+                e->move->identifier);
+      }
+      break;
+    case bev_miss:
+      render_battle_message_getch(m);
+      sprintf(m, "%s's attack missed!", e->p->get_nickname());
+      render_battle(pc_poke, opp_poke, m, false, 0, 0);
+      break;
+    case bev_status:
+      render_battle_message_getch(m);
+      sprintf(m, "Status effects are not implemented yet. It had no effect!");
       render_battle_getch(pc_poke, opp_poke, m, false, 0, 0);
-    }
-    if (type > 1) {
-      sprintf(m, "It's super effective!");
+      break;
+    case bev_damage:
+      render_battle_message(m);
+      frame_sleep(BATTLE_ANIMATION_TIME);
       render_battle_getch(pc_poke, opp_poke, m, false, 0, 0);
-    } else if (type == 0) {
-      sprintf(m, "But it had no effect!");
+      break;
+    case bev_critical:
+      sprintf(m, "A critical hit!");
       render_battle_getch(pc_poke, opp_poke, m, false, 0, 0);
-    } else if (type < 1) {
-      sprintf(m, "It's not very effective...");
+      break;
+    case bev_effectiveness:
+      if (e->eff > 1) {
+        sprintf(m, "It's super effective!");
+      } else if (e->eff == 0) {
+        sprintf(m, "But it had no effect!");
+      } else {
+        sprintf(m, "It's not very effective...");
+      }
       render_battle_getch(pc_poke, opp_poke, m, false, 0, 0);
-    }
-    if (defender->is_fainted()) {
-      if (pc_is_attacker) {
-        if (!defender->get_has_owner()) {
-          sprintf(m, "Wild %s fainted!", defender->get_nickname());
-        } else {
-          sprintf(m, "Foe %s fainted!", defender->get_nickname());
-        }
+      break;
+    case bev_faint:
+      if (e->side == side_pc) {
+        sprintf(m, "%s fainted!", e->p->get_nickname());
+      } else if (b->is_wild()) {
+        sprintf(m, "Wild %s fainted!", e->p->get_nickname());
       } else {
-        sprintf(m, "%s fainted!", defender->get_nickname());
-        pc->set_defeated(pc->get_active_pokemon() == NULL);
+        sprintf(m, "Foe %s fainted!", e->p->get_nickname());
       }
       render_battle_getch(pc_poke, opp_poke, m, false, 0, 0);
-      return true;
-    }
-  }
-  return false;
-}
-
-/*
- * Process a battle turn for attempting to run from a pokemon
- * Returns True only if escape is successful.
- */
-bool attempt_escape (Pokemon *pc_active, Pokemon *opp, int32_t *attempts) {
-  if (opp->get_has_owner()) {
-    // escape failed
-    render_battle_message_getch(
-      "No! There's no running from a TRAINER battle!");
-    return false;
-  }
-
-  int32_t escape_odds = (pc_active->get_stat(stat_speed) * 32)
-                        / ((opp->get_stat(stat_speed) / 4) % 256) 
-                        + 30 * (*attempts);
-  if (rand() % 256 < escape_odds) {
-    // Escape was successful
-    render_battle_message_getch("Got away safely!");
-    return true;
+      break;
+    case bev_exp:
+      sprintf(m, "%s gained %d EXP. Points!", e->p->get_nickname(), e->value);
+      render_battle_message_getch(m);
+      break;
+    case bev_exp_step:
+      frame_sleep(BATTLE_ANIMATION_TIME);
+      render_battle(pc_poke, opp_poke, m, false, 0, 0);
+      break;
+    case bev_level_up:
+      frame_sleep(BATTLE_ANIMATION_TIME);
+      sprintf(m, "%s grew to LV. %d!", e->p->get_nickname(), e->value);
+      render_battle_getch(pc_poke, opp_poke, m, false, 0, 0);
+      break;
+    case bev_learn_move:
+      e->p->teach_move(e->move);
+      // screen must be redrawn completely after the teach move view
+      render_battle(pc_poke, opp_poke, m, false, 0, 0);
+      break;
+    case bev_catch_blocked:
+      sprintf(m, "%s", catch_illegal_txt[rand() % NUM_CATCH_ILLEGAL_TXT]);
+      render_battle_message_getch(m);
+      break;
+    case bev_catch:
+    case bev_catch_fail:
+      sprintf(m, "%s used %s", pc->get_nickname(), item_name_txt[e->item]);
+      render_battle_message_getch(m);
+      if (e->type == bev_catch) {
+        sprintf(m, "Gotcha! %s was caught!", e->p->get_nickname());
+      } else {
+        sprintf(m, "Oh, no! The POKEMON broke free!");
+      }
+      render_battle_message_getch(m);
+      break;
+    case bev_escape_blocked:
+      render_battle_message_getch(
+        "No! There's no running from a TRAINER battle!");
+      break;
+    case bev_escape:
+      render_battle_message_getch("Got away safely!");
+      break;
+    case bev_escape_fail:
+      render_battle_message_getch("Can't escape!");
+      break;
   }
-  // Escape failed
-  render_battle_message_getch("Can't escape!");
-  return false;
 }
 
 /*
@@ -483,13 +421,11 @@ void battle_driver(Pc *pc, Character *opp) {
   int32_t scroller_pos = 0;
   bool selected_fight = false;
   int32_t pc_move_slot, ai_move_slot;
-  int32_t priority;
-  bool pc_turn;
+  bool pc_turn = false;
   char m[MAX_COL];
   Pokemon *pc_active = pc->get_active_pokemon();
   Pokemon *opp_active;
   item_t selected_item;
-  int32_t esc_atempts = 0;
 
   if (opp == NULL) {
     // wild encounter
@@ -508,12 +444,15 @@ void battle_driver(Pc *pc, Character *opp) {
                         m, false, scroller_pos, selected_fight);
   }
 
+  Battle b(pc_active, opp_active, render_battle_event, m);
+
   while (!end_battle) {
     sprintf(m, "What will %s do?", pc_active->get_nickname());
     render_battle(pc_active, opp_active, m, true, scroller_pos, selected_fight);
 
     if (!pc_turn) {
-      ai_move_slot = opp_active->ai_select_move_slot();
+      ai_move_slot = opp_active->ai_select_move_slot(pc_active, 
+                     opp == NULL ? ai_random : TRAINER_AI_POLICY);
       pc_turn = true;
     }
 
@@ -537,28 +476,7 @@ void battle_driver(Pc *pc, Character *opp) {
           || !pc_active->has_pp()) {
         // selected move with pp or is struggling
         pc_move_slot = pc_active->has_pp() ? scroller_pos : -1;
-
-        priority = move_priority(
-                    pc_active->get_move(pc_move_slot)->priority, 
-                    pc_active->get_stat(stat_speed),
-                    opp_active->get_move(ai_move_slot)->priority, 
-                    opp_active->get_stat(stat_speed));
-          
-        if (priority > 0) {
-          pokemon_fainted = do_fight_turn(pc_active, pc_move_slot, 
-                                          opp_active, true);
-          if (!pokemon_fainted) {
-            pokemon_fainted = do_fight_turn(opp_active, ai_move_slot, 
-                                            pc_active, false);
-          }
-        } else {
-          pokemon_fainted = do_fight_turn(opp_active, ai_move_slot, 
-                                          pc_active, false);
-          if (!pokemon_fainted) {
-            pokemon_fainted = do_fight_turn(pc_active, pc_move_slot, 
-                                            opp_active, true);
-          }
-        }
+        pokemon_fainted = b.fight(pc_move_slot, ai_move_slot);
         pc_turn = false;
       } else {
         // selected move with no pp but is not struggling
@@ -572,14 +490,30 @@ void battle_driver(Pc *pc, Character *opp) {
     } else if (scroller_pos == 1) {
       selected_item = bag_driver();
       render_battle(pc_active, opp_active, m, false, 0, 0);
-      pc_turn = use_item(pc, pc_active, opp_active, selected_item);
-      render_battle(pc_active, opp_active, m, false, 0, 0);
-      if (opp_active->get_has_owner() && opp == NULL) {
-        // wild pokemon was caught... end battle
-        end_battle = 1;
-      } else if (!pc_turn) {
-        pokemon_fainted = do_fight_turn(opp_active, ai_move_slot, 
-                                        pc_active, false);
+      // the first items are all poke balls
+      if (selected_item >= item_poke_ball 
+       && selected_item <= item_master_ball) {
+        pc->remove_item_from_bag(selected_item, 1);
+        pc_turn = false;
+        if (b.throw_ball(selected_item)) {
+          if (!pc->add_pokemon(opp_active)) {
+            // TODO: pokemon PC box mechanics. sent to box
+            sprintf(m, "%s will be sent to BOX %d.", 
+                    opp_active->get_nickname(), 1);
+            render_battle_message_getch(m);
+            delete opp_active;
+          }
+          // wild pokemon was caught... end battle
+          end_battle = 1;
+        }
+      } else {
+        pc_turn = use_item(pc, pc_active, opp_active, selected_item);
+      }
+      if (!end_battle) {
+        render_battle(pc_active, opp_active, m, false, 0, 0);
+        if (!pc_turn) {
+          pokemon_fainted = b.attack(side_opp, ai_move_slot);
+        }
       }
     // POKEMON
     } else if (scroller_pos == 2) {
@@ -597,45 +531,27 @@ void battle_driver(Pc *pc, Character *opp) {
       }
 
       pc_active = pc->get_active_pokemon();
+      b.set_active(side_pc, pc_active);
       render_battle(pc_active, opp_active, m, false, 0, 0);
 
     if (!pc_turn && !opp_active->get_has_owner()) {
-      pokemon_fainted = do_fight_turn(opp_active, ai_move_slot, 
-                                      pc_active, false);
+      pokemon_fainted = b.attack(side_opp, ai_move_slot);
     }
     // RUN
     } else if (scroller_pos == 3) {
-      end_battle = pc_turn = attempt_escape(pc_active, opp_active, 
-                                            &esc_atempts);
+      end_battle = pc_turn = b.escape();
       if (!pc_turn) {
-        pokemon_fainted = do_fight_turn(opp_active, ai_move_slot, 
-                                        pc_active, false);
+        pokemon_fainted = b.attack(side_opp, ai_move_slot);
       }
     }
 
     if (pokemon_fainted) {
       // give exp and level up
       if (opp_active->is_fainted()) {
-        int32_t exp_gain = experience_gain(opp_active);
-        int32_t exp_for_this_level;
-        sprintf(m, "%s gained %d EXP. Points!", pc_active->get_nickname()
-                                              , exp_gain);
-        render_battle_message_getch(m);
-        while (exp_gain > 0) {
-          exp_for_this_level = min(pc_active->get_exp_next_level(), exp_gain);
-          exp_gain -= exp_for_this_level;
-          pc_active->give_exp(exp_for_this_level);
-          usleep(BATTLE_ANIMATION_TIME);
-          render_battle(pc_active, opp_active, m, false, 0, 0);
-          if (pc_active->process_level_up()) {
-            usleep(BATTLE_ANIMATION_TIME);
-            // pokemon leveled up, 
-            // screen must be redrawn completely incase a new move was learned
-            sprintf(m, "%s grew to LV. %d!", pc_active->get_nickname()
-                                           , pc_active->get_level());
-            render_battle_getch(pc_active, opp_active, m, false, 0, 0);
-          }
-        }
+        b.award_exp();
+      }
+      if (pc_active->is_fainted()) {
+        pc->set_defeated(pc->get_active_pokemon() == NULL);
       }
 
       if (pc->is_defeated()) {
@@ -653,6 +569,7 @@ void battle_driver(Pc *pc, Character *opp) {
         // player pokemon fainted... use next pokemon
         party_view_driver(2);
         pc_active = pc->get_pokemon(0);
+        b.set_active(side_pc, pc_active);
         sprintf(m, "Go! %s!", pc_active->get_nickname());
         render_battle_getch(pc_active, opp_active, m, false, 0, 0);
       } else if (opp == NULL) {
@@ -677,6 +594,7 @@ void battle_driver(Pc *pc, Character *opp) {
         } else {
           // opponent pokemon fainted... use next pokemon
           opp_active = opp->get_active_pokemon();
+          b.set_active(side_opp, opp_active);
           sprintf(m, "%s sent out %s!", 
                   opp->get_nickname(), opp_active->get_nickname());
           render_battle_getch(pc_active, opp_active, 
@@ -728,11 +646,8 @@ bool is_valid_location(int32_t to_i, int32_t to_j, trainer_t tnr) {
    && pc->get_j() == to_j) {
     return false;
   }
-  for (auto it = r->get_npcs()->begin(); it != r->get_npcs()->end(); ++it) {
-    if (it->get_i() == to_i
-     && it->get_j() == to_j) {
-        return false;
-      }
+  if (r->get_trainers()->find(to_i, to_j) != -1) {
+    return false;
   }
   if (tnr != tnr_pc && ( 
      to_i <= 0 || to_i >= MAX_ROW - 1 ||
@@ -757,11 +672,8 @@ bool is_valid_gradient(int32_t to_i, int32_t to_j,
   if (dist_map[to_i][to_j] == INT_MAX) {
     return false;
   }
-  for (auto it = r->get_npcs()->begin(); it != r->get_npcs()->end(); ++it) {
-    if (it->get_i() == to_i
-     && it->get_j() == to_j) {
-        return false;
-    }
+  if (r->get_trainers()->find(to_i, to_j) != -1) {
+    return false;
   }
   return true;
 }
@@ -769,82 +681,186 @@ bool is_valid_gradient(int32_t to_i, int32_t to_j,
 /*
  * Move a trainer along the maximum gradient
  *
+ * The flow map already has the closest neighbour of every tile, so unless 
+ * someone stands there this is one lookup. Otherwise the neighbours are 
+ * searched for the closest free one.
+ *
  * Friend of Character so that trainer locations can be updated 
  */
-void move_along_gradient(Character *c, int32_t dist_map[MAX_ROW][MAX_COL]) {
+void move_along_gradient(Character *c, int32_t dist_map[MAX_ROW][MAX_COL],
+                         uint8_t flow_map[MAX_ROW][MAX_COL]) {
   int32_t next_i = 0;
   int32_t next_j = 0;
-  int32_t max_gradient = INT_MAX;
-
-  // North
-  if (is_valid_gradient(c->pos_i - 1, c->pos_j    , dist_map)
-            && dist_map[c->pos_i - 1][c->pos_j    ] < max_gradient) {
-    max_gradient = dist_map[c->pos_i - 1][c->pos_j    ];
-    next_i = -1;
-    next_j = 0;
-  }
-  // East
-  if (is_valid_gradient(c->pos_i    , c->pos_j + 1, dist_map)
-            && dist_map[c->pos_i    ][c->pos_j + 1] < max_gradient) {
-    max_gradient = dist_map[c->pos_i    ][c->pos_j + 1];
-    next_i = 0;
-    next_j = 1;
-  }
-  // South
-  if (is_valid_gradient(c->pos_i + 1, c->pos_j    , dist_map)
-            && dist_map[c->pos_i + 1][c->pos_j    ] < max_gradient) {
-    max_gradient = dist_map[c->pos_i + 1][c->pos_j    ];
-    next_i = 1;
-    next_j = 0;
-  }
-  // West
-  if (is_valid_gradient(c->pos_i    , c->pos_j - 1, dist_map)
-            && dist_map[c->pos_i    ][c->pos_j - 1] < max_gradient) {
-    max_gradient = dist_map[c->pos_i    ][c->pos_j - 1];
-    next_i = 0;
-    next_j = -1;
-  }
-  // North East
-  if (is_valid_gradient(c->pos_i - 1, c->pos_j + 1, dist_map)
-            && dist_map[c->pos_i - 1][c->pos_j + 1] < max_gradient) {
-    max_gradient = dist_map[c->pos_i - 1][c->pos_j + 1];
-    next_i = -1;
-    next_j = 1;
-  }
-  // South East
-  if (is_valid_gradient(c->pos_i + 1, c->pos_j + 1, dist_map)
-            && dist_map[c->pos_i + 1][c->pos_j + 1] < max_gradient) {
-    max_gradient = dist_map[c->pos_i + 1][c->pos_j + 1];
-    next_i = 1;
-    next_j = 1;
-  }
-  // South West
-  if (is_valid_gradient(c->pos_i + 1, c->pos_j - 1, dist_map)
-            && dist_map[c->pos_i + 1][c->pos_j - 1] < max_gradient) {
-    max_gradient = dist_map[c->pos_i + 1][c->pos_j - 1];
-    next_i = 1;
-    next_j = -1;
-  }
-  // North West
-  if (is_valid_gradient(c->pos_i - 1, c->pos_j - 1, dist_map)
-            && dist_map[c->pos_i - 1][c->pos_j - 1] < max_gradient) {
-    max_gradient = dist_map[c->pos_i - 1][c->pos_j - 1];
-    next_i = -1;
-    next_j = -1;
+  uint8_t flow = flow_map[c->pos_i()][c->pos_j()];
+
+  if (flow != FLOW_NONE && is_valid_gradient(c->pos_i() + dir_offsets[flow][0],
+                                             c->pos_j() + dir_offsets[flow][1],
+                                             dist_map)) {
+    next_i = dir_offsets[flow][0];
+    next_j = dir_offsets[flow][1];
+  } else {
+    int32_t max_gradient = INT_MAX;
+    for (int32_t k = 0; k < 8; ++k) {
+      int32_t di = dir_offsets[gradient_order[k]][0];
+      int32_t dj = dir_offsets[gradient_order[k]][1];
+      if (is_valid_gradient(c->pos_i() + di, c->pos_j() + dj, dist_map)
+          && dist_map[c->pos_i() + di][c->pos_j() + dj] < max_gradient) {
+        max_gradient = dist_map[c->pos_i() + di][c->pos_j() + dj];
+        next_i = di;
+        next_j = dj;
+      }
+    }
   }
 
   // Check if initiating a battle
-  if (pc->get_i() == (c->pos_i + next_i)
-   && pc->get_j() == (c->pos_j + next_j)) {
+  if (pc->get_i() == (c->pos_i() + next_i)
+   && pc->get_j() == (c->pos_j() + next_j)) {
     battle_driver(pc, c);
     return;
   }
 
-  c->pos_i += next_i;
-  c->pos_j += next_j;
+  c->pos_i() += next_i;
+  c->pos_j() += next_j;
   return;
 }
 
+/*
+ * Takes the turn of a hiker or rival, row k of region r, that chases the 
+ * player from outside the player's region, following the region's pursuit 
+ * map. Only region r is touched, so regions can take their turns in parallel.
+ * Returns the exit the trainer stands just inside of on its way to the 
+ * player, for cross_region to take it through, or -1.
+ */
+int32_t pursue_player(Region *r, int32_t k) {
+  TrainerTable *t = r->get_trainers();
+  int32_t c = t->tnr[k] == tnr_rival;
+  pursuit_t *p = r->get_pursuit();
+  int32_t (*map)[MAX_COL] = p->dist[c];
+  int32_t i = t->pos_i[k];
+  int32_t j = t->pos_j[k];
+
+  t->movetime[k] += turn_times[r->get_ter(i, j)][t->tnr[k]];
+
+  for (int32_t e = 0; e < 4; ++e) {
+    int32_t ei, ej;
+    if (p->exit_dist[c][e] != INT_MAX && map[i][j] == p->exit_dist[c][e]
+        && exit_inner_tile(r, e, &ei, &ej) && ei == i && ej == j) {
+      return e;
+    }
+  }
+
+  int32_t best = map[i][j];
+  int32_t next_i = 0;
+  int32_t next_j = 0;
+  for (int32_t d = 0; d < 8; ++d) {
+    int32_t ti = i + dir_offsets[d][0];
+    int32_t tj = j + dir_offsets[d][1];
+    if (map[ti][tj] < best && t->find(ti, tj) == -1) {
+      best = map[ti][tj];
+      next_i = dir_offsets[d][0];
+      next_j = dir_offsets[d][1];
+    }
+  }
+  t->pos_i[k] += next_i;
+  t->pos_j[k] += next_j;
+  return -1;
+}
+
+/*
+ * Takes a trainer, row k of region rx, ry, through exit e into the next 
+ * region, unless someone stands in the way in. Only ever on the main thread,
+ * it changes two regions and the move queue.
+ * Returns true if the trainer left its region.
+ *
+ * Friend of Character so that trainers can be moved between regions
+ */
+bool cross_region(Region *r, int32_t rx, int32_t ry, int32_t k, int32_t e) {
+  Npc *npc = (*r->get_npcs())[k];
+  int32_t nx, ny, ni, nj;
+  exit_neighbor(rx, ry, e, &nx, &ny);
+  Region *to = region_ptr[nx][ny];
+  if (to == NULL || !exit_inner_tile(to, (e + 2) % 4, &ni, &nj)
+      || to->get_trainers()->find(ni, nj) != -1
+      || (nx == pc->get_x() && ny == pc->get_y() 
+          && pc->get_i() == ni && pc->get_j() == nj)) {
+    // wait for the way in to clear
+    return false;
+  }
+
+  // the trainer and its party move into the arena of the new region, the
+  // old copies are freed with the old one
+  Npc *moved = to->get_arena()->alloc_array<Npc>(1);
+  new (moved) Npc(*npc);
+  for (int32_t m = 0; m < npc->party_size; ++m) {
+    moved->party[m] = to->get_arena()->alloc_array<Pokemon>(1);
+    new (moved->party[m]) Pokemon(*npc->party[m]);
+  }
+  moved->table = to->get_trainers();
+  moved->slot = moved->table->add(npc->tnr, ni, nj, 
+                                  turn_times[to->get_ter(ni, nj)][npc->tnr]);
+  moved->dir() = npc->dir();
+  moved->table->flags[moved->slot] = npc->table->flags[npc->slot];
+  to->get_npcs()->push_back(moved);
+
+  std::vector<Npc*> *npcs = r->get_npcs();
+  int32_t last = r->get_trainers()->remove(k);
+  if (last != -1) {
+    (*npcs)[k] = (*npcs)[last];
+    (*npcs)[k]->slot = k;
+  }
+  npcs->pop_back();
+  r->mark_dirty();
+  to->mark_dirty();
+
+  if (nx == pc->get_x() && ny == pc->get_y()) {
+    // from now on it takes its turns with everyone else in the region
+    heap_insert(&move_queue, moved);
+  }
+  return true;
+}
+
+/*
+ * Advances the hikers and rivals of region r, which is not the player's, by 
+ * amount ticks. Those that reach the border on their way to the player are 
+ * added to crossings and wait there for the main thread to take them across.
+ */
+void step_pursuers(Region *r, int32_t amount, 
+                   std::vector<crossing_t> *crossings) {
+  TrainerTable *t = r->get_trainers();
+  for (int32_t k = 0; k < t->size(); ++k) {
+    if ((t->tnr[k] != tnr_hiker && t->tnr[k] != tnr_rival)
+        || (t->flags[k] & TNR_FLAG_DEFEATED)) {
+      continue;
+    }
+    t->movetime[k] -= amount;
+    while (t->movetime[k] <= 0) {
+      int32_t e = pursue_player(r, k);
+      if (e != -1) {
+        crossings->push_back({(*r->get_npcs())[k], e});
+        break;
+      }
+    }
+  }
+}
+
+/*
+ * Takes the trainers in crossings, all from region rx, ry, into the regions
+ * they are waiting to enter.
+ * Returns true if any of them left.
+ */
+bool cross_regions(int32_t rx, int32_t ry, 
+                   const std::vector<crossing_t> *crossings) {
+  Region *r = region_ptr[rx][ry];
+  bool crossed = false;
+  for (auto it = crossings->begin(); it != crossings->end(); ++it) {
+    // rows move as trainers leave, so look the trainer up again
+    std::vector<Npc*> *npcs = r->get_npcs();
+    int32_t k = std::find(npcs->begin(), npcs->end(), it->npc) - npcs->begin();
+    crossed |= cross_region(r, rx, ry, k, it->exit);
+  }
+  return crossed;
+}
+
 /*
  * Step player character and npc movetimes by amount
  */
@@ -853,9 +869,7 @@ void step_all_movetimes(Region *r, int32_t amount) {
     return;
   }
   pc->step_movetime(amount);
-  for (auto it = r->get_npcs()->begin(); it != r->get_npcs()->end(); ++it) {
-    it->step_movetime(amount);
-  }
+  r->get_trainers()->step_movetimes(amount);
   return;
 }
 
@@ -868,27 +882,27 @@ void step_all_movetimes(Region *r, int32_t amount) {
  * Friend of Pc (Player Character) class so that we can move the player
  */
 int32_t process_pc_move_attempt(direction_t dir) {
-  if (check_trainer_battle(pc->pos_i + dir_offsets[dir][0], 
-                   pc->pos_j + dir_offsets[dir][1])) {
+  if (check_trainer_battle(pc->pos_i() + dir_offsets[dir][0], 
+                   pc->pos_j() + dir_offsets[dir][1])) {
     return 0;
   }
 
-  if (is_valid_location(pc->pos_i + dir_offsets[dir][0], 
-                        pc->pos_j + dir_offsets[dir][1], tnr_pc)) {
-    pc->pos_i += dir_offsets[dir][0];
-    pc->pos_j += dir_offsets[dir][1];
+  if (is_valid_location(pc->pos_i() + dir_offsets[dir][0], 
+                        pc->pos_j() + dir_offsets[dir][1], tnr_pc)) {
+    pc->pos_i() += dir_offsets[dir][0];
+    pc->pos_j() += dir_offsets[dir][1];
 
     if (check_wild_encounter()) {
       return 0;
     }
 
-    if (pc->pos_i == 0) {
+    if (pc->pos_i() == 0) {
       ++(pc->reg_y);
-    } else if (pc->pos_i == MAX_ROW - 1) {
+    } else if (pc->pos_i() == MAX_ROW - 1) {
       --(pc->reg_y);
-    } else if (pc->pos_j == 0) {
+    } else if (pc->pos_j() == 0) {
       --(pc->reg_x);
-    } else if (pc->pos_j == MAX_COL - 1) {
+    } else if (pc->pos_j() == MAX_COL - 1) {
       ++(pc->reg_x);
     }
     return 0;
@@ -2,6 +2,7 @@
 #define TRAINER_EVENTS_H
 
 #include <cstdint>
+#include <vector>
 
 #include "heap.h"
 #include "region.h"
@@ -14,6 +15,12 @@ typedef enum battle {
   encounter
 } battle_t;
 
+// A chaser waiting just inside exit (N, E, S, W) of its region to cross it
+typedef struct crossing {
+  Npc *npc;
+  int32_t exit;
+} crossing_t;
+
 void init_trainer_pq(heap_t *queue, Region *r);
 item_t bag_driver();
 void battle_driver(Pc *pc, Character *opp);
@@ -22,7 +29,14 @@ void check_encounter (Pc *pc);
 bool is_valid_location(int32_t to_i, int32_t to_j, trainer_t tnr);
 bool is_valid_gradient(int32_t to_i, int32_t to_j, 
                        int32_t dist_map[MAX_ROW][MAX_COL]);
-void move_along_gradient(Character *c, int32_t dist_map[MAX_ROW][MAX_COL]);
+void move_along_gradient(Character *c, int32_t dist_map[MAX_ROW][MAX_COL],
+                         uint8_t flow_map[MAX_ROW][MAX_COL]);
+int32_t pursue_player(Region *r, int32_t k);
+bool cross_region(Region *r, int32_t rx, int32_t ry, int32_t k, int32_t e);
+void step_pursuers(Region *r, int32_t amount, 
+                   std::vector<crossing_t> *crossings);
+bool cross_regions(int32_t rx, int32_t ry, 
+                   const std::vector<crossing_t> *crossings);
 void step_all_movetimes(Region *r, int32_t amount);
 int32_t process_pc_move_attempt(direction_t dir);
 int32_t party_view_driver(int32_t scenario);
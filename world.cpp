@@ -0,0 +1,669 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "character.h"
+#include "region.h"
+#include "save.h"
+#include "world.h"
+
+extern Region *region_ptr[WORLD_SIZE][WORLD_SIZE];
+extern Pc *pc;
+extern uint64_t world_tick;
+extern uint64_t world_seed;
+
+/*
+ * World file layout, mapped into memory as a whole
+ *
+ *   header:  two copies of world_header_t, half a page apart | two player
+ *            records of up to WORLD_PLAYER_SIZE/2 bytes
+ *   index:   u32 per region in x major order, 0 if the region is not stored,
+ *            else its record slot + 1
+ *   records: fixed-size slots of record_size bytes,
+ *            world_record_t | region as written by Region::save
+ *
+ * The header, index and record headers are in native byte order. Player and
+ * region payloads use the little-endian save file encoding, unpacked in 
+ * version 1 world files. The index is left as a hole in the file until 
+ * regions are stored, so only the pages of visited parts of the world take 
+ * up space on disk or in memory.
+ *
+ * Nothing that is in use is ever written over. Regions leaving memory
+ * between checkpoints are written to spare slots that the index does not
+ * point at yet. A checkpoint writes the changed regions and the player the
+ * same way, waits for them to reach the disk, switches the index over and
+ * commits by writing the spare header copy with the next generation.
+ * Opening takes the newest header copy whose checksum matches. A record
+ * newer than that header was switched to by a checkpoint that never
+ * committed, so the index goes back to the record it replaced, whose slot
+ * is only reused once a later header is on disk. A crash thus leaves the
+ * player and every region as of the same checkpoint. Version 1 and 2 files
+ * have a single header and player record written in place and no
+ * checksums.
+ */
+typedef struct world_header {
+  char magic[4];
+  uint32_t version;
+  uint32_t world_size;
+  uint32_t record_size;
+  // slots ever taken, the file has room for more
+  uint32_t slot_cnt;
+  uint32_t player_len;
+  uint64_t world_tick;
+  // 0 in files from before exits were derived from it
+  uint64_t world_seed;
+  // version 3: checkpoint that wrote this copy, its player record and the
+  // checksums of both
+  uint64_t gen;
+  uint32_t player_sum;
+  uint32_t sum;
+} world_header_t;
+
+typedef struct world_record {
+  uint32_t len;
+  uint16_t x;
+  uint16_t y;
+  // version 3: generation of the checkpoint that wrote the record, the slot
+  // + 1 of the record it replaces, and the checksum of the record header up 
+  // to here and the payload
+  uint32_t gen;
+  uint32_t prev;
+  uint32_t sum;
+} world_record_t;
+
+#define WORLD_PAGE_SIZE 4096
+#define WORLD_PLAYER_SIZE 4096
+#define WORLD_INDEX_OFFSET (WORLD_PAGE_SIZE + WORLD_PLAYER_SIZE)
+#define WORLD_INDEX_SIZE ((WORLD_SIZE * WORLD_SIZE * sizeof (uint32_t) \
+                          + WORLD_PAGE_SIZE - 1) & ~(WORLD_PAGE_SIZE - 1))
+#define WORLD_DATA_OFFSET (WORLD_INDEX_OFFSET + WORLD_INDEX_SIZE)
+// version 1 and 2 record headers end before gen
+#define WORLD_OLD_RECORD_HEADER offsetof(world_record_t, gen)
+
+static int world_fd = -1;
+static uint8_t *world_base = NULL;
+static size_t world_len = 0;
+static uint32_t record_size = 0;
+static uint32_t record_header = 0;
+static uint32_t slot_capacity = 0;
+static bool world_packed = true;
+static bool world_versioned = true;
+static uint64_t last_checkpoint_tick = 0;
+// the newest header on disk, changed in memory and written out as a whole
+static world_header_t hdr;
+// Slots nothing points to, and slots the last checkpoint switched away 
+// from, which a crash could still need until its header is on disk
+static std::vector<uint32_t> free_slots;
+static std::vector<uint32_t> retired_slots;
+// Regions written out of memory since the last checkpoint, by region, which
+// the index only points at once the next checkpoint commits them
+static std::map<int32_t, uint32_t> pending;
+// Regions kept in memory, least recently used first
+static std::vector<int32_t> resident;
+
+static uint32_t fnv1a32(const void *p, size_t n, uint32_t h = 0x811c9dc5) {
+  const uint8_t *b = static_cast<const uint8_t*>(p);
+  for (size_t k = 0; k < n; ++k) {
+    h ^= b[k];
+    h *= 0x01000193;
+  }
+  return h;
+}
+
+static uint32_t* region_index() {
+  return reinterpret_cast<uint32_t*>(world_base + WORLD_INDEX_OFFSET);
+}
+
+static uint8_t* record(uint32_t slot) {
+  return world_base + WORLD_DATA_OFFSET + static_cast<size_t>(slot) * record_size;
+}
+
+/*
+ * Where header copy and player record number copy live
+ */
+static world_header_t* header_copy(uint64_t copy) {
+  return reinterpret_cast<world_header_t*>(
+    world_base + (world_versioned ? (copy & 1) * WORLD_PAGE_SIZE / 2 : 0));
+}
+
+static uint8_t* player_copy(uint64_t copy) {
+  return world_base + WORLD_PAGE_SIZE 
+         + (world_versioned ? (copy & 1) * WORLD_PLAYER_SIZE / 2 : 0);
+}
+
+static uint32_t player_capacity() {
+  return world_versioned ? WORLD_PLAYER_SIZE / 2 : WORLD_PLAYER_SIZE;
+}
+
+static uint32_t header_sum(const world_header_t *h) {
+  return fnv1a32(h, offsetof(world_header_t, sum));
+}
+
+/*
+ * Returns the record slot of region x, y, or -1 if it is not stored
+ */
+static int32_t lookup(int32_t x, int32_t y) {
+  if (x < 0 || y < 0 || x >= WORLD_SIZE || y >= WORLD_SIZE) {
+    return -1;
+  }
+  uint32_t e = region_index()[x * WORLD_SIZE + y];
+  if (e == 0 || e > hdr.slot_cnt) {
+    return -1;
+  }
+  return e - 1;
+}
+
+/*
+ * Returns the payload of the record in slot and its length, or NULL if the
+ * record is damaged or not the one of region x, y
+ */
+static uint8_t* slot_payload(int32_t slot, int32_t x, int32_t y, 
+                             uint32_t *len) {
+  world_record_t *rec = reinterpret_cast<world_record_t*>(record(slot));
+  uint8_t *payload = record(slot) + record_header;
+  if (rec->x != x || rec->y != y || rec->len > record_size - record_header
+      || (world_versioned 
+          && rec->sum != fnv1a32(payload, rec->len, 
+                                 fnv1a32(rec, offsetof(world_record_t, sum))))) {
+    return NULL;
+  }
+  *len = rec->len;
+  return payload;
+}
+
+/*
+ * Returns the slot of the newest record of region x, y, committed or not, 
+ * or -1 if it is not stored
+ */
+static int32_t stored_slot(int32_t x, int32_t y) {
+  auto it = pending.find(x * WORLD_SIZE + y);
+  return it != pending.end() ? static_cast<int32_t>(it->second) : lookup(x, y);
+}
+
+/*
+ * Returns the payload of the newest record of region x, y and its length, 
+ * or NULL if the region is not stored or its record is damaged
+ */
+static uint8_t* record_payload(int32_t x, int32_t y, uint32_t *len) {
+  int32_t slot = stored_slot(x, y);
+  return slot < 0 ? NULL : slot_payload(slot, x, y, len);
+}
+
+/*
+ * Extends the file and the mapping by a batch of empty record slots
+ */
+static bool grow() {
+  uint32_t capacity = slot_capacity ? slot_capacity * 2 : WORLD_GROW_SLOTS;
+  size_t len = WORLD_DATA_OFFSET + static_cast<size_t>(capacity) * record_size;
+  if (ftruncate(world_fd, len) != 0) {
+    return false;
+  }
+  void *p = mremap(world_base, world_len, len, MREMAP_MAYMOVE);
+  if (p == MAP_FAILED) {
+    return false;
+  }
+  world_base = static_cast<uint8_t*>(p);
+  world_len = len;
+  slot_capacity = capacity;
+  return true;
+}
+
+/*
+ * Writes region x, y to a spare slot without publishing it, as the next 
+ * generation. Returns the slot, or -1 if the region does not fit in one.
+ */
+static int32_t write_record(int32_t x, int32_t y) {
+  char *buf = NULL;
+  size_t len = 0;
+  FILE *f = open_memstream(&buf, &len);
+  SaveWriter out(f, world_packed);
+  region_ptr[x][y]->save(&out);
+  fclose(f);
+
+  int32_t slot = -1;
+  if (len > record_size - record_header) {
+    // too big for a record slot
+  } else if (!free_slots.empty()) {
+    slot = free_slots.back();
+    free_slots.pop_back();
+  } else if (hdr.slot_cnt < slot_capacity || grow()) {
+    slot = hdr.slot_cnt++;
+  }
+  if (slot >= 0) {
+    world_record_t *rec = reinterpret_cast<world_record_t*>(record(slot));
+    rec->len = len;
+    rec->x = x;
+    rec->y = y;
+    memcpy(record(slot) + record_header, buf, len);
+    if (world_versioned) {
+      rec->gen = hdr.gen + 1;
+      rec->prev = lookup(x, y) + 1;
+      rec->sum = fnv1a32(buf, len, fnv1a32(rec, offsetof(world_record_t, sum)));
+    }
+  }
+  if (slot >= 0) {
+    region_ptr[x][y]->clear_dirty();
+  }
+  free(buf);
+  return slot;
+}
+
+/*
+ * Makes slot the newest record of region x, y until the next checkpoint. A
+ * record it replaces was never published, so its slot is free right away.
+ */
+static void keep_pending(int32_t x, int32_t y, int32_t slot) {
+  auto it = pending.find(x * WORLD_SIZE + y);
+  if (it != pending.end()) {
+    free_slots.push_back(it->second);
+    it->second = slot;
+  } else {
+    pending[x * WORLD_SIZE + y] = slot;
+  }
+}
+
+/*
+ * Points the index of region x, y at slot, which has to be on disk already.
+ * Its old slot is only reused once the header committing slot is on disk.
+ */
+static void publish_record(int32_t x, int32_t y, int32_t slot) {
+  int32_t old = lookup(x, y);
+  region_index()[x * WORLD_SIZE + y] = slot + 1;
+  if (old >= 0) {
+    retired_slots.push_back(old);
+  }
+}
+
+static bool header_ok(const world_header_t *h) {
+  return !memcmp(h->magic, WORLD_MAGIC, 4) && h->version >= 3 
+         && h->version <= WORLD_VERSION && h->sum == header_sum(h);
+}
+
+/*
+ * Picks the newest intact header copy. Version 1 and 2 files have only one.
+ */
+static bool read_header() {
+  world_header_t *a = reinterpret_cast<world_header_t*>(world_base);
+  world_header_t *b = reinterpret_cast<world_header_t*>(
+                        world_base + WORLD_PAGE_SIZE / 2);
+  bool a_ok = header_ok(a);
+  bool b_ok = header_ok(b);
+  if (a_ok || b_ok) {
+    hdr = (a_ok && (!b_ok || a->gen >= b->gen)) ? *a : *b;
+    return true;
+  }
+  if (!memcmp(a->magic, WORLD_MAGIC, 4) && a->version >= 1 
+      && a->version < 3) {
+    hdr = *a;
+    return true;
+  }
+  return false;
+}
+
+/*
+ * Points every index entry that a checkpoint switched over without 
+ * committing back at the record it replaced
+ */
+static void roll_back_index() {
+  uint32_t *index = region_index();
+  bool changed = false;
+  for (int32_t k = 0; k < WORLD_SIZE * WORLD_SIZE; ++k) {
+    uint32_t len;
+    if (index[k] != 0 && index[k] <= hdr.slot_cnt
+        && slot_payload(index[k] - 1, k / WORLD_SIZE, k % WORLD_SIZE, &len)) {
+      world_record_t *rec = 
+        reinterpret_cast<world_record_t*>(record(index[k] - 1));
+      if (rec->gen > hdr.gen) {
+        index[k] = rec->prev;
+        changed = true;
+      }
+    }
+  }
+  // before the slots given up here are written over
+  if (changed) {
+    msync(index, WORLD_INDEX_SIZE, MS_SYNC);
+  }
+}
+
+/*
+ * Sorts every slot below slot_cnt into in use or free, from the index
+ */
+static void find_free_slots() {
+  std::vector<bool> used(hdr.slot_cnt, false);
+  uint32_t *index = region_index();
+  for (int32_t k = 0; k < WORLD_SIZE * WORLD_SIZE; ++k) {
+    if (index[k] != 0 && index[k] <= hdr.slot_cnt) {
+      used[index[k] - 1] = true;
+    }
+  }
+  free_slots.clear();
+  retired_slots.clear();
+  for (uint32_t s = hdr.slot_cnt; s-- > 0; ) {
+    if (!used[s]) {
+      free_slots.push_back(s);
+    }
+  }
+}
+
+/*
+ * Maps the world file at path, creating it if it does not exist. Regions
+ * loaded from then on are kept in the file and only a few stay in memory.
+ * Returns false if path is not a world file.
+ */
+bool world_open(const char *path) {
+  struct stat st;
+  if ((world_fd = open(path, O_RDWR | O_CREAT, 0644)) < 0) {
+    return false;
+  }
+  bool fresh = fstat(world_fd, &st) == 0 && st.st_size == 0;
+  if (fresh && ftruncate(world_fd, WORLD_DATA_OFFSET) == 0) {
+    world_len = WORLD_DATA_OFFSET;
+  } else if (!fresh && st.st_size >= static_cast<off_t>(WORLD_DATA_OFFSET)) {
+    world_len = st.st_size;
+  } else {
+    close(world_fd);
+    world_fd = -1;
+    return false;
+  }
+  void *p = mmap(NULL, world_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+                 world_fd, 0);
+  if (p == MAP_FAILED) {
+    close(world_fd);
+    world_fd = -1;
+    return false;
+  }
+  world_base = static_cast<uint8_t*>(p);
+
+  if (fresh) {
+    memset(&hdr, 0, sizeof (hdr));
+    memcpy(hdr.magic, WORLD_MAGIC, 4);
+    hdr.version = WORLD_VERSION;
+    hdr.world_size = WORLD_SIZE;
+    hdr.record_size = WORLD_RECORD_SIZE;
+    hdr.world_seed = world_seed;
+    hdr.sum = header_sum(&hdr);
+    *reinterpret_cast<world_header_t*>(world_base) = hdr;
+  }
+  if (!read_header() || hdr.world_size != WORLD_SIZE 
+      || hdr.player_len > WORLD_PLAYER_SIZE 
+      || (record_size = hdr.record_size) <= sizeof (world_record_t)
+      || WORLD_DATA_OFFSET + static_cast<size_t>(hdr.slot_cnt) * record_size
+         > world_len) {
+    munmap(world_base, world_len);
+    close(world_fd);
+    world_fd = -1;
+    world_base = NULL;
+    return false;
+  }
+  slot_capacity = (world_len - WORLD_DATA_OFFSET) / record_size;
+  // older world files keep their encoding, since they are read back as is
+  world_packed = hdr.version >= 2;
+  world_versioned = hdr.version >= 3;
+  record_header = world_versioned ? sizeof (world_record_t) 
+                                  : WORLD_OLD_RECORD_HEADER;
+  // a crash after slots were taken but before the header was written leaves
+  // the index pointing past slot_cnt
+  uint32_t *index = region_index();
+  for (int32_t k = 0; k < WORLD_SIZE * WORLD_SIZE; ++k) {
+    if (index[k] > hdr.slot_cnt && index[k] <= slot_capacity) {
+      hdr.slot_cnt = index[k];
+    }
+  }
+  if (world_versioned) {
+    roll_back_index();
+  }
+  find_free_slots();
+  last_checkpoint_tick = hdr.world_tick;
+  // everything generated into this world has to share its borders
+  world_seed = hdr.world_seed;
+  return true;
+}
+
+/*
+ * Writes everything back to the world file and unmaps it. Regions stay in
+ * memory until they are freed.
+ */
+void world_close() {
+  if (!world_active()) {
+    return;
+  }
+  world_checkpoint(true);
+  munmap(world_base, world_len);
+  close(world_fd);
+  world_fd = -1;
+  world_base = NULL;
+  resident.clear();
+  pending.clear();
+}
+
+bool world_active() {
+  return world_base != NULL;
+}
+
+/*
+ * True once a player has been written to the world, false for a new world
+ */
+bool world_has_player() {
+  return world_active() && hdr.player_len > 0;
+}
+
+/*
+ * Restores the player and the region it stands in from the world file.
+ * Returns false if either record is damaged.
+ */
+bool world_load_player() {
+  uint8_t *player = player_copy(hdr.gen);
+  if (hdr.player_len > player_capacity()
+      || (world_versioned 
+          && hdr.player_sum != fnv1a32(player, hdr.player_len))) {
+    return false;
+  }
+  FILE *f = fmemopen(player, hdr.player_len, "rb");
+  if (!f) {
+    return false;
+  }
+  SaveReader in(f, world_packed);
+  pc = new Pc(&in);
+  fclose(f);
+  world_tick = hdr.world_tick;
+  if (!in.good() || pc->get_x() >= WORLD_SIZE || pc->get_y() >= WORLD_SIZE
+      || !(region_ptr[pc->get_x()][pc->get_y()] =
+           world_load_region(pc->get_x(), pc->get_y()))) {
+    return false;
+  }
+  world_touch(pc->get_x(), pc->get_y());
+  return true;
+}
+
+/*
+ * Reads the N, E, S and W exits of a stored region straight from its record,
+ * without loading the region. Returns false if the region is not stored.
+ */
+bool world_region_exits(int32_t x, int32_t y, int32_t exits[4]) {
+  uint32_t len;
+  uint8_t *payload;
+  if (!world_active() || !(payload = record_payload(x, y, &len)) || len < 4) {
+    return false;
+  }
+  for (int32_t k = 0; k < 4; ++k) {
+    exits[k] = payload[k];
+  }
+  // a damaged record is left to world_load_region to turn down
+  return valid_exits(exits[0], exits[1], exits[2], exits[3]);
+}
+
+/*
+ * Builds region x, y from its record. The record is read in place, so the
+ * only I/O is the kernel faulting in its pages. Returns NULL if the region
+ * is not stored or the record is damaged.
+ */
+Region* world_load_region(int32_t x, int32_t y) {
+  uint32_t len;
+  uint8_t *payload;
+  if (!world_active() || !(payload = record_payload(x, y, &len))) {
+    return NULL;
+  }
+  FILE *f = fmemopen(payload, len, "rb");
+  if (!f) {
+    return NULL;
+  }
+  SaveReader in(f, world_packed);
+  Region *r = new Region(&in);
+  fclose(f);
+  if (!in.good()) {
+    delete r;
+    return NULL;
+  }
+  r->clear_dirty();
+  return r;
+}
+
+/*
+ * Writes the least recently used regions out of memory until no more than 
+ * WORLD_RESIDENT_REGIONS are loaded. The region the player just left is 
+ * never evicted, since its trainers are still in the move queue until it is
+ * rebuilt. Their records wait for the next checkpoint to be published.
+ */
+static void evict() {
+  std::vector<int32_t> gone;
+  for (size_t k = 0; resident.size() - gone.size() > WORLD_RESIDENT_REGIONS
+                     && k + 2 < resident.size(); ++k) {
+    int32_t ex = resident[k] / WORLD_SIZE;
+    int32_t ey = resident[k] % WORLD_SIZE;
+    if (region_ptr[ex][ey]->is_dirty() || stored_slot(ex, ey) < 0) {
+      int32_t slot = write_record(ex, ey);
+      if (slot < 0) {
+        // too big for a record slot, so it has to stay in memory
+        continue;
+      }
+      keep_pending(ex, ey, slot);
+    }
+    gone.push_back(resident[k]);
+  }
+  for (auto it = gone.begin(); it != gone.end(); ++it) {
+    delete region_ptr[*it / WORLD_SIZE][*it % WORLD_SIZE];
+    region_ptr[*it / WORLD_SIZE][*it % WORLD_SIZE] = NULL;
+    resident.erase(std::find(resident.begin(), resident.end(), *it));
+  }
+}
+
+/*
+ * Moves region x, y to the most recently used end
+ */
+static void mark_used(int32_t x, int32_t y) {
+  int32_t key = x * WORLD_SIZE + y;
+  auto it = std::find(resident.begin(), resident.end(), key);
+  if (it != resident.end()) {
+    resident.erase(it);
+  }
+  resident.push_back(key);
+}
+
+/*
+ * Marks region x, y as the most recently used one and writes the least
+ * recently used regions out of memory once more than WORLD_RESIDENT_REGIONS
+ * are loaded
+ */
+void world_touch(int32_t x, int32_t y) {
+  if (!world_active()) {
+    return;
+  }
+  mark_used(x, y);
+  evict();
+}
+
+/*
+ * Same as world_touch for many regions, evicting only once at the end
+ */
+void world_touch_all(const std::vector<int32_t> &keys) {
+  if (!world_active()) {
+    return;
+  }
+  for (auto it = keys.begin(); it != keys.end(); ++it) {
+    mark_used(*it / WORLD_SIZE, *it % WORLD_SIZE);
+  }
+  evict();
+}
+
+/*
+ * Writes the player and every changed region in memory to the world file
+ * and commits them, along with the regions written out since the last
+ * checkpoint, with a new header. With sync, waits until the header is on 
+ * disk too, otherwise the kernel writes it back whenever it likes.
+ */
+void world_checkpoint(bool sync) {
+  if (!world_active()) {
+    return;
+  }
+  // the slots the last checkpoint switched away from are free once its 
+  // header is on disk
+  msync(world_base, WORLD_PAGE_SIZE, MS_SYNC);
+  free_slots.insert(free_slots.end(), retired_slots.begin(), 
+                    retired_slots.end());
+  retired_slots.clear();
+
+  world_header_t next = hdr;
+  ++next.gen;
+  next.world_tick = world_tick;
+
+  // a pregenerated world has no player yet, one loaded from the file is 
+  // carried over to the spare record
+  char *buf = NULL;
+  size_t len = 0;
+  if (pc) {
+    FILE *f = open_memstream(&buf, &len);
+    SaveWriter out(f, world_packed);
+    pc->save(&out);
+    fclose(f);
+  }
+  if (pc && len <= player_capacity()) {
+    memcpy(player_copy(next.gen), buf, len);
+    next.player_len = len;
+    next.player_sum = fnv1a32(buf, len);
+  } else if (world_versioned) {
+    memcpy(player_copy(next.gen), player_copy(hdr.gen), hdr.player_len);
+  }
+  free(buf);
+
+  for (auto it = resident.begin(); it != resident.end(); ++it) {
+    int32_t x = *it / WORLD_SIZE;
+    int32_t y = *it % WORLD_SIZE;
+    int32_t slot;
+    if (region_ptr[x][y]->is_dirty() && (slot = write_record(x, y)) >= 0) {
+      keep_pending(x, y, slot);
+    }
+  }
+  // new records and the player before the index, the index before the header
+  msync(world_base, world_len, MS_SYNC);
+  for (auto it = pending.begin(); it != pending.end(); ++it) {
+    publish_record(it->first / WORLD_SIZE, it->first % WORLD_SIZE, it->second);
+  }
+  pending.clear();
+  msync(world_base + WORLD_INDEX_OFFSET, WORLD_INDEX_SIZE, MS_SYNC);
+
+  next.slot_cnt = hdr.slot_cnt;
+  next.sum = header_sum(&next);
+  *header_copy(next.gen) = next;
+  hdr = next;
+  msync(world_base, WORLD_PAGE_SIZE, sync ? MS_SYNC : MS_ASYNC);
+  last_checkpoint_tick = world_tick;
+}
+
+/*
+ * Called once per frame, checkpoints whenever enough game time has passed
+ */
+void world_autosave_tick() {
+  if (world_active() && world_tick - last_checkpoint_tick >= AUTOSAVE_TICKS) {
+    world_checkpoint(false);
+  }
+}
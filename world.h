@@ -0,0 +1,24 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <cstdint>
+#include <vector>
+
+#include "region.h"
+
+#define WORLD_MAGIC "PKWD"
+#define WORLD_VERSION 3
+
+bool world_open(const char *path);
+void world_close();
+bool world_active();
+bool world_has_player();
+bool world_load_player();
+bool world_region_exits(int32_t x, int32_t y, int32_t exits[4]);
+Region* world_load_region(int32_t x, int32_t y);
+void world_touch(int32_t x, int32_t y);
+void world_touch_all(const std::vector<int32_t> &keys);
+void world_checkpoint(bool sync);
+void world_autosave_tick();
+
+#endif